@@ -0,0 +1,89 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "utility/math/TransformStore.h"
+
+// Compares the SIMD batch transform kernels against the per-object glm path that they replace.
+//
+// Usage: transform_bench [numObjects] [numIterations]
+
+static const size_t objectBlockStride = 256; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT on most hardware.
+
+template<typename F>
+static double timeMilliseconds(int iterations, F func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char *argv[]) {
+    int numObjects = (argc > 1) ? std::atoi(argv[1]) : 10000;
+    int numIterations = (argc > 2) ? std::atoi(argv[2]) : 100;
+
+    std::mt19937 gen(3320);
+    std::uniform_real_distribution<float> distrib(-1, 1);
+
+    std::vector<glm::mat4> worlds;
+    utility::math::TransformStore store;
+    store.allocate(numObjects);
+    for (int i = 0; i < numObjects; i++) {
+        glm::vec3 pos = glm::vec3(distrib(gen), distrib(gen), distrib(gen)) * 100.0f;
+        glm::vec3 dir = glm::normalize(glm::vec3(distrib(gen), distrib(gen), distrib(gen)) + glm::vec3(0, 0, 2));
+        glm::mat4 world = glm::inverse(glm::lookAt(pos, pos + dir, glm::vec3(0, 0, 1)));
+        worlds.push_back(world);
+        store.set(i, world);
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(-20, 0, 5), glm::vec3(0, 0, 5), glm::vec3(0, 0, 1));
+    glm::mat4 proj = glm::perspective(float(M_PI_4), 4.0f / 3.0f, 1.0f, 1000.0f);
+
+    std::vector<unsigned char> scalarOut(numObjects * objectBlockStride);
+    std::vector<unsigned char> simdOut(numObjects * objectBlockStride);
+
+    // The previous path: three glm multiplies per object per camera.
+    double scalarMs = timeMilliseconds(numIterations, [&]() {
+        for (int i = 0; i < numObjects; i++) {
+            glm::mat4 results[3] = {worlds[i], view * worlds[i], proj * view * worlds[i]};
+            std::memcpy(&scalarOut[i * objectBlockStride], results, sizeof(results));
+        }
+    });
+
+    double simdMs = timeMilliseconds(numIterations, [&]() {
+        store.computeViewTransforms(view, proj, simdOut.data(), objectBlockStride);
+    });
+
+    float maxError = 0;
+    for (int i = 0; i < numObjects; i++) {
+        const float *a = reinterpret_cast<const float *>(&scalarOut[i * objectBlockStride]);
+        const float *b = reinterpret_cast<const float *>(&simdOut[i * objectBlockStride]);
+        for (int k = 0; k < 48; k++) {
+            maxError = std::max(maxError, std::abs(a[k] - b[k]) / std::max(1.0f, std::abs(a[k])));
+        }
+    }
+
+#if defined(__AVX__)
+    const char *kernel = "AVX";
+#elif defined(UTILITY_MATH_TRANSFORM_STORE_SSE)
+    const char *kernel = "SSE";
+#else
+    const char *kernel = "scalar";
+#endif
+
+    std::cout << "objects: " << numObjects << ", iterations: " << numIterations << ", kernel: " << kernel << std::endl;
+    std::cout << "glm per object: " << scalarMs << " ms (" << (scalarMs * 1e6 / numObjects) << " ns/object)" << std::endl;
+    std::cout << "TransformStore: " << simdMs << " ms (" << (simdMs * 1e6 / numObjects) << " ns/object)" << std::endl;
+    std::cout << "speedup: " << (scalarMs / simdMs) << "x, max relative error: " << maxError << std::endl;
+
+    return (maxError < 1e-4f) ? 0 : 1;
+}
@@ -20,7 +20,7 @@ namespace NUGL {
         }
 
         template<typename T>
-        inline void setData(GLenum target, std::vector<T> data, GLenum usage) {
+        inline void setData(GLenum target, const std::vector<T>& data, GLenum usage) {
             bind(target);
             glBufferData(target, data.size() * sizeof(T), data.data(), usage);
         }
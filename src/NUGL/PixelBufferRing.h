@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "utility/debug.h"
+#include "utility/make_unique.h"
+#include "NUGL/Buffer.h"
+
+namespace NUGL {
+    /**
+     * A ring of pixel unpack buffers used to stream texture data to the GPU.
+     *
+     * Pixels are copied into the next free buffer and the texture upload is then sourced from that buffer
+     * instead of from client memory, so glTexImage2D returns without waiting for the driver to copy the data.
+     * A fence is inserted after each upload, and a slot is only rewritten once its fence has signalled.
+     */
+    class PixelBufferRing {
+    public:
+        inline PixelBufferRing(GLsizeiptr initialSlotSize = 4 * 1024 * 1024, int numSlots = 3) {
+            if (numSlots < 1) {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": numSlots must be at least 1 (numSlots == " << numSlots << ").";
+                throw std::invalid_argument(errMsg.str());
+            }
+
+            for (int i = 0; i < numSlots; i++) {
+                slots.emplace_back();
+                auto& slot = slots.back();
+                slot.buffer = std::make_unique<Buffer>();
+                slot.buffer->bind(GL_PIXEL_UNPACK_BUFFER);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, initialSlotSize, nullptr, GL_STREAM_DRAW);
+                slot.capacity = initialSlotSize;
+            }
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+        }
+
+        inline ~PixelBufferRing() {
+            for (auto& slot : slots) {
+                if (slot.fence != nullptr)
+                    glDeleteSync(slot.fence);
+            }
+        }
+
+        PixelBufferRing(const PixelBufferRing&) = delete;
+        PixelBufferRing& operator=(const PixelBufferRing&) = delete;
+
+        /**
+         * Copies size bytes of pixel data into the next free slot and leaves that slot bound to
+         * GL_PIXEL_UNPACK_BUFFER.
+         *
+         * Returns the value to pass as the pixels argument of the following glTexImage call.
+         * Every call must be paired with a call to release() once the upload has been issued.
+         */
+        inline const GLvoid* stage(const GLvoid* pixels, GLsizeiptr size) {
+            auto& slot = slots[nextSlot];
+            waitForSlot(slot);
+
+            slot.buffer->bind(GL_PIXEL_UNPACK_BUFFER);
+            if (size > slot.capacity) {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+                slot.capacity = size;
+            }
+
+            // The slot's fence has signalled, so no pending upload reads from it.
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (dst == nullptr) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                std::stringstream errMsg;
+                errMsg << __func__ << ": Could not map pixel buffer of size " << size << ".";
+                throw std::runtime_error(errMsg.str());
+            }
+
+            std::memcpy(dst, pixels, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+
+            // Texture uploads take an offset into the bound unpack buffer.
+            return nullptr;
+        }
+
+        //! Fences the upload sourced from the current slot, unbinds it, and advances the ring.
+        inline void release() {
+            auto& slot = slots[nextSlot];
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+
+            nextSlot = (nextSlot + 1) % slots.size();
+        }
+
+    private:
+        struct Slot {
+            std::unique_ptr<Buffer> buffer;
+            GLsizeiptr capacity = 0;
+            GLsync fence = nullptr;
+        };
+
+        inline void waitForSlot(Slot& slot) {
+            if (slot.fence == nullptr)
+                return;
+
+            // Only blocks when every slot is still being read by the GPU.
+            GLenum result;
+            do {
+                result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+
+            if (result == GL_WAIT_FAILED) {
+                checkForAndPrintGLError(__FILE__, __LINE__);
+            }
+
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+
+        std::vector<Slot> slots;
+        unsigned nextSlot = 0;
+    };
+}
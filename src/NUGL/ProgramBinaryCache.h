@@ -0,0 +1,166 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <boost/filesystem.hpp>
+
+#include "utility/debug.h"
+
+namespace NUGL {
+    /**
+     * An on-disk cache of linked program binaries (ARB_get_program_binary), so that programs need not be compiled
+     * from source on every launch.
+     *
+     * Binaries are stored by a key hashed from everything that determines the linked program: the shader sources,
+     * the bind locations, and the driver's vendor, renderer, and version strings. A binary that the driver rejects
+     * (e.g. after a driver update that does not change the version string) is ignored, and the program is compiled
+     * from source and stored again.
+     */
+    class ProgramBinaryCache {
+    public:
+        //! Binaries are stored in this directory. The cache is disabled while it is empty.
+        static inline std::string& directory() {
+            static std::string dir;
+            return dir;
+        }
+
+        static inline bool enabled() {
+            return !directory().empty() && (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary);
+        }
+
+        //! Accumulates the parts of a program's key (a 64-bit FNV-1a hash).
+        class Key {
+        public:
+            inline Key() {
+                // Binaries are only valid for the driver that produced them:
+                add(reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+                add(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+                add(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+            }
+
+            inline Key& add(const char* str) {
+                return add(str, str != nullptr ? std::strlen(str) : 0);
+            }
+
+            inline Key& add(const std::string& str) {
+                return add(str.data(), str.size());
+            }
+
+            inline Key& add(uint64_t value) {
+                return add(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            // Each part is followed by its length, so that different splits of the same bytes give different keys.
+            inline Key& add(const char* data, size_t size) {
+                for (size_t i = 0; i < size; i++) {
+                    hash ^= uint8_t(data[i]);
+                    hash *= 1099511628211ull;
+                }
+                for (size_t i = 0; i < sizeof(size); i++) {
+                    hash ^= uint8_t(size >> (8 * i));
+                    hash *= 1099511628211ull;
+                }
+                return *this;
+            }
+
+            inline uint64_t value() const {
+                return hash;
+            }
+
+        private:
+            uint64_t hash = 14695981039346656037ull;
+        };
+
+        /**
+         * Loads the program's binary from the cache. Returns true if the program was linked from it, or false if
+         * there is no usable binary for the key (in which case the program must be linked from source).
+         */
+        static inline bool load(GLuint programId, uint64_t key) {
+            std::ifstream file(fileName(key), std::ifstream::binary);
+            if (!file)
+                return false;
+
+            Header header;
+            if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+                    std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+                    header.version != version || header.key != key)
+                return false;
+
+            std::vector<char> binary(header.length);
+            if (!file.read(binary.data(), header.length))
+                return false;
+
+            glProgramBinary(programId, header.format, binary.data(), GLsizei(header.length));
+            checkForAndPrintGLError(__FILE__, __LINE__);
+
+            GLint linkStatus;
+            glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+            return linkStatus == GL_TRUE;
+        }
+
+        /**
+         * Stores the binary of a linked program in the cache. The program must have been linked with
+         * GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+         *
+         * Failing to write the cache is not an error: it is reported, and the program is compiled again next time.
+         */
+        static inline void save(GLuint programId, uint64_t key) {
+            GLint linkStatus;
+            glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+            GLint length = 0;
+            glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (linkStatus != GL_TRUE || length <= 0)
+                return;
+
+            Header header;
+            std::memcpy(header.magic, magic(), sizeof(header.magic));
+            header.version = version;
+            header.key = key;
+
+            std::vector<char> binary(size_t(length), 0);
+            GLsizei written = 0;
+            glGetProgramBinary(programId, length, &written, &header.format, binary.data());
+            checkForAndPrintGLError(__FILE__, __LINE__);
+            header.length = uint32_t(written);
+
+            boost::system::error_code error;
+            boost::filesystem::create_directories(directory(), error);
+
+            std::ofstream file(fileName(key), std::ofstream::binary);
+            if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+                    !file.write(binary.data(), written)) {
+                std::cerr << __func__ << ": Could not write '" << fileName(key) << "'." << std::endl;
+            }
+        }
+
+    private:
+        // Files hold a header followed by the binary, in host byte order:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint64_t key;
+            GLenum format;
+            uint32_t length;
+        };
+
+        static const uint32_t version = 1;
+
+        static inline const char* magic() {
+            return "NUPB";
+        }
+
+        static inline std::string fileName(uint64_t key) {
+            std::stringstream name;
+            name << directory() << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+            return name.str();
+        }
+    };
+}
@@ -87,6 +87,20 @@ namespace NUGL {
             printShaderDebugInfo(shaderId);
         }
 
+        //! Throws std::logic_error, with the info log, if the shader failed to compile.
+        inline void checkCompileStatus(const std::string& programName) {
+            GLint compileStatus;
+            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &compileStatus);
+            if (compileStatus == GL_TRUE)
+                return;
+
+            char infoLogBuff[512] = {0};
+            glGetShaderInfoLog(shaderId, 512, nullptr, infoLogBuff);
+            std::stringstream errMsg;
+            errMsg << __func__ << ": Compile error in a shader of program '" << programName << "': " << infoLogBuff << ".";
+            throw std::logic_error(errMsg.str());
+        }
+
         inline GLuint id() const {
             return shaderId;
         }
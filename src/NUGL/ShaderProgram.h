@@ -3,6 +3,7 @@
 #include <vector>
 #include <memory>
 #include <cstdint>
+#include <map>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -14,6 +15,9 @@
 #include "utility/debug.h"
 #include "NUGL/Shader.h"
 #include "NUGL/Texture.h"
+#include "NUGL/ProgramBinaryCache.h"
+#include "NUGL/ShaderSource.h"
+#include "utility/AllocationCounter.h"
 
 namespace NUGL {
     union MaterialInfo {
@@ -80,7 +84,7 @@ namespace NUGL {
         }
     }
 
-    class ShaderProgram {
+    class ShaderProgram : public std::enable_shared_from_this<ShaderProgram> {
     public:
         ShaderProgram() {
             programId = glCreateProgram();
@@ -94,14 +98,12 @@ namespace NUGL {
             return createFromFiles("NO_NAME", shaders);
         }
 
+        //! The shaders are compiled by link(), unless the program's binary is in the ProgramBinaryCache.
         static inline std::shared_ptr<ShaderProgram> createSharedFromFiles(const std::string& name, std::vector<std::pair<GLenum, std::string>> shaders) {
             auto program = std::make_shared<ShaderProgram>(name);
 
             for (auto& pair : shaders) {
-                auto shader = std::make_shared<Shader>(pair.first, pair.second);
-                shader->compile();
-                shader->printDebugInfo();
-                program->attachShader(shader);
+                program->addShaderSourceFromFile(pair.first, pair.second);
             }
             return program;
         }
@@ -110,10 +112,7 @@ namespace NUGL {
             ShaderProgram program(name);
 
             for (auto& pair : shaders) {
-                auto shader = std::make_shared<Shader>(pair.first, pair.second);
-                shader->compile();
-                shader->printDebugInfo();
-                program.attachShader(shader);
+                program.addShaderSourceFromFile(pair.first, pair.second);
             }
             return program;
         }
@@ -128,30 +127,216 @@ namespace NUGL {
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
         }
 
+        /**
+         * Adds a shader to be compiled and attached when the program is linked. The source is preprocessed by
+         * preprocessShaderFile, with the program's features defined.
+         */
+        inline void addShaderSourceFromFile(GLenum shaderType, const std::string& fileName) {
+            shaderFiles.emplace_back(shaderType, fileName);
+            shaderSources.emplace_back(shaderType, preprocessShaderFile(fileName, programFeatures));
+            usedFeatures |= ShaderFeatures::usedBy(shaderSources.back().second);
+        }
+
+        /**
+         * Returns the variant of the program compiled for the given features (see ShaderFeatures), creating and
+         * linking it if this is the first time it was requested. Features that the program's sources do not test
+         * for are ignored, so the program itself is returned if it does not use any of them.
+         *
+         * Must be called on a program created by createSharedFromFiles (not on a variant).
+         */
+        inline std::shared_ptr<ShaderProgram> variant(uint32_t features) {
+            features &= usedFeatures;
+            if (features == programFeatures)
+                return shared_from_this();
+
+            for (auto& pair : variants) {
+                if (pair.first == features)
+                    return pair.second;
+            }
+
+            // Variants are usually requested while the scene loads, but may first be needed mid-frame:
+            utility::ScopedAllowAllocations allow;
+
+            auto program = std::make_shared<ShaderProgram>(programName + " [" + ShaderFeatures::str(features) + "]");
+            program->programFeatures = features;
+            for (auto& file : shaderFiles) {
+                program->addShaderSourceFromFile(file.first, file.second);
+            }
+            for (auto& location : fragDataLocations) {
+                program->bindFragDataLocation(location.first, location.second);
+            }
+            program->link();
+
+            variants.emplace_back(features, program);
+            return program;
+        }
+
         inline void bindFragDataLocation(GLuint colorNumber, const std::string& name) {
             glBindFragDataLocation(programId, colorNumber, name.c_str());
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
+            fragDataLocations.emplace_back(colorNumber, name);
         }
 
+        /**
+         * Starts linking the program, from its binary in the ProgramBinaryCache if there is one, or otherwise by
+         * compiling the shader sources added with addShaderSourceFromFile.
+         *
+         * Nothing here waits for the driver: compile and link errors are reported, and the program's uniform block
+         * bindings and material info are set, when the program is first used or queried (see finishLink). Linking
+         * every program before using any of them lets the driver compile them in parallel (with
+         * KHR_parallel_shader_compile), and overlap compilation with loading the rest of the scene.
+         */
         inline void link() {
-            glLinkProgram(programId);
-            checkForAndPrintGLError(__FILE__, __LINE__, programName);
+            bool useCache = !shaderSources.empty() && ProgramBinaryCache::enabled();
+            if (useCache) {
+                ProgramBinaryCache::Key key;
+                for (auto& source : shaderSources) {
+                    key.add(uint64_t(source.first)).add(source.second);
+                }
+                for (auto& location : fragDataLocations) {
+                    key.add(uint64_t(location.first)).add(location.second);
+                }
+                binaryCacheKey = key.value();
+            }
+
+            saveBinary = false;
+            if (useCache && ProgramBinaryCache::load(programId, binaryCacheKey)) {
+                std::cout << "Loaded shader program '" << programName << "' from the program binary cache." << std::endl;
+            } else {
+                compileShaderSources();
+
+                if (useCache)
+                    glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+                glLinkProgram(programId);
+                checkForAndPrintGLError(__FILE__, __LINE__, programName);
+                saveBinary = useCache;
+            }
+
+            linkPending = true;
+        }
+
+        /**
+         * Waits for the link started by link() to finish. Throws std::logic_error if a shader failed to compile or
+         * the program failed to link.
+         *
+         * Called by every method that uses the linked program, so it need not be called directly.
+         */
+        inline void finishLink() {
+            if (!linkPending)
+                return;
+            linkPending = false;
+
+            // Only the status is checked, as printing the full debug info here would stall the frame that needs the
+            // program (see printDebugInfo):
+            for (auto& shader : shaders) {
+                shader->checkCompileStatus(programName);
+            }
+            checkLinkStatus();
+
+            if (saveBinary)
+                ProgramBinaryCache::save(programId, binaryCacheKey);
+
+            // Uniform block bindings are not part of the program binary, so they are set either way:
+            for (auto& pair : uniformBlockBindings()) {
+                bindUniformBlockIfActive(pair.first, pair.second);
+            }
+
+            updateMaterialInfo();
+
+            GLint activeAttributes = 0;
+            glGetProgramiv(programId, GL_ACTIVE_ATTRIBUTES, &activeAttributes);
+            positionOnly = (activeAttributes == 1 && glGetAttribLocation(programId, "position") != -1);
 
             // TODO: After linking, detach all shaders and remove them from the shaders list.
         }
 
+        /**
+         * Returns whether the program is ready to use, without waiting for the link started by link() when the
+         * driver supports KHR_parallel_shader_compile (and otherwise by finishing it). Once the driver has finished,
+         * the link is completed (see finishLink), so that using the program does not block.
+         *
+         * Render passes skip draws whose programs are not yet ready, rather than stall the frame.
+         */
+        inline bool isLinkComplete() {
+            if (!linkPending)
+                return true;
+
+#ifdef GL_KHR_parallel_shader_compile
+            if (GLEW_KHR_parallel_shader_compile) {
+                GLint complete = GL_FALSE;
+                glGetProgramiv(programId, GL_COMPLETION_STATUS_KHR, &complete);
+                if (complete != GL_TRUE)
+                    return false;
+            }
+#endif
+
+            finishLink();
+            return true;
+        }
+
+        //! Lets the driver compile shaders on as many threads as it likes. Returns false if it does not support it.
+        static inline bool enableParallelCompilation() {
+#ifdef GL_KHR_parallel_shader_compile
+            if (GLEW_KHR_parallel_shader_compile) {
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                return true;
+            }
+#endif
+            return false;
+        }
+
+        //! Uniform blocks with these names are assigned to the given binding points when a program is linked.
+        static inline std::map<std::string, GLuint>& uniformBlockBindings() {
+            static std::map<std::string, GLuint> bindings;
+            return bindings;
+        }
+
+        inline bool uniformBlockIsActive(const std::string& name) {
+            return uniformBlockIsActive(name.c_str());
+        }
+
+        inline bool uniformBlockIsActive(const char* name) {
+            finishLink();
+            return glGetUniformBlockIndex(programId, name) != GL_INVALID_INDEX;
+        }
+
+        inline void bindUniformBlockIfActive(const std::string& name, GLuint binding) {
+            finishLink();
+            GLuint blockIndex = glGetUniformBlockIndex(programId, name.c_str());
+            if (blockIndex == GL_INVALID_INDEX)
+                return;
+
+            glUniformBlockBinding(programId, blockIndex, binding);
+            checkForAndPrintGLError(__FILE__, __LINE__, programName);
+        }
+
         inline void use() {
+            finishLink();
             glUseProgram(programId);
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
         }
 
+        /*
+         * The name lookups also accept C strings, as constructing a std::string from a literal longer than the
+         * small string buffer would allocate on every draw.
+         */
         inline bool uniformIsActive(const std::string& name) {
-            GLint uniLoc = glGetUniformLocation(programId, name.c_str());
+            return uniformIsActive(name.c_str());
+        }
+
+        inline bool uniformIsActive(const char* name) {
+            finishLink();
+            GLint uniLoc = glGetUniformLocation(programId, name);
             return (uniLoc != -1);
         }
 
         inline GLint getUniformLocation(const std::string& name) {
-            GLint uniLoc = glGetUniformLocation(programId, name.c_str());
+            return getUniformLocation(name.c_str());
+        }
+
+        inline GLint getUniformLocation(const char* name) {
+            finishLink();
+            GLint uniLoc = glGetUniformLocation(programId, name);
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
 
             if (uniLoc == -1) {
@@ -164,12 +349,20 @@ namespace NUGL {
             return uniLoc;
         }
 
+        //! Returns whether position is the only vertex attribute the program reads (e.g. depth-only programs).
+        inline bool readsPositionOnly() {
+            finishLink();
+            return positionOnly;
+        }
+
         inline bool attributeIsActive(const std::string& name) {
+            finishLink();
             GLint attribLoc = glGetAttribLocation(programId, name.c_str());
             return (attribLoc != -1);
         }
 
         inline GLint getAttribLocation(const std::string& name) {
+            finishLink();
             GLint attribLoc = glGetAttribLocation(programId, name.c_str());
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
 
@@ -184,26 +377,52 @@ namespace NUGL {
         }
 
         inline void printDebugInfo() {
+            finishLink();
             printProgramDebugInfo(programId, programName);
         }
 
+        //! Throws std::logic_error, with the info log, if the program failed to link.
+        inline void checkLinkStatus() {
+            GLint linkStatus;
+            glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+            if (linkStatus == GL_TRUE)
+                return;
+
+            char infoLogBuff[512] = {0};
+            glGetProgramInfoLog(programId, 512, nullptr, infoLogBuff);
+            std::stringstream errMsg;
+            errMsg << __func__ << ": Link error in shader program '" << programName << "': " << infoLogBuff << ".";
+            throw std::logic_error(errMsg.str());
+        }
+
         inline GLuint id() const {
             return programId;
         }
 
         inline void validate() {
+            finishLink();
             glValidateProgram(programId);
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
         }
 
         template<typename T>
         inline void setUniformIfActive(const std::string& name, const T& value) {
+            setUniformIfActive(name.c_str(), value);
+        }
+
+        template<typename T>
+        inline void setUniformIfActive(const char* name, const T& value) {
             if (uniformIsActive(name))
                 setUniform(name, value);
         }
 
         template<typename T>
         inline void setUniform(const std::string& name, const T& value) {
+            setUniform(name.c_str(), value);
+        }
+
+        template<typename T>
+        inline void setUniform(const char* name, const T& value) {
             GLint uniLoc = getUniformLocation(name);
             setUniform(uniLoc, value);
         }
@@ -227,7 +446,7 @@ namespace NUGL {
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
         }
 
-        inline void setUniform(GLint uniLoc, std::shared_ptr<NUGL::Texture> value) {
+        inline void setUniform(GLint uniLoc, const std::shared_ptr<NUGL::Texture>& value) {
             glUniform1i(uniLoc, value->unit() - GL_TEXTURE0);
             checkForAndPrintGLError(__FILE__, __LINE__, programName);
         }
@@ -240,6 +459,7 @@ namespace NUGL {
 
         //! Populates the program's material info.
         inline void updateMaterialInfo() {
+            finishLink();
             materialInfo.bitSet = 0;
             materialInfo.has.colAmbient = uniformIsActive("colAmbient");
             materialInfo.has.colDiffuse = uniformIsActive("colDiffuse");
@@ -268,8 +488,28 @@ namespace NUGL {
         }
 
     private:
+        inline void compileShaderSources() {
+            for (auto& source : shaderSources) {
+                auto shader = std::make_shared<Shader>(source.first);
+                shader->setSource(source.second);
+                shader->compile(); // The compile status is checked by finishLink.
+                attachShader(shader);
+            }
+            shaderSources.clear();
+        }
+
         GLuint programId;
         std::vector<std::shared_ptr<Shader>> shaders;
+        std::vector<std::pair<GLenum, std::string>> shaderFiles;
+        std::vector<std::pair<GLenum, std::string>> shaderSources; // Sources that link() has not yet compiled.
+        uint32_t programFeatures = 0; // The features this program was compiled for.
+        uint32_t usedFeatures = 0; // The features its sources test for.
+        std::vector<std::pair<uint32_t, std::shared_ptr<ShaderProgram>>> variants;
+        std::vector<std::pair<GLuint, std::string>> fragDataLocations;
+        bool linkPending = false; // Set by link() until finishLink() has checked the result.
+        bool saveBinary = false;
+        bool positionOnly = false;
+        uint64_t binaryCacheKey = 0;
 
         std::string programName; //!< Identifies the program in debug messages
 
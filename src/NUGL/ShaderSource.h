@@ -0,0 +1,161 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <cstdint>
+
+#include "utility/strutil.h"
+
+namespace NUGL {
+    /**
+     * Features that shader variants are specialised for at compile time.
+     *
+     * Each feature is defined as a preprocessor macro (e.g. HAS_TEX_DIFFUSE) in the variants that have it, so that
+     * shaders can test for it with #ifdef rather than branching on a uniform.
+     */
+    struct ShaderFeatures {
+        enum : uint32_t {
+            texDiffuse        = 1 << 0,
+            texHeight         = 1 << 1,
+            texEnvironmentMap = 1 << 2,
+            spotlight         = 1 << 3,
+            directionalLight  = 1 << 4,
+            shadowMap         = 1 << 5,
+            lightIndependent  = 1 << 6, // Only the terms that do not depend on the light (see Scene::forwardRender).
+        };
+
+        static const int count = 7;
+
+        static inline const char* macroName(int bit) {
+            static const char* names[count] = {
+                    "HAS_TEX_DIFFUSE",
+                    "HAS_TEX_HEIGHT",
+                    "HAS_TEX_ENVIRONMENT_MAP",
+                    "LIGHT_SPOT",
+                    "LIGHT_DIRECTIONAL",
+                    "LIGHT_SHADOW_MAP",
+                    "LIGHT_INDEPENDENT",
+            };
+            return names[bit];
+        }
+
+        /**
+         * Returns the features whose macros appear in the source's preprocessor directives (i.e. the features that
+         * its variants can differ in).
+         */
+        static inline uint32_t usedBy(const std::string& source) {
+            uint32_t used = 0;
+            std::stringstream in(source);
+            std::string line;
+            while (std::getline(in, line)) {
+                size_t start = line.find_first_not_of(" \t");
+                if (start == std::string::npos || line[start] != '#')
+                    continue;
+
+                for (int bit = 0; bit < count; bit++) {
+                    if (line.find(macroName(bit), start) != std::string::npos)
+                        used |= uint32_t(1) << bit;
+                }
+            }
+            return used;
+        }
+
+        //! Describes the features for program names in debug messages, e.g. "HAS_TEX_DIFFUSE|LIGHT_SPOT".
+        static inline std::string str(uint32_t features) {
+            std::string names;
+            for (int bit = 0; bit < count; bit++) {
+                if (features & (uint32_t(1) << bit)) {
+                    if (!names.empty())
+                        names += "|";
+                    names += macroName(bit);
+                }
+            }
+            return names;
+        }
+    };
+
+    namespace detail {
+        inline void appendShaderFile(std::stringstream& out, const std::string& fileName,
+                std::vector<std::string>& files, std::vector<std::string>& includeStack, const std::string& defines) {
+            for (auto& including : includeStack) {
+                if (including == fileName) {
+                    std::stringstream errMsg;
+                    errMsg << __func__ << ": '" << fileName << "' includes itself.";
+                    throw std::invalid_argument(errMsg.str());
+                }
+            }
+
+            // Files are included at most once, as if they all began with '#pragma once':
+            for (auto& file : files) {
+                if (file == fileName)
+                    return;
+            }
+
+            int sourceNumber = int(files.size());
+            files.push_back(fileName);
+            includeStack.push_back(fileName);
+
+            std::string directory;
+            size_t slash = fileName.find_last_of('/');
+            if (slash != std::string::npos)
+                directory = fileName.substr(0, slash + 1);
+
+            std::stringstream in(utility::strutil::getFileString(fileName));
+            std::string line;
+            int lineNumber = 0;
+            while (std::getline(in, line)) {
+                lineNumber++;
+
+                size_t start = line.find_first_not_of(" \t");
+                if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+                    size_t open = line.find('"', start);
+                    size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+                    if (close == std::string::npos) {
+                        std::stringstream errMsg;
+                        errMsg << __func__ << ": " << fileName << ", line " << lineNumber
+                                << ": Expected '#include \"file\"'.";
+                        throw std::invalid_argument(errMsg.str());
+                    }
+
+                    // #line directives keep the compiler's error messages pointing at the original files:
+                    out << "#line 1 " << files.size() << "\n";
+                    appendShaderFile(out, directory + line.substr(open + 1, close - open - 1), files, includeStack, "");
+                    out << "#line " << lineNumber + 1 << " " << sourceNumber << "\n";
+                    continue;
+                }
+
+                out << line << "\n";
+
+                // The defines must follow the #version directive, which must come first:
+                if (!defines.empty() && start != std::string::npos && line.compare(start, 8, "#version") == 0) {
+                    out << defines;
+                    out << "#line " << lineNumber + 1 << " " << sourceNumber << "\n";
+                }
+            }
+
+            includeStack.pop_back();
+        }
+    }
+
+    /**
+     * Reads a GLSL source file, expanding its #include "file" directives (relative to the including file), and
+     * defining the macros for the given features after its #version directive.
+     *
+     * In compiler messages, source string 0 is the file itself, and included files are numbered in the order
+     * they are first included.
+     */
+    inline std::string preprocessShaderFile(const std::string& fileName, uint32_t features = 0) {
+        std::string defines;
+        for (int bit = 0; bit < ShaderFeatures::count; bit++) {
+            if (features & (uint32_t(1) << bit))
+                defines += std::string("#define ") + ShaderFeatures::macroName(bit) + "\n";
+        }
+
+        std::stringstream out;
+        std::vector<std::string> files;
+        std::vector<std::string> includeStack;
+        detail::appendShaderFile(out, fileName, files, includeStack, defines);
+        return out.str();
+    }
+}
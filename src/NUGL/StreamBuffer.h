@@ -0,0 +1,307 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "utility/debug.h"
+#include "utility/make_unique.h"
+#include "utility/AllocationCounter.h"
+#include "NUGL/Buffer.h"
+
+namespace NUGL {
+    /**
+     * A ring allocator for data that is rewritten every frame (e.g. per-draw uniform blocks).
+     *
+     * The buffer is split into one region per frame in flight. Writes are appended to the current region
+     * with a plain memcpy into a persistently mapped, coherent buffer, and are addressed by their offset.
+     * A fence is inserted at the end of each frame, and a region is only reused once its fence has signalled,
+     * so the CPU never waits on the GPU unless it is more than numRegions frames behind.
+     *
+     * Without ARB_buffer_storage, each write is mapped unsynchronized and the buffer is orphaned when it wraps.
+     */
+    class StreamBuffer {
+    public:
+        inline StreamBuffer(GLenum target, GLsizeiptr regionSize = 4 * 1024 * 1024, int numRegions = 3)
+                : target(target), numRegions(numRegions), fences(numRegions, nullptr) {
+            if (numRegions < 1) {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": numRegions must be at least 1 (numRegions == " << numRegions << ").";
+                throw std::invalid_argument(errMsg.str());
+            }
+
+            if (target == GL_UNIFORM_BUFFER) {
+                GLint offsetAlignment;
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+                alignment = std::max(alignment, GLsizeiptr(offsetAlignment));
+            }
+
+            persistent = GLEW_ARB_buffer_storage;
+            allocate(regionSize);
+        }
+
+        inline ~StreamBuffer() {
+            release();
+        }
+
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+        //! Starts writing to the next region, waiting until the GPU has finished reading from it.
+        inline void beginFrame() {
+            if (!persistent)
+                return;
+
+            GLsync& fence = fences[currentRegion];
+            if (fence != nullptr) {
+                GLenum result;
+                do {
+                    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                } while (result == GL_TIMEOUT_EXPIRED);
+
+                if (result == GL_WAIT_FAILED) {
+                    checkForAndPrintGLError(__FILE__, __LINE__);
+                }
+
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+
+            head = currentRegion * regionSize;
+        }
+
+        //! Fences the commands that read from the current region, and advances the ring.
+        inline void endFrame() {
+            if (!persistent)
+                return;
+
+            fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+
+            currentRegion = (currentRegion + 1) % numRegions;
+        }
+
+        /**
+         * Reserves size bytes in the current region for the caller to fill in place, and returns a pointer to them.
+         *
+         * The reserved range's offset in the buffer is stored in offset. Every call must be paired with a call to
+         * unmap() before the range is used by the GL.
+         */
+        inline GLvoid* map(GLsizeiptr size, GLintptr& offset) {
+            offset = alignUp(head);
+
+            if (persistent) {
+                GLintptr regionEnd = (currentRegion + 1) * regionSize;
+                if (offset + size > regionEnd) {
+                    grow(size);
+                    offset = alignUp(head);
+                }
+
+                head = offset + size;
+                return mappedData + offset;
+            }
+
+            if (offset + size > regionSize * numRegions) {
+                if (size > regionSize * numRegions) {
+                    grow(size);
+                    offset = alignUp(head);
+                } else {
+                    // Orphan the buffer, so that the driver allocates new storage instead of waiting:
+                    buffer->bind(target);
+                    glBufferData(target, regionSize * numRegions, nullptr, GL_STREAM_DRAW);
+                    offset = 0;
+                }
+            }
+
+            buffer->bind(target);
+            void* dst = glMapBufferRange(target, offset, size,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (dst == nullptr) {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": Could not map stream buffer range of size " << size << ".";
+                throw std::runtime_error(errMsg.str());
+            }
+
+            head = offset + size;
+            return dst;
+        }
+
+        inline void unmap() {
+            if (persistent)
+                return;
+
+            buffer->bind(target);
+            glUnmapBuffer(target);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+        }
+
+        //! Copies size bytes into the current region, and returns their offset in the buffer.
+        inline GLintptr write(const GLvoid* data, GLsizeiptr size) {
+            GLintptr offset;
+            std::memcpy(map(size, offset), data, size);
+            unmap();
+            return offset;
+        }
+
+        template<typename T>
+        inline GLintptr write(const T& value) {
+            return write(&value, sizeof(T));
+        }
+
+        /**
+         * Binds a range of the buffer to an indexed binding point of the buffer's target.
+         *
+         * The range stays bound if the buffer grows later in the frame (see grow).
+         */
+        inline void bindRange(GLuint index, GLintptr offset, GLsizeiptr size) {
+            glBindBufferRange(target, index, buffer->id(), offset, size);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+
+            if (index >= boundRanges.size()) {
+                utility::ScopedAllowAllocations allow;
+                boundRanges.resize(index + 1, {0, 0});
+            }
+            boundRanges[index] = {offset, size};
+        }
+
+        //! Writes the value and binds it to an indexed binding point (e.g. a uniform block binding).
+        template<typename T>
+        inline void writeAndBind(GLuint index, const T& value) {
+            GLintptr offset = write(value);
+            bindRange(index, offset, sizeof(T));
+        }
+
+        inline bool isPersistent() {
+            return persistent;
+        }
+
+        //! Rounds size up to the alignment required between consecutive bound ranges.
+        inline GLsizeiptr alignedSize(GLsizeiptr size) {
+            return alignUp(size);
+        }
+
+    private:
+        inline GLintptr alignUp(GLintptr offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        inline void allocate(GLsizeiptr newRegionSize) {
+            regionSize = alignUp(newRegionSize);
+            GLsizeiptr size = regionSize * numRegions;
+
+            buffer = std::make_unique<Buffer>();
+            buffer->bind(target);
+
+            if (persistent) {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(target, size, nullptr, flags);
+                mappedData = static_cast<GLubyte*>(glMapBufferRange(target, 0, size, flags));
+
+                if (mappedData == nullptr) {
+                    std::stringstream errMsg;
+                    errMsg << __func__ << ": Could not persistently map stream buffer of size " << size << ".";
+                    throw std::runtime_error(errMsg.str());
+                }
+            } else {
+                glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+            }
+
+            checkForAndPrintGLError(__FILE__, __LINE__);
+        }
+
+        inline void release() {
+            for (auto& fence : fences) {
+                if (fence != nullptr)
+                    glDeleteSync(fence);
+                fence = nullptr;
+            }
+
+            if (buffer != nullptr && mappedData != nullptr) {
+                buffer->bind(target);
+                glUnmapBuffer(target);
+            }
+
+            mappedData = nullptr;
+            buffer = nullptr;
+        }
+
+        /**
+         * Replaces the buffer with one that can hold another minSize bytes in the current frame.
+         *
+         * The data written so far this frame is copied to the same offsets in the new buffer (whose first region
+         * is made large enough to hold it), so the offsets already returned stay valid, and the ranges bound from it
+         * are rebound to the new buffer (deleting a buffer unbinds it from every binding point). Deleting the old
+         * buffer is otherwise safe: the GL keeps its storage alive until pending commands complete.
+         */
+        inline void grow(GLsizeiptr minSize) {
+            utility::ScopedAllowAllocations allow;
+
+            // Without persistent mapping, the whole buffer is written until it is orphaned:
+            GLintptr frameStart = persistent ? currentRegion * regionSize : 0;
+            GLintptr frameEnd = head;
+
+            for (auto& fence : fences) {
+                if (fence != nullptr)
+                    glDeleteSync(fence);
+                fence = nullptr;
+            }
+
+            std::unique_ptr<Buffer> oldBuffer = std::move(buffer);
+            GLubyte* oldData = mappedData;
+            allocate(std::max(regionSize * 2, alignUp(alignUp(frameEnd) + minSize)));
+
+            if (frameEnd > frameStart) {
+                if (persistent) {
+                    std::memcpy(mappedData + frameStart, oldData + frameStart, frameEnd - frameStart);
+                } else {
+                    oldBuffer->bind(GL_COPY_READ_BUFFER);
+                    buffer->bind(GL_COPY_WRITE_BUFFER);
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, frameStart, frameStart,
+                            frameEnd - frameStart);
+                }
+            }
+
+            if (oldData != nullptr) {
+                oldBuffer->bind(target);
+                glUnmapBuffer(target);
+            }
+            oldBuffer = nullptr;
+
+            // The rest of the frame is written to the new first region:
+            currentRegion = 0;
+            head = frameEnd;
+
+            for (GLuint index = 0; index < boundRanges.size(); index++) {
+                const BoundRange& range = boundRanges[index];
+                if (range.size != 0 && range.offset >= frameStart && range.offset + range.size <= frameEnd)
+                    glBindBufferRange(target, index, buffer->id(), range.offset, range.size);
+            }
+            checkForAndPrintGLError(__FILE__, __LINE__);
+        }
+
+        struct BoundRange {
+            GLintptr offset;
+            GLsizeiptr size;
+        };
+
+        GLenum target;
+        int numRegions;
+        std::vector<GLsync> fences;
+
+        std::unique_ptr<Buffer> buffer;
+        GLubyte* mappedData = nullptr;
+        bool persistent = false;
+
+        GLsizeiptr alignment = 16;
+        GLsizeiptr regionSize = 0;
+        int currentRegion = 0;
+        GLintptr head = 0;
+
+        std::vector<BoundRange> boundRanges; // The range last bound to each binding point, by index.
+    };
+}
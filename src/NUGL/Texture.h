@@ -18,8 +18,30 @@
 #include "utility/debug.h"
 #include "utility/strutil.h"
 #include "utility/make_unique.h"
+#include "NUGL/PixelBufferRing.h"
 
 namespace NUGL {
+    inline int getBytesPerPixel(GLenum format) {
+        switch (format) {
+            case GL_RED: return 1;
+            case GL_RG: return 2;
+            case GL_RGB: return 3;
+            case GL_RGBA: return 4;
+            default: {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": Unsupported pixel format enum value " << format << ".";
+                throw std::invalid_argument(errMsg.str());
+            }
+        }
+    }
+
+    //! RGB pixel data decoded from an image file (see Texture::decodeImage).
+    struct Image {
+        GLsizei width = 0;
+        GLsizei height = 0;
+        std::vector<unsigned char> pixels;
+    };
+
     class Texture {
     public:
         Texture() = delete;
@@ -71,6 +93,16 @@ namespace NUGL {
         }
 
         inline void loadFromImage(const std::string& fileName, GLenum target) {
+            loadFromImage(decodeImage(fileName), target);
+//            checkForAndPrintGLError(__FILE__, __LINE__);
+        }
+
+        inline void loadFromImage(const Image& image, GLenum target) {
+            setTextureData(target, image.width, image.height, image.pixels.data());
+        }
+
+        //! Decodes a JPEG or PNG file. Makes no GL calls, so images can be decoded on worker threads.
+        static inline Image decodeImage(const std::string& fileName) {
             if (!boost::filesystem::exists(fileName)) {
                 std::stringstream errMsg;
                 errMsg << __func__ << ": The file '" << fileName << "' does not exist.";
@@ -78,17 +110,15 @@ namespace NUGL {
             }
 
             if (utility::strutil::checkFirstBytes(fileName, "\xFF\xD8\xFF")) {
-                loadFromJPEG(fileName, target);
+                return decodeJPEG(fileName);
             } else if (utility::strutil::checkFirstBytes(fileName, "\x89\x50\x4E\x47\x0D\x0A\x1A\x0A")) {
-                loadFromPNG(fileName, target);
+                return decodePNG(fileName);
             } else {
                 std::stringstream errMsg;
                 errMsg << __func__
                     << ": The file '" << fileName << "' has unrecognised image file type.";
                 throw std::invalid_argument(errMsg.str());
             }
-
-//            checkForAndPrintGLError(__FILE__, __LINE__);
         }
 
         inline void setTextureData(GLenum target, GLsizei width, GLsizei height, const GLvoid *pixels,
@@ -101,12 +131,31 @@ namespace NUGL {
                 glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 //                checkForAndPrintGLError(__FILE__, __LINE__);
             }
+
+            // Stream image data through a pixel buffer object so that the upload doesn't stall the frame:
+            auto ring = pixelBufferRing();
+            if (ring != nullptr && pixels != nullptr) {
+                GLsizeiptr size = GLsizeiptr(width) * height * getBytesPerPixel(format);
+                const GLvoid *offset = ring->stage(pixels, size);
+                glTexImage2D(target, 0, internalFormat,
+                        width, height,
+                        0, format, GL_UNSIGNED_BYTE, offset);
+                ring->release();
+                return;
+            }
+
             glTexImage2D(target, 0, internalFormat,
                     width, height,
                     0, format, GL_UNSIGNED_BYTE, pixels); // TODO: Check byte formats
 ////            checkForAndPrintGLError(__FILE__, __LINE__);
         }
 
+        //! When set, pixel data passed to setTextureData is uploaded through this ring of pixel buffer objects.
+        static inline std::shared_ptr<PixelBufferRing>& pixelBufferRing() {
+            static std::shared_ptr<PixelBufferRing> ring;
+            return ring;
+        }
+
         static inline std::unique_ptr<Texture> createTexture(GLenum unit, GLenum target, GLsizei width, GLsizei height,
                 GLenum internalFormat, GLenum format = GL_RGBA) {
             auto newTex = std::make_unique<NUGL::Texture>(unit, target);
@@ -117,25 +166,35 @@ namespace NUGL {
         }
 
         inline void loadFromPNG(const std::string& fileName, GLenum target) {
+            loadFromImage(decodePNG(fileName), target);
+        }
+
+        inline void loadFromJPEG(const std::string& fileName, GLenum target) {
+            loadFromImage(decodeJPEG(fileName), target);
+        }
+
+        static inline Image decodePNG(const std::string& fileName) {
             // Open image
             png::image<png::rgb_pixel> image(fileName.c_str());
 
             // Copy image data to buffer
-            std::vector<unsigned char> imgData;
-            imgData.reserve(image.get_width() * image.get_height() * 3);
+            Image decoded;
+            decoded.width = GLsizei(image.get_width());
+            decoded.height = GLsizei(image.get_height());
+            decoded.pixels.reserve(image.get_width() * image.get_height() * 3);
             for (size_t y = 0; y < image.get_height(); y++) {
                 for (size_t x = 0; x < image.get_width(); x++) {
                     auto& pixel = image[y][x];
-                    imgData.push_back(pixel.red);
-                    imgData.push_back(pixel.green);
-                    imgData.push_back(pixel.blue);
+                    decoded.pixels.push_back(pixel.red);
+                    decoded.pixels.push_back(pixel.green);
+                    decoded.pixels.push_back(pixel.blue);
                 }
             }
 
-            setTextureData(target, image.get_width(), image.get_height(), imgData.data());
+            return decoded;
         }
 
-        inline void loadFromJPEG(const std::string& fileName, GLenum target) {
+        static inline Image decodeJPEG(const std::string& fileName) {
             struct jpeg_error_mgr err;
             struct jpeg_decompress_struct cinfo;
             std::memset(&cinfo, 0, sizeof(jpeg_decompress_struct));
@@ -163,8 +222,11 @@ namespace NUGL {
             jpeg_start_decompress(&cinfo);
 
             // Read scanlines
-            std::vector<char> data(cinfo.image_width * cinfo.image_height * cinfo.num_components);
-            char* samples = data.data();
+            Image decoded;
+            decoded.width = GLsizei(cinfo.output_width);
+            decoded.height = GLsizei(cinfo.output_height);
+            decoded.pixels.resize(cinfo.output_width * cinfo.output_height * cinfo.output_components);
+            unsigned char* samples = decoded.pixels.data();
             while (cinfo.output_scanline < cinfo.output_height) {
                 int numSamples = jpeg_read_scanlines(&cinfo, (JSAMPARRAY)&samples, 1);
                 samples += numSamples * cinfo.output_width * cinfo.output_components;
@@ -174,8 +236,9 @@ namespace NUGL {
             jpeg_finish_decompress(&cinfo);
 
             jpeg_destroy_decompress(&cinfo);
+            fclose(pFile);
 
-            setTextureData(target, cinfo.image_width, cinfo.image_height, data.data());
+            return decoded;
         }
 
         inline void setParam(GLenum param, GLint value) {
@@ -8,6 +8,7 @@
 
 #include "NUGL/Buffer.h"
 #include "NUGL/ShaderProgram.h"
+#include "NUGL/VertexLayout.h"
 #include "utility/debug.h"
 
 namespace NUGL {
@@ -19,6 +20,7 @@ namespace NUGL {
             case GL_UNSIGNED_SHORT: return sizeof(GLushort);
             case GL_INT: return sizeof(GLint);
             case GL_UNSIGNED_INT: return sizeof(GLuint);
+            case GL_HALF_FLOAT: return sizeof(GLhalf);
             case GL_FLOAT: return sizeof(GLfloat);
             case GL_DOUBLE: return sizeof(GLdouble);
             default: {
@@ -29,16 +31,6 @@ namespace NUGL {
         }
     }
 
-    struct VertexAttribute {
-        std::string name;
-        GLint size;
-        GLenum type;
-        GLboolean normalized;
-//        GLsizei stride;
-//        const GLvoid* offset;
-        bool isPadding;
-    };
-
     class VertexArray {
     public:
         VertexArray() {
@@ -53,40 +45,17 @@ namespace NUGL {
             glBindVertexArray(arrayId);
         }
 
-        // Assumes sequential, packed vertices.
-        inline void setAttributePointers(ShaderProgram& program, Buffer& buffer, GLenum target, std::vector<VertexAttribute> attribs) {
-            int stride = 0;
-            for (auto& attrib : attribs) {
-                stride += attrib.size * getSizeOfOpenGlType(attrib.type);
-            }
-
+        /**
+         * Describes the buffer's vertices, which are NUGL::Vertex structs of type V, to the vertex array (see
+         * VertexLayout.h). The attributes are at their fixed AttribLocations, so the array can be used with any
+         * program.
+         */
+        template <typename V>
+        inline void setAttributePointers(Buffer& buffer, GLenum target) {
             bind();
-            checkForAndPrintGLError(__func__, __LINE__);
-
             buffer.bind(target);
+            V::setAttributePointers();
             checkForAndPrintGLError(__func__, __LINE__);
-
-            size_t offset = 0;
-            for (auto& attrib : attribs) {
-                if (!attrib.isPadding) {
-                    GLint location = program.getAttribLocation(attrib.name);
-                    checkForAndPrintGLError(__func__, __LINE__);
-
-                    glEnableVertexAttribArray(location);
-                    checkForAndPrintGLError(__func__, __LINE__, attrib.name);
-
-                    glVertexAttribPointer(
-                            location,
-                            attrib.size,
-                            attrib.type,
-                            attrib.normalized,
-                            stride,
-                            (void *) offset);
-                    checkForAndPrintGLError(__func__, __LINE__);
-                }
-
-                offset += attrib.size * getSizeOfOpenGlType(attrib.type);
-            }
         }
 
         inline GLuint id() {
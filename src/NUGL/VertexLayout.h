@@ -0,0 +1,179 @@
+#pragma once
+#include <cstddef>
+
+#include <GL/glew.h>
+
+namespace NUGL {
+    /**
+     * The attribute locations that all vertex shaders declare with layout(location = ...), so that vertex arrays
+     * can be set up without looking up attribute names, and shared between programs.
+     */
+    struct AttribLocation {
+        enum : GLuint {
+            position = 0,
+            normal   = 1,
+            texcoord = 2,
+        };
+    };
+
+    //! Returns the number of bytes occupied by one component of the given type (0 for packed types).
+    constexpr GLsizei sizeOfComponentType(GLenum type) {
+        return (type == GL_BYTE || type == GL_UNSIGNED_BYTE) ? 1
+                : (type == GL_SHORT || type == GL_UNSIGNED_SHORT || type == GL_HALF_FLOAT) ? 2
+                : (type == GL_INT || type == GL_UNSIGNED_INT || type == GL_FLOAT) ? 4
+                : (type == GL_DOUBLE) ? 8
+                : 0;
+    }
+
+    //! Returns the number of bytes the GL reads for a vertex attribute with the given size and type.
+    constexpr GLsizei sizeOfAttribute(GLint size, GLenum type) {
+        // Packed formats store all four components in a single 32-bit word:
+        return (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV) ? 4
+                : size * sizeOfComponentType(type);
+    }
+
+    /*
+     * Attribute encodings.
+     *
+     * Each describes the GL's view of the attribute (size, type, and normalized, as passed to
+     * glVertexAttribPointer). Trailing padding keeps every attribute 4-byte aligned.
+     */
+
+    //! Marks an attribute that a vertex type does not have.
+    struct NoAttribute {};
+
+    struct Float3 {
+        GLfloat x, y, z;
+
+        static const GLint size = 3;
+        static const GLenum type = GL_FLOAT;
+        static const GLboolean normalized = GL_FALSE;
+    };
+
+    struct Float2 {
+        GLfloat x, y;
+
+        static const GLint size = 2;
+        static const GLenum type = GL_FLOAT;
+        static const GLboolean normalized = GL_FALSE;
+    };
+
+    //! A vec3 quantized to [-1, 1] (see Mesh::positionDecodeTransform).
+    struct Snorm16x3 {
+        GLshort x, y, z;
+        GLshort padding;
+
+        static const GLint size = 3;
+        static const GLenum type = GL_SHORT;
+        static const GLboolean normalized = GL_TRUE;
+    };
+
+    struct Half3 {
+        GLhalf x, y, z;
+        GLhalf padding;
+
+        static const GLint size = 3;
+        static const GLenum type = GL_HALF_FLOAT;
+        static const GLboolean normalized = GL_FALSE;
+    };
+
+    struct Half2 {
+        GLhalf x, y;
+
+        static const GLint size = 2;
+        static const GLenum type = GL_HALF_FLOAT;
+        static const GLboolean normalized = GL_FALSE;
+    };
+
+    //! A unit vector packed as 10-bit signed normalized x, y, and z.
+    struct Int2101010 {
+        GLuint bits;
+
+        static const GLint size = 4;
+        static const GLenum type = GL_INT_2_10_10_10_REV;
+        static const GLboolean normalized = GL_TRUE;
+    };
+
+    //! Checks that the GL reads an attribute's values, and only its values and padding, from the struct.
+    template <typename Attribute>
+    struct CheckAttribute {
+        static_assert(sizeOfAttribute(Attribute::size, Attribute::type) > 0, "Unknown attribute type.");
+        static_assert(sizeof(Attribute) >= size_t(sizeOfAttribute(Attribute::size, Attribute::type)),
+                "Attribute struct is smaller than the attribute.");
+        static_assert(sizeof(Attribute) - size_t(sizeOfAttribute(Attribute::size, Attribute::type)) < 4,
+                "Attribute struct holds more than padding beyond the attribute.");
+        static_assert(sizeof(Attribute) % 4 == 0, "Attributes must be 4-byte aligned.");
+        static_assert(Attribute::type != GL_INT_2_10_10_10_REV || Attribute::size == 4,
+                "Packed attributes must have 4 components.");
+        static_assert(Attribute::normalized == GL_FALSE || (Attribute::type != GL_FLOAT && Attribute::type != GL_HALF_FLOAT),
+                "Only integer attributes can be normalized.");
+
+        static const bool value = true;
+    };
+
+    template <typename Attribute>
+    inline void setAttributePointer(GLuint location, GLsizei stride, size_t offset) {
+        static_assert(CheckAttribute<Attribute>::value, "");
+
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, Attribute::size, Attribute::type, Attribute::normalized, stride,
+                reinterpret_cast<const GLvoid *>(offset));
+    }
+
+    /**
+     * An interleaved vertex, with the given position, normal, and texture coordinate encodings (NoAttribute for
+     * those it does not have).
+     *
+     * setAttributePointers() describes the vertex to the bound vertex array, with the attributes at their
+     * AttribLocation.
+     */
+    template <typename Position, typename Normal = NoAttribute, typename TexCoord = NoAttribute>
+    struct Vertex {
+        Position position;
+        Normal normal;
+        TexCoord texcoord;
+
+        static inline void setAttributePointers() {
+            setAttributePointer<Position>(AttribLocation::position, sizeof(Vertex), offsetof(Vertex, position));
+            setAttributePointer<Normal>(AttribLocation::normal, sizeof(Vertex), offsetof(Vertex, normal));
+            setAttributePointer<TexCoord>(AttribLocation::texcoord, sizeof(Vertex), offsetof(Vertex, texcoord));
+        }
+    };
+
+    template <typename Position, typename TexCoord>
+    struct Vertex<Position, NoAttribute, TexCoord> {
+        Position position;
+        TexCoord texcoord;
+
+        static inline void setAttributePointers() {
+            setAttributePointer<Position>(AttribLocation::position, sizeof(Vertex), offsetof(Vertex, position));
+            setAttributePointer<TexCoord>(AttribLocation::texcoord, sizeof(Vertex), offsetof(Vertex, texcoord));
+        }
+    };
+
+    template <typename Position, typename Normal>
+    struct Vertex<Position, Normal, NoAttribute> {
+        Position position;
+        Normal normal;
+
+        static inline void setAttributePointers() {
+            setAttributePointer<Position>(AttribLocation::position, sizeof(Vertex), offsetof(Vertex, position));
+            setAttributePointer<Normal>(AttribLocation::normal, sizeof(Vertex), offsetof(Vertex, normal));
+        }
+    };
+
+    template <typename Position>
+    struct Vertex<Position, NoAttribute, NoAttribute> {
+        Position position;
+
+        static inline void setAttributePointers() {
+            setAttributePointer<Position>(AttribLocation::position, sizeof(Vertex), offsetof(Vertex, position));
+        }
+    };
+
+    // Vertices are tightly packed (every attribute is 4-byte aligned, so there is no padding between them):
+    static_assert(sizeof(Vertex<Float3, Float3, Float2>) == 32, "Unexpected vertex size.");
+    static_assert(sizeof(Vertex<Snorm16x3, Int2101010, Half2>) == 16, "Unexpected vertex size.");
+    static_assert(sizeof(Vertex<Half3, Int2101010>) == 12, "Unexpected vertex size.");
+    static_assert(sizeof(Vertex<Float3, NoAttribute, Float2>) == 20, "Unexpected vertex size.");
+}
@@ -5,11 +5,9 @@ in vec2 Texcoord;
 
 out vec4 outColor;
 
-// Transform uniforms:
-//uniform mat4 modelViewInverse;
-uniform mat4 view;
-uniform mat4 viewInverse;
-uniform mat4 projInverse;
+#define SHADOW_SAMPLES 16
+#define UNBOUNDED_DIRECTIONAL_SHADOWS
+#include "include/light.glsl"
 
 // G-Buffer uniforms:
 uniform sampler2D texDepthStencil;
@@ -17,99 +15,6 @@ uniform sampler2D texNormal;
 uniform sampler2D texAlbedoRoughness;
 uniform sampler2D texEnvMapColSpecIntensity;
 
-// Light uniforms:
-struct Light {
-    vec3 pos;
-    vec3 dir;
-    float attenuationConstant;
-    float attenuationLinear;
-    float attenuationQuadratic;
-    vec3 colDiffuse;
-    vec3 colSpecular;
-    vec3 colAmbient;
-    float angleConeInner;
-    float angleConeOuter;
-
-    bool isSpotlight;
-    bool isDirectional;
-    bool hasShadowMap;
-    sampler2D texShadowMap;
-    mat4 view;
-    mat4 proj;
-};
-
-uniform Light light;
-
-
-float phong(in vec3 incident, in vec3 reflection, in float shininess) {
-    return pow(clamp(dot(-incident, reflection), 0, 1), shininess);
-}
-
-float calculateIntensity(in float lightDist) {
-    float denom = light.attenuationConstant;
-    denom += light.attenuationLinear * lightDist;
-    denom += light.attenuationQuadratic * lightDist * lightDist;
-    return 1.0 / denom;
-}
-
-
-float rand(in vec4 seed) {
-    float dot_product = dot(seed, vec4(12.9898, 78.233, 45.164, 94.673));
-    return fract(sin(dot_product) * 43758.5453);
-}
-
-vec2 randVec2(in vec3 seed1, in float seed2, in float seed3) {
-    return vec2(rand(vec4(seed1, seed2)), rand(vec4(seed1, seed3)));
-}
-
-float doShadowMapping(in vec4 eyeSpacePosition) {
-    float lightVisibility = 1.0;
-    if (light.hasShadowMap) {
-        vec4 lightClipPos = light.proj * light.view * viewInverse * eyeSpacePosition;
-
-        vec3 lightClipPosDivided = lightClipPos.xyz / lightClipPos.w;
-        vec3 shadowLookup = (lightClipPosDivided * 0.5) + 0.5;
-
-        float bias = 0.0;
-        float samples = 16;
-        float radius = (1.0 / 300.0);
-        if (light.isDirectional) {
-            radius = (1.0 / 600.0);
-        }
-
-        for (int i = 0; i < samples; i++) {
-//            int index = int(4.0 * rand(vec4(eyeSpacePosition.xyz, i))) % 4;
-//            vec2 stratifiedCoord = vec2(shadowLookup.xy + poissonDisk[index] / 700.0); //,  (shadowLookup.z - bias ) / shadowLookup.w);
-            vec2 offset = randVec2(eyeSpacePosition.xyz, i, i + samples);
-
-            vec2 stratifiedCoord = vec2(shadowLookup.xy + offset * radius);
-
-            float occluderDepth = texture(light.texShadowMap, stratifiedCoord.xy).x;
-
-            if (occluderDepth < ((lightClipPos.z - bias) / lightClipPos.w) * 0.5 + 0.5)
-                lightVisibility -= 1.0 / samples;
-        }
-
-        lightVisibility = clamp(lightVisibility, 0.0, 1.0);
-
-        // Apply the view frustum:
-        if (!light.isDirectional) {
-            float upper = 1;
-            float lower = 0;
-            if (shadowLookup.x < lower || shadowLookup.x > upper ||
-                    shadowLookup.y < lower || shadowLookup.y > upper
-                    || shadowLookup.z > upper // || shadowLookup.z < lower
-                    ) {
-                lightVisibility = 0;
-            } else if (shadowLookup.z < lower) {
-                lightVisibility = 1;
-            }
-        }
-    }
-
-    return lightVisibility;
-}
-
 // Based on code from: http://mynameismjp.wordpress.com/2009/03/10/reconstructing-position-from-depth/
 vec3 eyeSpacePosFromDepth(in float depth, in vec2 texcoord) {
 
@@ -128,24 +33,6 @@ vec3 eyeSpacePosFromDepth(in float depth, in vec2 texcoord) {
     return viewPos.xyz / viewPos.w;
 }
 
-float calcSpotlightFactor(in vec3 lightVec) {
-    if (!light.isSpotlight)
-        return 1.0;
-
-    float minDot = cos(light.angleConeOuter / 2.0); // TODO: precalc.
-    float lightDirDot = dot((viewInverse * vec4(lightVec, 0)).xyz, light.dir);
-
-    if (lightDirDot < minDot)
-        return 0.0;
-
-    float innerDot = cos(light.angleConeInner / 2.0); // TODO: precalc.
-
-    if (lightDirDot > innerDot)
-        return 1.0;
-
-    return (lightDirDot - minDot) / (innerDot - minDot);
-}
-
 void main() {
     vec3 colSpecular = vec3(1.0, 1.0, 1.0);
 
@@ -173,13 +60,13 @@ void main() {
     vec3 normal = normalize(eyeSpaceNormal.xyz);
     vec3 lightVecRaw;
     vec3 lightVec;
-    if (!light.isDirectional) {
-        lightVecRaw = eyeSpacePosition.xyz - (view * vec4(light.pos, 1)).xyz;
-        lightVec = normalize(lightVecRaw);
-    } else {
-        lightVecRaw = (view * vec4(light.dir, 0)).xyz;
-        lightVec = normalize(lightVecRaw);
-    }
+#ifndef LIGHT_DIRECTIONAL
+    lightVecRaw = eyeSpacePosition.xyz - (view * vec4(light.pos, 1)).xyz;
+    lightVec = normalize(lightVecRaw);
+#else
+    lightVecRaw = (view * vec4(light.dir, 0)).xyz;
+    lightVec = normalize(lightVecRaw);
+#endif
 
     // Don't show lighting on surfaces that are facing the wrong way:
     float lightDot = -dot(lightVec, normal);
@@ -207,7 +94,11 @@ void main() {
     float lightVisibility = doShadowMapping(vec4(eyeSpacePosition, 1));
 
     // Spotlight cone:
+#ifdef LIGHT_SPOT
     float spotFactor = calcSpotlightFactor(lightVec);
+#else
+    float spotFactor = 1.0;
+#endif
 
     // Diffuse component:
     vec3 outDiffuse = albedo * light.colDiffuse * max(lightDot, 0);
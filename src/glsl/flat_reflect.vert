@@ -1,7 +1,7 @@
 #version 330 core
 
-in vec3 position;
-in vec3 normal;
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
 
 out vec3 eyeSpacePosition;
 out vec3 Normal;
@@ -26,8 +26,7 @@ out vec4 outNormal;
 out vec4 outAlbedoRoughness;
 out vec4 outEnvMapColSpecIntensity;
 
-uniform mat4 modelViewInverse;
-uniform mat4 viewInverse;
+#include "include/camera.glsl"
 
 // Material uniforms
 uniform vec3 colDiffuse;
@@ -39,9 +38,6 @@ uniform float emissive;
 uniform samplerCube texEnvironmentMap;
 uniform sampler2D texDiffuse;
 uniform sampler2D texHeight;
-uniform bool hasTexHeight;
-uniform bool hasTexDiffuse;
-uniform bool hasTexEnvironmentMap;
 
 float phong(in vec3 incident, in vec3 reflection, in float shininess) {
     return pow(clamp(dot(-incident, reflection), 0, 1), shininess);
@@ -92,7 +88,8 @@ void main() {
     vec3 incident = normalize(eyeSpacePosition.xyz);
 
     // Apply heightmap:
-    if (hasTexHeight) {
+#ifdef HAS_TEX_HEIGHT
+    {
 //        float s_d = 1.0 / 640;
 //        float t_d = 1.0 / 640;
 //        float top = texture(texHeight, Texcoord + vec2(0.0, t_d)).r;
@@ -119,6 +116,7 @@ void main() {
 
         normal = perturb_normal(normal, incident, Texcoord);
     }
+#endif
 
     // Normal:
     outNormal.xy = normal.xy;
@@ -126,7 +124,8 @@ void main() {
     // Environment map reflection:
     outEnvMapColSpecIntensity.rgba = vec4(0, 0, 0, 0);
 
-    if (hasTexEnvironmentMap && shininess > 0) {
+#ifdef HAS_TEX_ENVIRONMENT_MAP
+    if (shininess > 0) {
         vec3 viewReflect = reflect(incident, normal);
         vec4 sampleCoord = viewInverse * vec4(viewReflect, 0);
         sampleCoord = vec4(sampleCoord.x, sampleCoord.z, -sampleCoord.y, 1);
@@ -140,20 +139,19 @@ void main() {
             vec3 fresnelCol = mix(vec3(0.1), vec3(1), fresnelFactor);
             outEnvMapColSpecIntensity.rgb = fresnelCol * reflectCol.rgb * colSpecular;
         }
-    } else {
-        outEnvMapColSpecIntensity.rgb = vec3(0, 0, 0);
     }
+#endif
 
     outEnvMapColSpecIntensity.a = emissive;
 
 
     // Diffuse albedo:
-    if (hasTexDiffuse) {
-        vec4 texCol = texture(texDiffuse, Texcoord);
-        outAlbedoRoughness.rgb = texCol.rgb * colDiffuse;
-    } else {
-        outAlbedoRoughness.rgb = colDiffuse;
-    }
+#ifdef HAS_TEX_DIFFUSE
+    vec4 texCol = texture(texDiffuse, Texcoord);
+    outAlbedoRoughness.rgb = texCol.rgb * colDiffuse;
+#else
+    outAlbedoRoughness.rgb = colDiffuse;
+#endif
 
     // Roughness:
     outAlbedoRoughness.a = shininess / 8; // Map to [0, 1].
@@ -1,24 +1,24 @@
 #version 330 core
 
-in vec3 position;
-in vec3 normal;
-in vec2 texcoord;
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
 
 out vec2 Texcoord;
 out vec4 eyeSpacePosition;
 out vec3 eyeSpaceNormal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 mvp;
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat4 modelView;
+    mat4 mvp;
+};
 
 
 void main() {
     Texcoord = texcoord;
     gl_Position = mvp * vec4(position, 1.0);
 
-    mat4 modelView = view * model;
-
     eyeSpacePosition = modelView * vec4(position, 1.0);
 
     vec4 eyeSpaceNormalTmp = modelView * vec4(normal, 0);
@@ -0,0 +1,7 @@
+// Transform uniforms (see scene::CameraBlock):
+layout(std140) uniform CameraBlock {
+    mat4 view;
+    mat4 proj;
+    mat4 viewInverse;
+    mat4 projInverse;
+};
@@ -0,0 +1,127 @@
+/*
+ * The light uniforms and shadow mapping functions shared by the lighting shaders.
+ *
+ * The light's type is selected at compile time by the variant's features (see NUGL::ShaderFeatures):
+ *  - LIGHT_SPOT, LIGHT_DIRECTIONAL: the light's type (otherwise, a point light).
+ *  - LIGHT_SHADOW_MAP: lightTexShadowMap holds the light's shadow map.
+ *
+ * Shaders may define these before including this file:
+ *  - SHADOW_SAMPLES: the number of jittered shadow map samples (default 1, unfiltered).
+ *  - UNBOUNDED_DIRECTIONAL_SHADOWS: directional lights light everything outside their shadow map.
+ */
+#include "camera.glsl"
+
+#ifndef SHADOW_SAMPLES
+#define SHADOW_SAMPLES 1
+#endif
+
+// Light uniforms (see scene::LightBlock; the flags are kept for its layout, but variants do not read them):
+layout(std140) uniform LightBlock {
+    vec3 pos;
+    float attenuationConstant;
+    vec3 dir;
+    float attenuationLinear;
+    vec3 colDiffuse;
+    float attenuationQuadratic;
+    vec3 colSpecular;
+    float angleConeInner;
+    vec3 colAmbient;
+    float angleConeOuter;
+    float fov;
+    bool isSpotlight;
+    bool isDirectional;
+    bool hasShadowMap;
+    mat4 view;
+    mat4 proj;
+} light;
+
+#ifdef LIGHT_SHADOW_MAP
+uniform sampler2D lightTexShadowMap;
+#endif
+
+float phong(in vec3 incident, in vec3 reflection, in float shininess) {
+    return pow(clamp(dot(-incident, reflection), 0, 1), shininess);
+}
+
+float calculateIntensity(in float lightDist) {
+    float denom = light.attenuationConstant;
+    denom += light.attenuationLinear * lightDist;
+    denom += light.attenuationQuadratic * lightDist * lightDist;
+    return 1.0 / denom;
+}
+
+float rand(in vec4 seed) {
+    float dot_product = dot(seed, vec4(12.9898, 78.233, 45.164, 94.673));
+    return fract(sin(dot_product) * 43758.5453);
+}
+
+vec2 randVec2(in vec3 seed1, in float seed2, in float seed3) {
+    return vec2(rand(vec4(seed1, seed2)), rand(vec4(seed1, seed3)));
+}
+
+float doShadowMapping(in vec4 eyeSpacePosition) {
+    float lightVisibility = 1.0;
+#ifdef LIGHT_SHADOW_MAP
+    vec4 lightClipPos = light.proj * light.view * viewInverse * eyeSpacePosition;
+
+    vec3 lightClipPosDivided = lightClipPos.xyz / lightClipPos.w;
+    vec3 shadowLookup = (lightClipPosDivided * 0.5) + 0.5;
+
+    float bias = 0.0;
+    float samples = SHADOW_SAMPLES;
+#if SHADOW_SAMPLES == 1
+    float radius = 0;
+#elif defined(LIGHT_DIRECTIONAL)
+    float radius = (1.0 / 600.0);
+#else
+    float radius = (1.0 / 300.0);
+#endif
+
+    for (int i = 0; i < samples; i++) {
+//        int index = int(4.0 * rand(vec4(eyeSpacePosition.xyz, i))) % 4;
+//        vec2 stratifiedCoord = vec2(shadowLookup.xy + poissonDisk[index] / 700.0); //,  (shadowLookup.z - bias ) / shadowLookup.w);
+        vec2 offset = randVec2(eyeSpacePosition.xyz, i, i + samples);
+
+        vec2 stratifiedCoord = vec2(shadowLookup.xy + offset * radius);
+
+        float occluderDepth = texture(lightTexShadowMap, stratifiedCoord.xy).x;
+
+        if (occluderDepth < ((lightClipPos.z - bias) / lightClipPos.w) * 0.5 + 0.5)
+            lightVisibility -= 1.0 / samples;
+    }
+
+    lightVisibility = clamp(lightVisibility, 0.0, 1.0);
+
+    // Apply the view frustum:
+#if !(defined(LIGHT_DIRECTIONAL) && defined(UNBOUNDED_DIRECTIONAL_SHADOWS))
+    float upper = 1;
+    float lower = 0;
+    if (shadowLookup.x < lower || shadowLookup.x > upper ||
+            shadowLookup.y < lower || shadowLookup.y > upper
+            || shadowLookup.z > upper // || shadowLookup.z < lower
+            ) {
+        lightVisibility = 0;
+    } else if (shadowLookup.z < lower) {
+        lightVisibility = 1;
+    }
+#endif
+#endif
+
+    return lightVisibility;
+}
+
+//! The attenuation of the light by its cone, for a surface in the given direction from it (in eye space).
+float calcSpotlightFactor(in vec3 lightVec) {
+    float minDot = cos(light.angleConeOuter / 2.0); // TODO: precalc.
+    float lightDirDot = dot((viewInverse * vec4(lightVec, 0)).xyz, light.dir);
+
+    if (lightDirDot < minDot)
+        return 0.0;
+
+    float innerDot = cos(light.angleConeInner / 2.0); // TODO: precalc.
+
+    if (lightDirDot > innerDot)
+        return 1.0;
+
+    return (lightDirDot - minDot) / (innerDot - minDot);
+}
@@ -1,15 +1,20 @@
-#version 150
+#version 330 core
 
-in vec3 position;
-in vec3 normal;
+// Depths must match the depth pre-pass exactly (see Scene::forwardRender):
+invariant gl_Position;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
 
 out vec4 Normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat4 modelView;
+    mat4 mvp;
+};
 
 void main() {
-    gl_Position = proj * view * model * vec4(position, 1.0);
+    gl_Position = mvp * vec4(position, 1.0);
     Normal = vec4(normal, 0);
 }
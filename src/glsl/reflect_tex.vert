@@ -1,8 +1,8 @@
 #version 330 core
 
-in vec3 position;
-in vec3 normal;
-in vec2 texcoord;
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
 
 out vec2 Texcoord;
 out vec3 eyeSpacePosition;
@@ -1,7 +1,7 @@
-#version 150
+#version 330 core
 
-in vec3 position;
-in vec2 texcoord;
+layout(location = 0) in vec3 position;
+layout(location = 2) in vec2 texcoord;
 
 out vec2 Texcoord;
 
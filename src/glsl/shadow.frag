@@ -7,10 +7,13 @@ in vec3 eyeSpaceNormal;
 
 out vec4 outColor;
 
-// Transform uniforms:
-uniform mat4 modelViewInverse;
-uniform mat4 view;
-uniform mat4 viewInverse;
+// The light-independent variant is drawn once, before the light passes (see Scene::forwardRender), and reads no
+// light uniforms:
+#ifdef LIGHT_INDEPENDENT
+#include "include/camera.glsl"
+#else
+#include "include/light.glsl"
+#endif
 
 // Material uniforms
 uniform float opacity;
@@ -21,125 +24,18 @@ uniform float shininess;
 //uniform float shininessStrength;
 uniform samplerCube texEnvironmentMap;
 uniform sampler2D texDiffuse;
-uniform bool hasTexDiffuse;
-uniform bool hasTexEnvironmentMap;
-
-// Light uniforms:
-struct Light {
-    vec3 pos;
-    vec3 dir;
-    float attenuationConstant;
-    float attenuationLinear;
-    float attenuationQuadratic;
-    vec3 colDiffuse;
-    vec3 colSpecular;
-    vec3 colAmbient;
-    float angleConeInner;
-    float angleConeOuter;
-    float fov;
-
-    bool hasShadowMap;
-    sampler2D texShadowMap;
-    mat4 view;
-    mat4 proj;
-};
-
-uniform Light light;
-
-
-float phong(in vec3 incident, in vec3 reflection, in float shininess) {
-    return pow(clamp(dot(-incident, reflection), 0, 1), shininess);
-}
-
-float calculateIntensity(in float lightDist) {
-    float denom = light.attenuationConstant;
-    denom += light.attenuationLinear * lightDist;
-    denom += light.attenuationQuadratic * lightDist * lightDist;
-    return 1.0 / denom;
-}
-
-float rand(in vec4 seed) {
-    float dot_product = dot(seed, vec4(12.9898, 78.233, 45.164, 94.673));
-    return fract(sin(dot_product) * 43758.5453);
-}
-
-float doShadowMapping(in vec4 eyeSpacePosition) {
-    float lightVisibility = 1.0;
-    if (light.hasShadowMap) {
-        vec4 lightClipPos = light.proj * light.view * viewInverse * eyeSpacePosition;
-
-        vec3 lightClipPosDivided = lightClipPos.xyz / lightClipPos.w;
-        vec3 shadowLookup = (lightClipPosDivided * 0.5) + 0.5;
-
-        float bias = 0.0;
-        float samples = 1; // 16;
-        float radius = 0; // 1.0 / 300.0;
-        for (int i = 0; i < samples; i++) {
-//            int index = int(4.0 * rand(vec4(eyeSpacePosition.xyz, i))) % 4;
-//            vec2 stratifiedCoord = vec2(shadowLookup.xy + poissonDisk[index] / 700.0); //,  (shadowLookup.z - bias ) / shadowLookup.w);
-            vec2 offset = vec2(rand(vec4(eyeSpacePosition.xyz, i)), rand(vec4(eyeSpacePosition.xyz, i + samples)));
-
-            vec2 stratifiedCoord = vec2(shadowLookup.xy + offset * radius);
-
-            float occluderDepth = texture(light.texShadowMap, stratifiedCoord.xy).x;
-
-            if (occluderDepth < ((lightClipPos.z - bias) / lightClipPos.w) * 0.5 + 0.5)
-                lightVisibility -= 1.0 / samples;
-        }
-
-        lightVisibility = clamp(lightVisibility, 0.0, 1.0);
-
-        // Apply the view frustum:
-        float upper = 1;
-        float lower = 0;
-        if (shadowLookup.x < lower || shadowLookup.x > upper ||
-                shadowLookup.y < lower || shadowLookup.y > upper
-                || shadowLookup.z > upper // || shadowLookup.z < lower
-                ) {
-            lightVisibility = 0;
-        } else if (shadowLookup.z < lower) {
-            lightVisibility = 1;
-        }
-    }
-
-    return lightVisibility;
-}
-
-float calcSpotlightFactor(in vec3 lightVec) {
-    float spotFactor = 1.0;
-
-    if (!light.hasShadowMap)
-        return 1.0;
-
-    float minDot = cos(light.angleConeOuter / 2.0); // TODO: precalc.
-    float lightDirDot = dot((viewInverse * vec4(lightVec, 0)).xyz, light.dir);
-
-    if (lightDirDot < minDot)
-        return 0.0;
-
-    float innerDot = cos(light.angleConeInner / 2.0); // TODO: precalc.
-
-    if (lightDirDot > innerDot)
-        return 1.0;
-
-    return (lightDirDot - minDot) / (innerDot - minDot);
-}
 
 void main() {
     // face normal in eye space:
     vec3 normal = normalize(eyeSpaceNormal.xyz);
-    vec3 lightVecRaw = eyeSpacePosition.xyz - (view * vec4(light.pos, 1)).xyz;
-    vec3 lightVec = normalize(lightVecRaw);
-
-    // Don't show lighting on surfaces that are facing the wrong way:
-    float lightDot = -dot(lightVec, normal);
-
     vec3 incident = normalize(eyeSpacePosition.xyz);
 
+#ifdef LIGHT_INDEPENDENT
     // Environment map reflection:
 //    vec3 outReflect = vec3(0,0,0);
-    vec3 outReflect;
-    if (hasTexEnvironmentMap && shininess > 0) {
+    vec3 outReflect = vec3(0, 0, 0);
+#ifdef HAS_TEX_ENVIRONMENT_MAP
+    if (shininess > 0) {
         vec3 viewReflect = reflect(incident, normal);
 //        float phongViewSpecular = phong(incident, viewReflect, shininess);
         vec4 sampleCoord = viewInverse * vec4(viewReflect, 0);
@@ -151,9 +47,16 @@ void main() {
         float fresnelFactor = pow(1.0 - max(0.0, dot(normal, -incident)), 2.0);
         vec3 fresnelCol = mix(vec3(0.1), vec3(1), fresnelFactor);
         outReflect = fresnelCol * reflectCol.rgb * colSpecular;
-    } else {
-        outReflect = vec3(0, 0, 0);
     }
+#endif
+
+    outColor = vec4(outReflect, opacity);
+#else
+    vec3 lightVecRaw = eyeSpacePosition.xyz - (view * vec4(light.pos, 1)).xyz;
+    vec3 lightVec = normalize(lightVecRaw);
+
+    // Don't show lighting on surfaces that are facing the wrong way:
+    float lightDot = -dot(lightVec, normal);
 
     // Specular reflection:
     vec3 colSpecular = vec3(1.0, 1.0, 1.0); // Ignore specular color to match 'deferredShading.frag'.
@@ -176,14 +79,18 @@ void main() {
     float lightVisibility = doShadowMapping(eyeSpacePosition);
 
     // Spotlight cone:
+#ifdef LIGHT_SHADOW_MAP
     float spotFactor = calcSpotlightFactor(lightVec);
+#else
+    float spotFactor = 1.0;
+#endif
 
     // Diffuse component:
     vec3 outDiffuse = colDiffuse * light.colDiffuse * max(lightDot, 0);
-    if (hasTexDiffuse) {
-        vec4 texCol = texture(texDiffuse, Texcoord);
-        outDiffuse = outDiffuse * texCol.rgb;
-    }
+#ifdef HAS_TEX_DIFFUSE
+    vec4 texCol = texture(texDiffuse, Texcoord);
+    outDiffuse = outDiffuse * texCol.rgb;
+#endif
 
 
     // Ambient component:
@@ -191,7 +98,8 @@ void main() {
 
     // Final colour:
     float intensity = calculateIntensity(length(lightVecRaw));
-    vec3 finalColor = outAmbient + outReflect + (outDiffuse + outSpecular) * intensity * lightVisibility * spotFactor;
+    vec3 finalColor = outAmbient + (outDiffuse + outSpecular) * intensity * lightVisibility * spotFactor;
 
     outColor = vec4(finalColor, opacity);
+#endif
 }
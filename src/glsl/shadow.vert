@@ -1,18 +1,23 @@
 #version 330 core
 
-in vec3 position;
-in vec3 normal;
-in vec2 texcoord;
+// Depths must match the depth pre-pass exactly (see Scene::forwardRender):
+invariant gl_Position;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texcoord;
 
 out vec2 Texcoord;
 out vec4 eyeSpacePosition;
 out vec3 eyeSpaceNormal;
 //out vec4 lightClipPos;
 
-uniform mat4 model;
-uniform mat4 view;
-//uniform mat4 proj;
-uniform mat4 mvp;
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat4 modelView;
+    mat4 mvp;
+};
+
 //uniform mat4 viewInverse;
 //
 //// Light uniforms:
@@ -42,8 +47,6 @@ void main() {
 //    gl_Position = proj * view * model * vec4(position, 1.0);
     gl_Position = mvp * vec4(position, 1.0);
 
-    mat4 modelView = view * model;
-
     eyeSpacePosition = modelView * vec4(position, 1.0);
 
     vec4 eyeSpaceNormalTmp = modelView * vec4(normal, 0);
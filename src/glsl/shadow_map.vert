@@ -1,11 +1,18 @@
 #version 330 core
 
-in vec3 position;
+// Depths must match the depth pre-pass exactly (see Scene::forwardRender):
+invariant gl_Position;
+
+layout(location = 0) in vec3 position;
 
 //uniform mat4 model;
 //uniform mat4 view;
 //uniform mat4 proj;
-uniform mat4 mvp;
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat4 modelView;
+    mat4 mvp;
+};
 
 void main() {
 //    gl_Position = proj * view * model * vec4(position, 1.0);
@@ -3,7 +3,7 @@
 //in vec3 Mapcoord;
 in vec4 eyeSpacePosition;
 
-uniform mat4 viewInverse;
+#include "include/camera.glsl"
 
 uniform samplerCube texEnvironmentMap;
 
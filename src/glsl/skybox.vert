@@ -1,18 +1,20 @@
 #version 330 core
 
-in vec3 position;
+layout(location = 0) in vec3 position;
 
 //out vec3 Mapcoord;
 out vec4 eyeSpacePosition;
 
-uniform mat4 mvp;
-uniform mat4 view;
-uniform mat4 model;
+layout(std140) uniform ObjectBlock {
+    mat4 model;
+    mat4 modelView;
+    mat4 mvp;
+};
 
 void main() {
 //    Mapcoord = normalize(position);
 
-    eyeSpacePosition = view * model * vec4(position, 1.0);
+    eyeSpacePosition = modelView * vec4(position, 1.0);
 
     gl_Position = mvp * vec4(position, 1.0);
 
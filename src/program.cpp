@@ -1,5 +1,13 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -10,17 +18,287 @@
 #include "utility/debug.h"
 #include "utility/make_unique.h"
 #include "utility/FrameTimer.h"
+#include "utility/AllocationCounter.h"
 
 #include "NUGL/Shader.h"
 #include "NUGL/ShaderProgram.h"
+#include "NUGL/ProgramBinaryCache.h"
 #include "NUGL/Buffer.h"
 #include "NUGL/VertexArray.h"
 #include "NUGL/Texture.h"
-#include "scene/ProceduralAsteroid.h"
 #include "scene/Model.h"
 #include "scene/Scene.h"
+#include "scene/UniformBlocks.h"
+#include "scene/SceneFile.h"
+#include "scene/InputRecording.h"
+#include "scene/StressScene.h"
+
+#ifndef NDEBUG
+// Count heap allocations, so that Scene::render can check that steady state frames do not allocate.
+UTILITY_DEFINE_ALLOCATION_COUNTER
+#endif
 
 static std::unique_ptr<scene::Scene> mainScene;
+static std::unique_ptr<scene::InputRecorder> inputRecorder;
+static std::unique_ptr<scene::InputPlayback> inputPlayback;
+static std::vector<std::string> sceneFiles; // Cycled through with N.
+static bool forwardDepthPrepass = true; // Cleared by --no-depth-prepass, toggled with Z.
+static size_t requestedScene = 0;
+
+// Scene names with this prefix are stress scenes generated from the parameters that follow it, not files:
+static const std::string stressScenePrefix = "stress:";
+static const std::string stressSceneBase = "assets/scenes/stress.json";
+
+/**
+ * Settings for the headless benchmark mode (--benchmark), which renders a fixed number of frames of the same scene
+ * along a scripted camera path, with a fixed animation clock, and writes the frame and per-pass statistics to a
+ * JSON file.
+ */
+struct BenchmarkOptions {
+    bool enabled = false;
+    int frames = 1000;
+    int warmupFrames = 100;
+    int width = 1280;
+    int height = 720;
+    double timeStep = 1 / 60.0; // Animation seconds per frame.
+    unsigned seed = 1031;
+    std::string contextApi = "native"; // native, egl, or osmesa.
+    std::string outputFile = "benchmark_results.json";
+};
+
+/**
+ * Settings for stress scene sweeps (--sweep), which benchmark each render path on a series of generated scenes that
+ * differ only in the swept parameter, and write the frame time statistics of each run as a row of a CSV file. The
+ * CPU and GPU times of each profiled pass of each run are written to a second file (see passesFile).
+ */
+struct SweepOptions {
+    bool enabled = false;
+    std::string parameter; // A StressSceneParams parameter, e.g. pointLights or asteroids.
+    std::vector<int> values;
+    std::string outputFile = "sweep_results.csv";
+
+    //! The output file name with "_passes" before its extension (e.g. sweep_results_passes.csv).
+    std::string passesFile() const {
+        size_t dot = outputFile.rfind('.');
+        if (dot == std::string::npos || outputFile.find('/', dot) != std::string::npos)
+            return outputFile + "_passes";
+        return outputFile.substr(0, dot) + "_passes" + outputFile.substr(dot);
+    }
+};
+
+static const int numRenderPaths = 3;
+static const char* renderPathNames[numRenderPaths] = {"deferred", "forward", "forward+reflections"};
+
+static void setRenderPath(scene::Scene& scene, int path) {
+    scene.useDeferredRendering = path == 0;
+    scene.forwardRenderReflections = path == 2;
+}
+
+//! Input recording (--record) and replay (--replay) settings.
+struct ReplayOptions {
+    std::string recordFile;
+    std::string replayFile;
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--benchmark [frames]] [--warmup frames] [--resolution WxH]"
+            << " [--seed n] [--context native|egl|osmesa] [--output file] [--record file | --replay file]"
+            << " [--scene file]... [--stress [name=value,...]]... [--sweep parameter [--sweep-values n,...]]"
+            << " [--no-shader-cache] [--no-depth-prepass]" << std::endl;
+}
+
+//! Parses a comma separated list of non-negative integers. Returns false if it is invalid.
+static bool parseValues(const std::string& str, std::vector<int>& values) {
+    values.clear();
+    std::stringstream stream(str);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end;
+        long value = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || value < 0)
+            return false;
+        values.push_back(int(value));
+    }
+    return !values.empty();
+}
+
+//! Parses the command line. Returns false if it is invalid.
+static bool parseArguments(int argc, char** argv, BenchmarkOptions& options, ReplayOptions& replay,
+        SweepOptions& sweep) {
+    std::string outputFile;
+    scene::StressSceneParams stressParams; // The parameters a sweep does not vary.
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+
+        if (arg == "--benchmark") {
+            options.enabled = true;
+            if (hasValue)
+                options.frames = std::atoi(argv[++i]);
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmupFrames = std::atoi(argv[++i]);
+        } else if (arg == "--resolution" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+                return false;
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--context" && hasValue) {
+            options.contextApi = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            outputFile = argv[++i];
+        } else if (arg == "--scene" && hasValue) {
+            sceneFiles.push_back(argv[++i]);
+        } else if (arg == "--stress") {
+            if (hasValue && !stressParams.parse(argv[++i]))
+                return false;
+            sceneFiles.push_back(stressScenePrefix + stressParams.str());
+        } else if (arg == "--sweep" && hasValue) {
+            sweep.enabled = true;
+            sweep.parameter = argv[++i];
+        } else if (arg == "--sweep-values" && hasValue) {
+            if (!parseValues(argv[++i], sweep.values))
+                return false;
+        } else if (arg == "--no-shader-cache") {
+            NUGL::ProgramBinaryCache::directory().clear();
+        } else if (arg == "--no-depth-prepass") {
+            forwardDepthPrepass = false;
+        } else if (arg == "--record" && hasValue) {
+            replay.recordFile = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            replay.replayFile = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    if (!replay.recordFile.empty() && (options.enabled || !replay.replayFile.empty()))
+        return false;
+
+    // Sweeps are benchmarks of one generated scene per value:
+    if (sweep.enabled) {
+        if (!replay.recordFile.empty() || !replay.replayFile.empty() || stressParams.find(sweep.parameter) == nullptr)
+            return false;
+
+        if (sweep.values.empty()) {
+            if (sweep.parameter.find("Lights") != std::string::npos)
+                sweep.values = {1, 2, 4, 8, 16, 32, 64};
+            else if (sweep.parameter == "reflectors")
+                sweep.values = {0, 1, 2, 4, 8};
+            else
+                sweep.values = {10, 50, 100, 250, 500, 1000};
+        }
+
+        options.enabled = true;
+        sceneFiles.clear();
+        for (int value : sweep.values) {
+            scene::StressSceneParams params = stressParams;
+            params.set(sweep.parameter, value);
+            sceneFiles.push_back(stressScenePrefix + params.str());
+        }
+    }
+
+    if (!outputFile.empty() && sweep.enabled)
+        sweep.outputFile = outputFile;
+    else if (!outputFile.empty())
+        options.outputFile = outputFile;
+
+    if (sceneFiles.empty())
+        sceneFiles.push_back("assets/scenes/default.json");
+
+    return options.frames > 0 && options.warmupFrames >= 0 && options.width > 0 && options.height > 0;
+}
+
+//! Selects the context creation API. Returns false if this build of GLFW does not support it.
+static bool setContextApiHints(const std::string& contextApi) {
+    if (contextApi == "native")
+        return true;
+
+#ifdef GLFW_EGL_CONTEXT_API
+    if (contextApi == "egl") {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        return true;
+    }
+#endif
+
+#ifdef GLFW_OSMESA_CONTEXT_API
+    if (contextApi == "osmesa") {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+static void writeBenchmarkResults(const BenchmarkOptions& options, double wallTime) {
+    std::ofstream out(options.outputFile);
+    if (!out) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Could not open benchmark output file '" << options.outputFile << "'.";
+        throw std::runtime_error(errMsg.str());
+    }
+
+    out << "{\n\"settings\": {\"frames\": " << options.frames
+            << ", \"warmupFrames\": " << options.warmupFrames
+            << ", \"width\": " << options.width
+            << ", \"height\": " << options.height
+            << ", \"timeStep\": " << options.timeStep
+            << ", \"seed\": " << options.seed
+            << ", \"contextApi\": ";
+    Profiler::writeJsonString(out, options.contextApi);
+    out << ", \"scene\": ";
+    Profiler::writeJsonString(out, sceneFiles[requestedScene]);
+    out << ", \"deferred\": " << std::boolalpha << mainScene->useDeferredRendering << "},\n";
+
+    out << "\"renderer\": ";
+    Profiler::writeJsonString(out, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    out << ",\n\"version\": ";
+    Profiler::writeJsonString(out, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    out << ",\n\"wallTime\": " << wallTime << ",\n\"profile\": ";
+    mainScene->profiler.writeReport(out);
+    out << "\n}\n";
+
+    std::cout << "Wrote benchmark results to '" << options.outputFile << "'." << std::endl;
+}
+
+/**
+ * Writes the frame times of a sweep run (the values of sweep.values by the render paths, in that order), and a row
+ * of CPU and GPU times for each pass that the run's render path timed on the GPU.
+ */
+static void writeSweepResult(std::ostream& out, std::ostream& passesOut, const SweepOptions& sweep, size_t run,
+        double wallTime) {
+    const utility::Histogram& frames = mainScene->profiler.frameHistogram;
+    out << renderPathNames[run % numRenderPaths] << "," << sweep.parameter << "," << sweep.values[run / numRenderPaths]
+            << "," << frames.count()
+            << "," << frames.mean() / 1000.0
+            << "," << frames.percentile(50) / 1000.0
+            << "," << frames.percentile(90) / 1000.0
+            << "," << frames.percentile(99) / 1000.0
+            << "," << frames.max() / 1000.0
+            << "," << wallTime * 1000.0 / std::max(uint64_t(1), frames.count()) << std::endl;
+
+    mainScene->profiler.visitScopes([&](const std::string& pass, const Profiler::ProfilerNode& scope) {
+        if (scope.gpuHistogram.count() == 0)
+            return;
+
+        passesOut << renderPathNames[run % numRenderPaths] << "," << sweep.parameter << ","
+                << sweep.values[run / numRenderPaths] << ",";
+        Profiler::writeJsonString(passesOut, pass); // Quoted, as pass names may contain commas.
+        passesOut << "," << scope.gpuHistogram.count()
+                << "," << scope.histogram.mean() / 1000.0
+                << "," << scope.histogram.percentile(99) / 1000.0
+                << "," << scope.gpuHistogram.mean() / 1000.0
+                << "," << scope.gpuHistogram.percentile(50) / 1000.0
+                << "," << scope.gpuHistogram.percentile(90) / 1000.0
+                << "," << scope.gpuHistogram.percentile(99) / 1000.0
+                << "," << scope.gpuHistogram.max() / 1000.0 << std::endl;
+    });
+
+    std::cout << "Sweep run " << run + 1 << " of " << sweep.values.size() * numRenderPaths << ": "
+            << renderPathNames[run % numRenderPaths] << ", " << sweep.parameter << " = " << sweep.values[run / numRenderPaths]
+            << ", mean " << frames.mean() / 1000.0 << " ms, p99 " << frames.percentile(99) / 1000.0 << " ms" << std::endl;
+}
 
 void errorCallback(int error, const char* description) {
     std::cerr << "GLFW ERROR: " << description << std::endl;
@@ -53,9 +331,11 @@ void framebufferSizeCallback(GLFWwindow* window, int fbWidth, int fbHeight) {
 //    std::cout << __func__ << ": [" << x << ", " << y << "]" << std::endl;
 //}
 
-void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    if (action == GLFW_PRESS && key == GLFW_KEY_TAB)
+void processKey(GLFWwindow* window, int key, int action) {
+    if (action == GLFW_PRESS && key == GLFW_KEY_TAB) {
         mainScene->useDeferredRendering = !mainScene->useDeferredRendering;
+        mainScene->profiler.mark(PROFILER_LABEL("toggle deferred rendering"));
+    }
 
     if (action == GLFW_PRESS && key == GLFW_KEY_T)
         mainScene->profiler.glFinishEnabled = !mainScene->profiler.glFinishEnabled;
@@ -63,11 +343,32 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     if (action == GLFW_PRESS && key == GLFW_KEY_SPACE)
         mainScene->fpsMode = !mainScene->fpsMode;
 
-    if (action == GLFW_PRESS && key == GLFW_KEY_R)
+    if (action == GLFW_PRESS && key == GLFW_KEY_R) {
         mainScene->forwardRenderReflections = !mainScene->forwardRenderReflections;
+        mainScene->profiler.mark(PROFILER_LABEL("toggle forward rendered reflections"));
+    }
 
-    if (action == GLFW_PRESS && key == GLFW_KEY_F)
+    if (action == GLFW_PRESS && key == GLFW_KEY_F) {
         mainScene->flashlightOn = !mainScene->flashlightOn;
+        mainScene->profiler.mark(PROFILER_LABEL("toggle flashlight"));
+    }
+
+    if (action == GLFW_PRESS && key == GLFW_KEY_Z) {
+        forwardDepthPrepass = !forwardDepthPrepass;
+        mainScene->forwardDepthPrepass = forwardDepthPrepass;
+        mainScene->profiler.mark(PROFILER_LABEL("toggle forward depth pre-pass"));
+    }
+
+    // Record a trace of the next 600 frames (or stop the current trace). startTrace reports its own errors:
+    if (action == GLFW_PRESS && key == GLFW_KEY_C) {
+        if (mainScene->profiler.isTracing())
+            mainScene->profiler.stopTrace();
+        else
+            mainScene->profiler.startTrace("profile_trace.json", 600);
+    }
+
+    if (action == GLFW_PRESS && key == GLFW_KEY_N)
+        requestedScene = (requestedScene + 1) % sceneFiles.size();
 
     if (action == GLFW_PRESS && key == GLFW_KEY_P)
         mainScene->paused = !mainScene->paused;
@@ -94,11 +395,51 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     }
 }
 
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    // While replaying, key presses come from the recording instead:
+    if (inputPlayback)
+        return;
+
+    // All of the keys handled by processKey act on presses, so only presses are recorded:
+    if (inputRecorder && action == GLFW_PRESS)
+        inputRecorder->keyPressed(key);
+
+    processKey(window, key, action);
+}
+
 int main(int argc, char** argv) {
-    glfwInit();
+    BenchmarkOptions benchmark;
+    ReplayOptions replay;
+    SweepOptions sweep;
+    NUGL::ProgramBinaryCache::directory() = "shader_cache";
+    if (!parseArguments(argc, argv, benchmark, replay, sweep)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Replays recreate the recorded session's window and scene:
+    unsigned sceneSeed = benchmark.enabled ? benchmark.seed : std::random_device()();
+    if (!replay.replayFile.empty()) {
+        inputPlayback = std::make_unique<scene::InputPlayback>(replay.replayFile);
+        sceneSeed = inputPlayback->seed;
+        benchmark.width = inputPlayback->windowSize.x;
+        benchmark.height = inputPlayback->windowSize.y;
+        benchmark.seed = sceneSeed;
+    }
+
+#ifdef GLFW_PLATFORM_NULL
+    // OSMesa renders in software, so it needs no display at all:
+    if (benchmark.contextApi == "osmesa")
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
 
     glfwSetErrorCallback(errorCallback);
 
+    if (!glfwInit()) {
+        std::cerr << "Could not initialise GLFW." << std::endl;
+        return EXIT_FAILURE;
+    }
+
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -111,10 +452,27 @@ int main(int argc, char** argv) {
     glfwWindowHint(GLFW_DEPTH_BITS, 24);
     glfwWindowHint(GLFW_STENCIL_BITS, 8);
 
+    // Benchmarks render offscreen, at a fixed resolution:
+    if (benchmark.enabled) {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    }
+
+    if (!setContextApiHints(benchmark.contextApi)) {
+        std::cerr << "This build of GLFW does not support the '" << benchmark.contextApi << "' context API." << std::endl;
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
     // Windowed:
-    int screenWidth = 700;
-    int screenHeight = 700;
+    int screenWidth = benchmark.enabled || inputPlayback ? benchmark.width : 700;
+    int screenHeight = benchmark.enabled || inputPlayback ? benchmark.height : 700;
     GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "OpenGL", nullptr, nullptr);
+    if (window == nullptr) {
+        std::cerr << "Could not create a window with an OpenGL 3.3 context." << std::endl;
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
 
     // Fullscreen:
 //    const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
@@ -129,7 +487,8 @@ int main(int argc, char** argv) {
 
     // Disable cursor to allow correct mouse input for camera controls on OSX.
     // See: http://stackoverflow.com/questions/14468039/glfw-glfwsetmousepos-bug-on-mac-os-x-10-7-with-opengl-camera
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!benchmark.enabled)
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 //    glfwSetCursorPosCallback(window, cursorPositionCallback);
@@ -143,6 +502,18 @@ int main(int argc, char** argv) {
     glewInit();
     checkForAndPrintGLError(__FILE__, __LINE__);
 
+    // Programs are linked without waiting for the driver, and checked when first used:
+    NUGL::ShaderProgram::enableParallelCompilation();
+
+    // Stream texture uploads through pixel buffer objects:
+    NUGL::Texture::pixelBufferRing() = std::make_shared<NUGL::PixelBufferRing>();
+
+    // Uniform blocks shared by the scene's shader programs are bound to fixed binding points at link time:
+    NUGL::ShaderProgram::uniformBlockBindings() = {
+            {"CameraBlock", scene::cameraBlockBinding},
+            {"ObjectBlock", scene::objectBlockBinding},
+            {"LightBlock", scene::lightBlockBinding},
+    };
 
     // Load deferred rendering shaders:
     auto gBufferProgram = NUGL::ShaderProgram::createSharedFromFiles("gBufferProgram", {
@@ -153,8 +524,6 @@ int main(int argc, char** argv) {
     gBufferProgram->bindFragDataLocation(1, "outAlbedoRoughness");
     gBufferProgram->bindFragDataLocation(2, "outEnvMapColSpecIntensity");
     gBufferProgram->link();
-    gBufferProgram->updateMaterialInfo();
-    gBufferProgram->printDebugInfo();
 
     auto deferredShadingProgram = NUGL::ShaderProgram::createSharedFromFiles("deferredShadingProgram", {
             {GL_VERTEX_SHADER, "src/glsl/deferredShading.vert"},
@@ -162,45 +531,6 @@ int main(int argc, char** argv) {
     });
     deferredShadingProgram->bindFragDataLocation(0, "outColor");
     deferredShadingProgram->link();
-    deferredShadingProgram->updateMaterialInfo();
-    deferredShadingProgram->printDebugInfo();
-
-    // Load forward rendering shaders:
-    auto flatProgram = NUGL::ShaderProgram::createSharedFromFiles("flatProgram", {
-            {GL_VERTEX_SHADER, "src/glsl/position.vert"},
-            {GL_FRAGMENT_SHADER, "src/glsl/uniform.frag"},
-    });
-    flatProgram->bindFragDataLocation(0, "outColor");
-    flatProgram->link();
-    flatProgram->updateMaterialInfo();
-    flatProgram->printDebugInfo();
-
-    auto textureProgram = NUGL::ShaderProgram::createSharedFromFiles("textureProgram", {
-            {GL_VERTEX_SHADER, "src/glsl/textured.vert"},
-            {GL_FRAGMENT_SHADER, "src/glsl/textured.frag"},
-    });
-    textureProgram->bindFragDataLocation(0, "outColor");
-    textureProgram->link();
-    textureProgram->updateMaterialInfo();
-    textureProgram->printDebugInfo();
-
-    auto reflectProgram = NUGL::ShaderProgram::createSharedFromFiles("reflectProgram", {
-            {GL_VERTEX_SHADER, "src/glsl/shadow.vert"},
-            {GL_FRAGMENT_SHADER, "src/glsl/shadow.frag"},
-    });
-    reflectProgram->bindFragDataLocation(0, "outColor");
-    reflectProgram->link();
-    reflectProgram->updateMaterialInfo();
-    reflectProgram->printDebugInfo();
-
-    auto skyboxProgram = NUGL::ShaderProgram::createSharedFromFiles("skyboxProgram", {
-            {GL_VERTEX_SHADER, "src/glsl/skybox.vert"},
-            {GL_FRAGMENT_SHADER, "src/glsl/skybox.frag"},
-    });
-    skyboxProgram->bindFragDataLocation(0, "outColor");
-    skyboxProgram->link();
-    skyboxProgram->updateMaterialInfo();
-    skyboxProgram->printDebugInfo();
 
     auto shadowMapProgram = NUGL::ShaderProgram::createSharedFromFiles("shadowMapProgram", {
             {GL_VERTEX_SHADER, "src/glsl/shadow_map.vert"},
@@ -208,8 +538,6 @@ int main(int argc, char** argv) {
     });
     shadowMapProgram->bindFragDataLocation(0, "outColor");
     shadowMapProgram->link();
-    shadowMapProgram->updateMaterialInfo();
-    shadowMapProgram->printDebugInfo();
 
     // Load compositing shaders:
     auto screenProgram = NUGL::ShaderProgram::createSharedFromFiles("screenProgram", {
@@ -218,8 +546,6 @@ int main(int argc, char** argv) {
     });
     screenProgram->bindFragDataLocation(0, "outColor");
     screenProgram->link();
-    screenProgram->updateMaterialInfo();
-    screenProgram->printDebugInfo();
 
     auto screenAlphaProgram = NUGL::ShaderProgram::createSharedFromFiles("screenAlphaProgram", {
             {GL_VERTEX_SHADER, "src/glsl/screen.vert"},
@@ -227,230 +553,73 @@ int main(int argc, char** argv) {
     });
     screenAlphaProgram->bindFragDataLocation(0, "outColor");
     screenAlphaProgram->link();
-    screenAlphaProgram->updateMaterialInfo();
-    screenAlphaProgram->printDebugInfo();
-
-    // Create Scene:
-    mainScene = std::make_unique<scene::Scene>(screenProgram, screenAlphaProgram,
-            glm::ivec2({screenWidth, screenHeight}),
-            glm::ivec2({fbWidth, fbHeight})
-    );
-    mainScene->shadowMapProgram = shadowMapProgram;
-    mainScene->gBufferProgram = gBufferProgram;
-    mainScene->deferredShadingProgram = deferredShadingProgram;
-
-    // Add some lights:
-    glm::vec3 sunlightCol = glm::vec3(1, 1, 0.7);
-    glm::vec3 downlightCol = glm::vec3(1, 1, 1) * 100.0f;
-    glm::vec3 tubelightCol = glm::vec3(0.4, 0.4, 1) * 50.0f;
-    glm::vec3 flashlightCol = glm::vec3(1, 1, 1) * 50.0f;
-
-    auto lightModel = std::make_shared<scene::Model>("sun");
-    auto light = std::make_shared<scene::Light>();
-    glm::vec3 sunDir = glm::normalize(glm::vec3(-10, -50, -5));
-    glm::vec3 sunPos = glm::vec3(30, 50, 12) + sunDir * 0.0f;
-    lightModel->lights.push_back(scene::Light::makeDirectional(sunPos, sunDir, 125, sunlightCol, sunlightCol));
-    mainScene->addModel(lightModel);
-
-    lightModel = std::make_shared<scene::Model>("downlight 1");
-    lightModel->lights.push_back(scene::Light::makeSpotlight({10, 0, 14}, {0, 0, -1}, 2, 1, downlightCol, downlightCol));
-    mainScene->addModel(lightModel);
-
-    lightModel = std::make_shared<scene::Model>("downlight 2");
-    lightModel->lights.push_back(scene::Light::makeSpotlight({-10, 0, 14}, {0, 0, -1}, 2, 1, downlightCol, downlightCol));
-    mainScene->addModel(lightModel);
-
-    lightModel = std::make_shared<scene::Model>("tube light");
-    light = scene::Light::makeSpotlight({0, 0, 0}, {0, 0, 1}, 1.5, 1.5, tubelightCol, tubelightCol);
-    light->colAmbient = glm::vec3(0.1);
-    lightModel->lights.push_back(light);
-    mainScene->addModel(lightModel);
-
-    lightModel = std::make_shared<scene::Model>("flash light");
-    auto flashlight = scene::Light::makeSpotlight({0, 0, 0}, {0, 0, 1}, 0.5, 0.2, flashlightCol, flashlightCol);
-    flashlight->colAmbient = glm::vec3(0.1);
-    lightModel->lights.push_back(flashlight);
-    mainScene->addModel(lightModel);
-
-
-    // TODO: Find a way to manage texture units!
-    auto cubeMap = std::make_shared<NUGL::Texture>(GL_TEXTURE2, GL_TEXTURE_CUBE_MAP);
-    cubeMap->loadCubeMap({
-            "assets/default_right1.png",
-            "assets/default_left2.png",
-            "assets/default_top3.png",
-            "assets/default_bottom4.png",
-            "assets/default_front5.png",
-            "assets/default_back6.png"
-
-//            "assets/PereaBeach1/posx.jpg",
-//            "assets/PereaBeach1/negx.jpg",
-//            "assets/PereaBeach1/posy.jpg",
-//            "assets/PereaBeach1/negy.jpg",
-//            "assets/PereaBeach1/posz.jpg",
-//            "assets/PereaBeach1/negz.jpg"
-    });
-    cubeMap->setParam(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    cubeMap->setParam(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    cubeMap->setParam(GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    cubeMap->setParam(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    cubeMap->setParam(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    cubeMap->setParam(GL_TEXTURE_BASE_LEVEL, 0);
-    cubeMap->setParam(GL_TEXTURE_MAX_LEVEL, 0);
-////    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-    // Load assets:
-    auto eagle5Model = scene::Model::loadFromFile("assets/eagle 5 transport/eagle 5 transport landed.obj");
-//    auto eagle5Model = scene::Model::loadFromFile("assets/Ship/Ship Room.obj");
-//    auto eagle5Model = scene::Model::loadFromFile("assets/textured_cube.obj");
-//    auto eagle5Model = scene::Model::loadFromFile("assets/KingsTreasure_OBJ/KingsTreasure.obj");
-    eagle5Model->flatProgram = flatProgram;
-    eagle5Model->textureProgram = textureProgram;
-//    eagle5Model->environmentMapProgram = sharedFlatReflectProgram;
-    eagle5Model->environmentMapProgram = reflectProgram;
-    eagle5Model->setEnvironmentMap(cubeMap);
-//    eagle5Model->setEnvironmentMap(nullptr); // TODO: Improve environment map management.
-//    eagle5Model->dynamicReflections = true;
-    eagle5Model->createMeshBuffers();
-    eagle5Model->createVertexArrays();
-    eagle5Model->pos = {60, 0, -5};
-    eagle5Model->dir = {-1, 1, 0};
-    eagle5Model->scale = glm::vec3(0.2);
-    mainScene->addModel(eagle5Model);
-
-//    auto houseModel = scene::Model::loadFromFile("assets/House01/House01.obj");
-//    houseModel->flatProgram = flatProgram;
-//    houseModel->textureProgram = textureProgram;
-////    houseModel->environmentMapProgram = sharedFlatReflectProgram;
-//    houseModel->environmentMapProgram = reflectProgram;
-//    houseModel->setEnvironmentMap(cubeMap);
-//    houseModel->createMeshBuffers();
-//    houseModel->createVertexArrays();
-//    houseModel->dir = {0, 1, 0};
-//    houseModel->scale = glm::vec3(3);
-//    mainScene->addModel(houseModel);
-
-    auto spaceshipModel = scene::Model::loadFromFile("assets/spaceship/spaceship.obj");
-//    auto spaceshipModel = scene::Model::loadFromFile("assets/spaceship/spaceship.3ds");
-    spaceshipModel->flatProgram = flatProgram;
-    spaceshipModel->textureProgram = textureProgram;
-//    spaceshipModel->environmentMapProgram = sharedFlatReflectProgram;
-    spaceshipModel->environmentMapProgram = reflectProgram;
-    spaceshipModel->setEnvironmentMap(cubeMap);
-    spaceshipModel->createMeshBuffers();
-    spaceshipModel->createVertexArrays();
-    spaceshipModel->dir = {0, 1, 0};
-//    spaceshipModel->pos = {50, 150, 30};
-    spaceshipModel->scale = glm::vec3(20);
-    mainScene->addModel(spaceshipModel);
-
-    auto robotModel = scene::Model::loadFromFile("assets/graph-robot.obj");
-    robotModel->flatProgram = flatProgram;
-    robotModel->textureProgram = textureProgram;
-    robotModel->environmentMapProgram = reflectProgram;
-//    robotModel->setEnvironmentMap(cubeMap);
-    robotModel->setEnvironmentMap(nullptr); // TODO: Improve environment map management.
-    robotModel->dynamicReflections = true;
-    robotModel->createMeshBuffers();
-    robotModel->createVertexArrays();
-    robotModel->dir = {0, 1, 0};
-    robotModel->pos = {0, 1, 0};
-    robotModel->scale = glm::vec3(1);
-
-    // Make the robot's light globes emissive:
-    robotModel->materials[2]->materialInfo.has.emissive = true;
-    robotModel->materials[2]->emissive = 1;
-
-    // Make the robot metallic:
-    for (auto material : robotModel->materials) {
-        material->materialInfo.has.reflectivity = true;
-        material->reflectivity = 1;
-    }
 
-    glm::vec3 robotLightCol = glm::vec3(0.6, 0.6, 1) * 50.0f;
-    robotModel->lights.push_back(scene::Light::makeSpotlight({0, 0, 0}, {0, 0, 0}, 1.5, 0.6, robotLightCol, robotLightCol));
-    robotModel->lights.push_back(scene::Light::makeSpotlight({0, 0, 0}, {0, 0, 0}, 1.5, 0.6, robotLightCol, robotLightCol));
-    mainScene->addModel(robotModel);
-
-//    auto cubeModel = scene::Model::loadFromFile("assets/cube.obj");
-//    cubeModel->flatProgram = flatProgram;
-//    cubeModel->textureProgram = textureProgram;
-////    cubeModel->environmentMapProgram = sharedFlatReflectProgram;
-//    cubeModel->environmentMapProgram = reflectProgram;
-//    cubeModel->setEnvironmentMap(cubeMap);
-////    cubeModel->setEnvironmentMap(nullptr); // TODO: Improve environment map management.
-////    cubeModel->dynamicReflections = true;
-//    cubeModel->createMeshBuffers();
-//    cubeModel->createVertexArrays();
-////    cubeModel->pos = {15, 120, 40};
-////    cubeModel->scale = glm::vec3(3);
-//    cubeModel->pos = {15, 120, 60};
-//    cubeModel->scale = glm::vec3(10);
-//    cubeModel->materials[0]->materialInfo.has.shininess = true;
-//    cubeModel->materials[0]->shininess = 1;
-//    cubeModel->materials[0]->colSpecular = glm::vec3(1);
-//    mainScene->addModel(cubeModel);
-
-    auto asteroidModel = scene::createAsteroid(0.3, 0.2, 4);
-//    auto asteroidModel = scene::createAsteroid(0, 0, 4);
-    asteroidModel->flatProgram = flatProgram;
-    asteroidModel->textureProgram = textureProgram;
-    asteroidModel->environmentMapProgram = reflectProgram;
-    asteroidModel->setEnvironmentMap(cubeMap);
-//    asteroidModel->setEnvironmentMap(nullptr); // TODO: Improve environment map management.
-//    asteroidModel->dynamicReflections = true;
-    asteroidModel->createMeshBuffers();
-    asteroidModel->createVertexArrays();
-    asteroidModel->pos = {0, 0, 5};
-    asteroidModel->scale = glm::vec3(1.2);
-//    asteroidModel->scale = glm::vec3(1.5);
-    mainScene->addModel(asteroidModel);
-
-    std::vector<std::shared_ptr<scene::Model>> asteroids;
-    for (int i = 0; i < 10; i++) {
-        auto asteroid = scene::createAsteroid(0.2, 0.2, 2);
-        asteroids.push_back(asteroid);
-
-        asteroid->flatProgram = flatProgram;
-        asteroid->textureProgram = textureProgram;
-        asteroid->environmentMapProgram = reflectProgram;
-        asteroid->setEnvironmentMap(cubeMap);
-//    asteroid->setEnvironmentMap(nullptr); // TODO: Improve environment map management.
-//    asteroid->dynamicReflections = true;
-        asteroid->createMeshBuffers();
-        asteroid->createVertexArrays();
-        asteroid->pos = {0, 30, 0};
-        asteroid->scale = glm::vec3(5);
-        mainScene->addModel(asteroid);
+    // Create the scene (and recreate it whenever another scene file is selected):
+    scene::SceneFile sceneFile;
+    auto loadScene = [&](const std::string& sceneFileName) {
+        glfwGetWindowSize(window, &screenWidth, &screenHeight);
+        glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+
+        // Release the previous scene's GL resources before allocating the next one's:
+        mainScene.reset();
+        sceneFile = scene::SceneFile();
+
+        mainScene = std::make_unique<scene::Scene>(screenProgram, screenAlphaProgram,
+                glm::ivec2({screenWidth, screenHeight}),
+                glm::ivec2({fbWidth, fbHeight})
+        );
+        mainScene->shadowMapProgram = shadowMapProgram;
+        mainScene->gBufferProgram = gBufferProgram;
+        mainScene->deferredShadingProgram = deferredShadingProgram;
+        mainScene->forwardDepthPrepass = forwardDepthPrepass;
+
+        if (sceneFileName.compare(0, stressScenePrefix.size(), stressScenePrefix) == 0) {
+            scene::StressSceneParams params;
+            params.parse(sceneFileName.substr(stressScenePrefix.size()));
+            sceneFile = scene::loadStressScene(stressSceneBase, params, *mainScene, sceneSeed);
+        } else {
+            sceneFile = scene::loadSceneFile(sceneFileName, *mainScene, sceneSeed);
+        }
+
+        mainScene->camera->lastUpdateTime = glfwGetTime();
+        mainScene->camera->frameWidth = screenWidth;
+        mainScene->camera->frameHeight = screenHeight;
+        mainScene->camera->prepareTransforms();
+
+        if (benchmark.enabled)
+            mainScene->profiler.histogramWindow = 0;
+    };
+    size_t currentScene = 0;
+    loadScene(sceneFiles[currentScene]);
+
+    if (benchmark.enabled)
+        glfwSwapInterval(0); // Don't wait for v-sync.
+    int frameNumber = 0;
+    double benchmarkStart = glfwGetTime();
+
+    // Each sweep run renders the same frames, so that only the scene and render path differ between runs:
+    size_t sweepRun = 0;
+    std::ofstream sweepOut;
+    std::ofstream sweepPassesOut;
+    if (sweep.enabled) {
+        sweepOut.open(sweep.outputFile);
+        if (!sweepOut) {
+            std::cerr << "Could not open sweep output file '" << sweep.outputFile << "'." << std::endl;
+            return EXIT_FAILURE;
+        }
+        sweepOut << "path,parameter,value,frames,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,wall_ms_per_frame" << std::endl;
+
+        sweepPassesOut.open(sweep.passesFile());
+        if (!sweepPassesOut) {
+            std::cerr << "Could not open sweep output file '" << sweep.passesFile() << "'." << std::endl;
+            return EXIT_FAILURE;
+        }
+        sweepPassesOut << "path,parameter,value,pass,samples,cpu_mean_ms,cpu_p99_ms,gpu_mean_ms,gpu_p50_ms,gpu_p90_ms,"
+                << "gpu_p99_ms,gpu_max_ms" << std::endl;
     }
 
-    auto skyBox = scene::Model::loadFromFile("assets/cube.obj");
-    skyBox->flatProgram = flatProgram;
-    skyBox->textureProgram = textureProgram;
-    skyBox->environmentMapProgram = skyboxProgram;
-    skyBox->setEnvironmentMap(cubeMap);
-    skyBox->createMeshBuffers();
-    skyBox->createVertexArrays();
-    mainScene->addModel(skyBox);
-    mainScene->skyBox = skyBox;
-
-    // Setup Camera:
-//    mainScene->camera->pos = {15, 120, 40};
-    mainScene->camera->near_ = 1;
-    mainScene->camera->pos = {-20, 0, 5};
-    mainScene->camera->dir = {1, 0, 0};
-//    mainScene->camera->pos = {37.2, 156, 38.1};
-//    mainScene->camera->dir = {0.415, -0.646, -0.64};
-    mainScene->camera->fov = M_PI_4;
-    mainScene->camera->speed = 10;
-    mainScene->camera->lookSpeed = 0.005;
-    mainScene->camera->up = glm::vec3(0.0f, 0.0f, 1.0f);
-//    mainScene->camera->up = glm::vec3(0.0f, 1.0f, 0.0f);
-    mainScene->camera->lastUpdateTime = glfwGetTime();
-    mainScene->camera->frameWidth = screenWidth;
-    mainScene->camera->frameHeight = screenHeight;
-    mainScene->camera->prepareTransforms();
-    mainScene->camera->initializeAngles();
+    if (!replay.recordFile.empty())
+        inputRecorder = std::make_unique<scene::InputRecorder>(replay.recordFile, sceneSeed, glm::ivec2(screenWidth, screenHeight));
 
     // Backface culling:
 //    glEnable (GL_CULL_FACE); // cull face
@@ -463,78 +632,122 @@ int main(int argc, char** argv) {
             glfwSetWindowTitle(window, frameTimer.timeStr.c_str());
         }
 
-        skyBox->pos = mainScene->camera->pos;
-
-        if (!mainScene->paused) {
-            // Tube-rock movement:
-            float t = glfwGetTime();
-            asteroidModel->pos = glm::vec3(0,0,8) + glm::vec3(0,0,3) * std::sin(t);
-            asteroidModel->dir = glm::normalize(glm::vec3(std::sin(2 * t) + std::cos(3 * t), std::cos(2 * t), std::cos(3 * t)));
-
-            // Asteroid movement:
-            srand(1031);
-            for (int i = 0; i < asteroids.size(); i++) {
-                auto asteroid = asteroids[i];
-
-                float k = rand() / (float)RAND_MAX;
+        if (requestedScene != currentScene) {
+            currentScene = requestedScene;
+            loadScene(sceneFiles[currentScene]);
+        }
+        if (sweep.enabled)
+            setRenderPath(*mainScene, int(sweepRun % numRenderPaths));
 
-                float t = glfwGetTime() + k * 1097;
-                float radius = (80 + k * 80);
-                float tilt = ((k - 0.5) + 0.5) * 0.5;
-                float speed = 1600.0 / (radius * radius);
+        // Benchmarks advance the animation by a fixed step per frame, so every run renders the same frames:
+        // Replays take the clock from the recording.
+        double animationTime = benchmark.enabled ? frameNumber * benchmark.timeStep : glfwGetTime();
+        if (inputPlayback)
+            animationTime = inputPlayback->currentFrame().time;
+        else if (benchmark.enabled)
+            sceneFile.cameraPath.apply(*mainScene->camera, animationTime);
 
-                glm::vec4 pos = glm::vec4(std::cos(t * speed), std::sin(t * speed), 0, 1);
-                glm::mat4 rot;
-                rot = glm::rotate(rot, tilt, glm::normalize(glm::vec3(0,1,0)));
-                pos = rot * pos;
-                asteroid->pos = glm::vec3(pos.x, pos.y, pos.z) * radius;
-                asteroid->dir = glm::vec3(std::sin(k*t*5), std::cos(k*t*5), 0);
-            }
+        if (mainScene->skyBox)
+            mainScene->skyBox->pos = mainScene->camera->pos;
 
-            // Robot movement:
-            {
-                float t = glfwGetTime();
-                float radius = 11. + (std::sin(t / 1.5) * 3.);
-                glm::vec3 lastPos = robotModel->pos;
-                robotModel->pos = glm::vec3(std::cos(t / 6.), std::sin(t / 6.), 0) * radius;
-                robotModel->dir = glm::normalize(robotModel->pos - lastPos);
-
-                glm::mat4 transform = robotModel->modelTransform();
-                robotModel->lights[0]->pos = glm::vec3(transform * glm::vec4(1.00111, 1.45769, -0.98452, 1));
-                robotModel->lights[0]->dir = glm::normalize(glm::vec3(transform * glm::vec4(0, 0, -1, 0)));
-                robotModel->lights[1]->pos = glm::vec3(transform * glm::vec4(-1.00111, 1.45769, -0.98452, 1));
-                robotModel->lights[1]->dir = glm::normalize(glm::vec3(transform * glm::vec4(0, 0, -1, 0)));
-            }
-        }
+        if (!mainScene->paused)
+            sceneFile.animate(animationTime);
 
         mainScene->render();
 
         // Swap front and back buffers:
 //        glfwSwapInterval(1); // v-sync
         glfwSwapBuffers(window);
-        mainScene->profiler.split("glfwSwapBuffers");
+        mainScene->profiler.split(PROFILER_LABEL("glfwSwapBuffers"));
 
         // Poll for and process events:
         glfwPollEvents();
-        mainScene->profiler.split("glfwPollEvents");
+        mainScene->profiler.split(PROFILER_LABEL("glfwPollEvents"));
+
+        scene::PlayerInput playerInput;
+        float deltaTime = 0;
+        if (inputPlayback) {
+            const scene::RecordedFrame& frame = inputPlayback->currentFrame();
+            for (uint32_t i = 0; i < frame.numKeyPresses; i++) {
+                processKey(window, inputPlayback->keyPresses[frame.firstKeyPress + i], GLFW_PRESS);
+            }
+
+            playerInput = frame.input;
+            deltaTime = frame.deltaTime;
+        } else if (!mainScene->cameraLocked && !benchmark.enabled) {
+            playerInput = scene::PlayerInput::poll(window);
+            deltaTime = mainScene->camera->updateClock(glfwGetTime());
+        }
 
-        if (!mainScene->cameraLocked) {
-            mainScene->camera->processPlayerInput(window);
+        if (!mainScene->cameraLocked && (inputPlayback || !benchmark.enabled)) {
+            mainScene->camera->processPlayerInput(playerInput, deltaTime);
         }
 
         if (mainScene->fpsMode) {
             mainScene->camera->pos.z = 6;
             mainScene->camera->prepareTransforms();
         }
-        flashlight->enabled = mainScene->flashlightOn;
-        flashlight->pos = mainScene->camera->pos + glm::cross(mainScene->camera->dir, mainScene->camera->up) * 2.0f;
-        flashlight->dir = mainScene->camera->dir;
-        mainScene->profiler.split("processPlayerInput");
+        if (sceneFile.flashlight) {
+            sceneFile.flashlight->enabled = mainScene->flashlightOn;
+            sceneFile.flashlight->pos = mainScene->camera->pos + glm::cross(mainScene->camera->dir, mainScene->camera->up) * 2.0f;
+            sceneFile.flashlight->dir = mainScene->camera->dir;
+        }
+        if (inputRecorder)
+            inputRecorder->endFrame(animationTime, deltaTime, playerInput, *mainScene->camera);
+        if (inputPlayback)
+            inputPlayback->nextFrame(*mainScene->camera);
+
+        mainScene->profiler.split(PROFILER_LABEL("processPlayerInput"));
+        mainScene->profiler.endFrame();
+        frameNumber++;
+
+        // Replays end with the recording (and report their results, if they are also benchmarks):
+        if (inputPlayback && inputPlayback->finished()) {
+            std::cout << "Replayed " << inputPlayback->frameCount() << " frames; "
+                    << inputPlayback->divergedFrames << " diverged from the recording." << std::endl;
+
+            if (benchmark.enabled) {
+                mainScene->profiler.finishGpuFrames();
+                writeBenchmarkResults(benchmark, glfwGetTime() - benchmarkStart);
+            }
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        } else if (benchmark.enabled) {
+            // Only measure frames after the warm-up (in which shaders are compiled and caches are filled):
+            if (frameNumber == benchmark.warmupFrames && frameNumber > 0) {
+                mainScene->profiler.finishGpuFrames();
+                mainScene->profiler.resetHistograms();
+                benchmarkStart = glfwGetTime();
+            }
+
+            if (frameNumber == benchmark.warmupFrames + benchmark.frames && sweep.enabled) {
+                mainScene->profiler.finishGpuFrames();
+                writeSweepResult(sweepOut, sweepPassesOut, sweep, sweepRun, glfwGetTime() - benchmarkStart);
+
+                // Start the next run (loading the next scene after the last render path):
+                if (++sweepRun == sweep.values.size() * numRenderPaths) {
+                    std::cout << "Wrote sweep results to '" << sweep.outputFile << "' and '" << sweep.passesFile() << "'."
+                            << std::endl;
+                    glfwSetWindowShouldClose(window, GL_TRUE);
+                } else {
+                    requestedScene = sweepRun / numRenderPaths;
+                    mainScene->profiler.resetHistograms();
+                    frameNumber = 0;
+                    benchmarkStart = glfwGetTime();
+                }
+            } else if (frameNumber == benchmark.warmupFrames + benchmark.frames && !inputPlayback) {
+                mainScene->profiler.finishGpuFrames();
+                writeBenchmarkResults(benchmark, glfwGetTime() - benchmarkStart);
+                glfwSetWindowShouldClose(window, GL_TRUE);
+            }
+        }
 
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
+    // Release GL resources while the context still exists:
+    NUGL::Texture::pixelBufferRing().reset();
+
     // Clean up GLFW:
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -50,24 +51,24 @@ namespace scene {
 
     class LightCamera : public Camera {
     public:
-        static inline std::shared_ptr<LightCamera> fromLight(scene::Light &light, int frameSize) {
-            auto camera = std::make_shared<LightCamera>();
-            camera->pos = light.pos;
-            camera->dir = light.dir;
-            camera->up = {0, 0, 1};
-            if (std::abs(glm::dot(camera->dir, camera->up)) > 0.9) {
-                camera->up = {0, 1, 0};
+        static inline LightCamera fromLight(const scene::Light &light, int frameSize) {
+            LightCamera camera;
+            camera.pos = light.pos;
+            camera.dir = light.dir;
+            camera.up = {0, 0, 1};
+            if (std::abs(glm::dot(camera.dir, camera.up)) > 0.9) {
+                camera.up = {0, 1, 0};
             }
-            camera->fov = light.angleConeOuter;
-            camera->frameWidth = frameSize;
-            camera->frameHeight = frameSize;
+            camera.fov = light.angleConeOuter;
+            camera.frameWidth = frameSize;
+            camera.frameHeight = frameSize;
 
             if (light.type == Light::Type::directional) {
-                camera->useOrtho = true;
-                camera->orthoWidth = light.orthoSize;
+                camera.useOrtho = true;
+                camera.orthoWidth = light.orthoSize;
             }
 
-            camera->prepareTransforms();
+            camera.prepareTransforms();
 
             return camera;
         }
@@ -75,20 +76,55 @@ namespace scene {
         std::shared_ptr<NUGL::Texture> shadowMap;
     };
 
+    //! The state of the controls that move a PlayerCamera, sampled once per frame (so that it can be recorded).
+    struct PlayerInput {
+        enum Keys : uint16_t {
+            forward = 1 << 0,
+            back = 1 << 1,
+            right = 1 << 2,
+            left = 1 << 3,
+            fast = 1 << 4,
+            slow = 1 << 5,
+        };
+
+        uint16_t keys = 0;
+        double cursorX = 0;
+        double cursorY = 0;
+
+        static inline PlayerInput poll(GLFWwindow *window) {
+            PlayerInput input;
+            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+                input.keys |= forward;
+            if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+                input.keys |= back;
+            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+                input.keys |= right;
+            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+                input.keys |= left;
+            if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+                input.keys |= fast;
+            if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
+                input.keys |= slow;
+
+            glfwGetCursorPos(window, &input.cursorX, &input.cursorY);
+            return input;
+        }
+    };
+
     class PlayerCamera : public Camera {
     public:
-        inline void processKeyboardInput(GLFWwindow *window, float deltaTime) {
+        inline void processKeyboardInput(const PlayerInput &input, float deltaTime) {
             glm::vec3 move = {0, 0, 0};
-            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+            if (input.keys & PlayerInput::forward) {
                 move.x += 1;
             }
-            if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+            if (input.keys & PlayerInput::back) {
                 move.x -= 1;
             }
-            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+            if (input.keys & PlayerInput::right) {
                 move.y += 1;
             }
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+            if (input.keys & PlayerInput::left) {
                 move.y -= 1;
             }
 
@@ -96,10 +132,10 @@ namespace scene {
                 move = glm::normalize(move);
             }
 
-            if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT))
+            if (input.keys & PlayerInput::fast)
                 move *= 5;
 
-            if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL))
+            if (input.keys & PlayerInput::slow)
                 move *= 0.2;
 
             glm::vec3 right = glm::cross(dir, up);
@@ -107,11 +143,12 @@ namespace scene {
             pos += right * move.y * speed * deltaTime;
         }
 
-        inline void processMouseInput(GLFWwindow *window, float deltaTime) {
-            double xPos, yPos;
-            glfwGetCursorPos(window, &xPos, &yPos);
-            glm::vec2 cursor(xPos, yPos);
-            static glm::vec2 lastCursor = cursor;
+        inline void processMouseInput(const PlayerInput &input) {
+            glm::vec2 cursor(input.cursorX, input.cursorY);
+            if (!hasLastCursor) {
+                lastCursor = cursor;
+                hasLastCursor = true;
+            }
             glm::vec2 deltaMouse = cursor - lastCursor;
             lastCursor = cursor;
 
@@ -126,13 +163,16 @@ namespace scene {
             dir = utility::math::coordinates::sphericalToCartesian(glm::vec3(1, horizontalAngle, verticalAngle));
         }
 
-        inline void processPlayerInput(GLFWwindow *window) {
-            float currentTime = glfwGetTime();
+        //! Returns the time since the last update, and starts the next timestep.
+        inline float updateClock(double currentTime) {
             float deltaTime = float(currentTime - lastUpdateTime);
             lastUpdateTime = currentTime;
+            return deltaTime;
+        }
 
-            processKeyboardInput(window, deltaTime);
-            processMouseInput(window, deltaTime);
+        inline void processPlayerInput(const PlayerInput &input, float deltaTime) {
+            processKeyboardInput(input, deltaTime);
+            processMouseInput(input);
 
             lookAt(pos + dir);
         }
@@ -150,6 +190,10 @@ namespace scene {
         float speed = 10;
         float lookSpeed = 0.005;
         float lastUpdateTime = 0;
+
+    private:
+        glm::vec2 lastCursor;
+        bool hasLastCursor = false;
     };
 
 }
@@ -0,0 +1,76 @@
+#include "scene/CameraPath.h"
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace scene {
+
+static glm::vec3 catmullRom(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float t) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * t
+            + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+            + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void CameraPath::addKeyframe(double time, glm::vec3 pos, glm::vec3 target) {
+    if (!keyframes.empty() && time <= keyframes.back().time) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Keyframe times must increase (time == " << time << ", previous == " << keyframes.back().time << ").";
+        throw std::invalid_argument(errMsg.str());
+    }
+
+    keyframes.push_back({time, pos, target});
+}
+
+double CameraPath::duration() const {
+    return keyframes.empty() ? 0 : keyframes.back().time - keyframes.front().time;
+}
+
+void CameraPath::apply(Camera &camera, double time) const {
+    if (keyframes.empty())
+        return;
+
+    int count = int(keyframes.size());
+    double start = keyframes.front().time;
+
+    if (loop && duration() > 0) {
+        time = start + std::fmod(time - start, duration());
+        if (time < start)
+            time += duration();
+    }
+
+    // Find the segment [k1, k2] containing the time:
+    int k1 = 0;
+    while (k1 < count - 1 && keyframes[k1 + 1].time <= time)
+        k1++;
+    int k2 = std::min(k1 + 1, count - 1);
+
+    // The neighbouring keyframes shape the spline (clamped at the ends, or wrapped when looping, in which case
+    // the last keyframe is the same point as the first):
+    auto keyframe = [&](int k) -> const Keyframe& {
+        if (loop && count > 1)
+            return keyframes[((k % (count - 1)) + (count - 1)) % (count - 1)];
+        return keyframes[std::min(std::max(k, 0), count - 1)];
+    };
+    const Keyframe &a = keyframe(k1 - 1);
+    const Keyframe &b = keyframes[k1];
+    const Keyframe &c = keyframes[k2];
+    const Keyframe &d = keyframe(k2 + 1);
+
+    float t = 0;
+    if (k2 != k1)
+        t = float(glm::clamp((time - b.time) / (c.time - b.time), 0.0, 1.0));
+
+    glm::vec3 pos = catmullRom(a.pos, b.pos, c.pos, d.pos, t);
+    glm::vec3 target = catmullRom(a.target, b.target, c.target, d.target, t);
+
+    camera.pos = pos;
+    camera.dir = glm::normalize(target - pos);
+    camera.prepareTransforms();
+}
+
+}
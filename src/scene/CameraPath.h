@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "scene/Camera.h"
+
+namespace scene {
+    /**
+     * A scripted camera path through a sequence of keyframes, used to replay identical frames in benchmarks.
+     *
+     * Positions and look-at targets are interpolated with Catmull-Rom splines, so the camera moves smoothly
+     * through every keyframe.
+     */
+    class CameraPath {
+    public:
+        struct Keyframe {
+            double time;
+            glm::vec3 pos;
+            glm::vec3 target;
+        };
+
+        //! Appends a keyframe. Keyframes must be added in order of increasing time.
+        void addKeyframe(double time, glm::vec3 pos, glm::vec3 target);
+
+        double duration() const;
+
+        //! Moves the camera to its position on the path at the given time.
+        void apply(Camera &camera, double time) const;
+
+        std::vector<Keyframe> keyframes;
+        bool loop = true; //!< Repeat the path after its last keyframe, which should then match the first.
+    };
+}
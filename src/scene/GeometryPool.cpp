@@ -0,0 +1,82 @@
+#include "scene/GeometryPool.h"
+#include <algorithm>
+
+#include "utility/make_unique.h"
+#include "utility/debug.h"
+
+namespace scene {
+
+GeometryBuffer::GeometryBuffer(VertexFormat format)
+        : format(format), vertexBuffer(std::make_unique<NUGL::Buffer>()), positionBuffer(std::make_unique<NUGL::Buffer>()),
+          elementBuffer(std::make_unique<NUGL::Buffer>()) {
+}
+
+GeometryRange GeometryBuffer::append(const std::vector<GLubyte>& vertexData, const std::vector<GLubyte>& positionData,
+        const std::vector<GLubyte>& indexData) {
+    GLsizei vertexSize = format.vertexSize();
+    GLsizei indexSize = NUGL::getSizeOfOpenGlType(format.indexType);
+
+    reserve(vertexBuffer, vertexBytes, vertexCapacity, vertexBytes + vertexData.size());
+    reserve(positionBuffer, positionBytes, positionCapacity, positionBytes + positionData.size());
+    reserve(elementBuffer, indexBytes, indexCapacity, indexBytes + indexData.size());
+
+    // Upload through the copy target, as binding GL_ELEMENT_ARRAY_BUFFER would modify the bound vertex array.
+    vertexBuffer->bind(GL_COPY_WRITE_BUFFER);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexBytes, vertexData.size(), vertexData.data());
+    positionBuffer->bind(GL_COPY_WRITE_BUFFER);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, positionBytes, positionData.size(), positionData.data());
+    elementBuffer->bind(GL_COPY_WRITE_BUFFER);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes, indexData.size(), indexData.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    checkForAndPrintGLError(__FILE__, __LINE__);
+
+    GeometryRange range;
+    range.indexCount = GLsizei(indexData.size() / indexSize);
+    range.indexOffset = indexBytes;
+    range.baseVertex = GLint(vertexBytes / vertexSize);
+
+    vertexBytes += vertexData.size();
+    positionBytes += positionData.size();
+    indexBytes += indexData.size();
+
+    return range;
+}
+
+void GeometryBuffer::reserve(std::unique_ptr<NUGL::Buffer>& buffer, GLsizeiptr used, GLsizeiptr& capacity, GLsizeiptr required) {
+    if (required <= capacity)
+        return;
+
+    GLsizeiptr newCapacity = std::max(std::max(capacity * 2, required), GLsizeiptr(1024 * 1024));
+
+    auto newBuffer = std::make_unique<NUGL::Buffer>();
+    newBuffer->bind(GL_COPY_WRITE_BUFFER);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, GL_STATIC_DRAW);
+
+    if (used > 0) {
+        buffer->bind(GL_COPY_READ_BUFFER);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    checkForAndPrintGLError(__FILE__, __LINE__);
+
+    buffer = std::move(newBuffer);
+    capacity = newCapacity;
+
+    // The vertex arrays still reference the old buffer.
+    vertexArray = nullptr;
+    positionVertexArray = nullptr;
+}
+
+GeometryBuffer& GeometryPool::bufferForFormat(const VertexFormat& format) {
+    for (auto& buffer : buffers) {
+        if (buffer->format == format)
+            return *buffer;
+    }
+
+    buffers.push_back(std::make_unique<GeometryBuffer>(format));
+    return *buffers.back();
+}
+
+}
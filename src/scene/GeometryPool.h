@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "NUGL/Buffer.h"
+#include "NUGL/VertexArray.h"
+#include "NUGL/ShaderProgram.h"
+#include "scene/Mesh.h"
+
+namespace scene {
+    /**
+     * Shared vertex and index buffers holding the meshes of one vertex format.
+     *
+     * Meshes are appended to the end of the buffers, and address their data as a GeometryRange. All meshes in a
+     * GeometryBuffer share its vertex array, so they can be drawn together with glMultiDrawElementsBaseVertex.
+     */
+    class GeometryBuffer {
+    public:
+        GeometryBuffer(VertexFormat format);
+
+        GeometryBuffer(const GeometryBuffer&) = delete;
+        GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
+        //! Copies the vertex, position, and index data of a mesh into the buffers, growing them if required.
+        GeometryRange append(const std::vector<GLubyte>& vertexData, const std::vector<GLubyte>& positionData,
+                const std::vector<GLubyte>& indexData);
+
+        VertexFormat format;
+
+        std::unique_ptr<NUGL::Buffer> vertexBuffer;
+        std::unique_ptr<NUGL::Buffer> positionBuffer; // The positions alone, at the same vertex indices.
+        std::unique_ptr<NUGL::Buffer> elementBuffer;
+
+        // Shared by every mesh in the buffers, with every program. Invalidated (and recreated on demand) whenever the
+        // buffers grow.
+        std::unique_ptr<NUGL::VertexArray> vertexArray;
+        std::unique_ptr<NUGL::VertexArray> positionVertexArray;
+
+    private:
+        void reserve(std::unique_ptr<NUGL::Buffer>& buffer, GLsizeiptr used, GLsizeiptr& capacity, GLsizeiptr required);
+
+        GLsizeiptr vertexBytes = 0;
+        GLsizeiptr vertexCapacity = 0;
+        GLsizeiptr positionBytes = 0;
+        GLsizeiptr positionCapacity = 0;
+        GLsizeiptr indexBytes = 0;
+        GLsizeiptr indexCapacity = 0;
+    };
+
+    //! Owns one GeometryBuffer for each vertex format used by the static meshes of a scene.
+    class GeometryPool {
+    public:
+        GeometryBuffer& bufferForFormat(const VertexFormat& format);
+
+        std::vector<std::unique_ptr<GeometryBuffer>> buffers;
+    };
+}
@@ -0,0 +1,132 @@
+#include "scene/InputRecording.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace scene {
+
+static const char recordingMagic[4] = {'N', 'U', 'I', 'R'};
+static const uint32_t recordingVersion = 1;
+
+template<typename T>
+static void writeValue(std::ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static T readValue(std::istream &in) {
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+
+InputRecorder::InputRecorder(const std::string &fileName, unsigned seed, glm::ivec2 windowSize)
+        : file(fileName, std::ios::binary) {
+    if (!file) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Could not open input recording '" << fileName << "' for writing.";
+        throw std::runtime_error(errMsg.str());
+    }
+
+    file.write(recordingMagic, sizeof(recordingMagic));
+    writeValue(file, recordingVersion);
+    writeValue(file, uint32_t(seed));
+    writeValue(file, int32_t(windowSize.x));
+    writeValue(file, int32_t(windowSize.y));
+
+    keyPresses.reserve(16);
+
+    std::cout << "Recording input to '" << fileName << "'." << std::endl;
+}
+
+void InputRecorder::keyPressed(int key) {
+    keyPresses.push_back(int16_t(key));
+}
+
+void InputRecorder::endFrame(double time, float deltaTime, const PlayerInput &input, const Camera &camera) {
+    writeValue(file, time);
+    writeValue(file, deltaTime);
+    writeValue(file, input.keys);
+    writeValue(file, uint16_t(keyPresses.size()));
+    writeValue(file, input.cursorX);
+    writeValue(file, input.cursorY);
+    writeValue(file, camera.pos);
+    writeValue(file, camera.dir);
+
+    for (int16_t key : keyPresses) {
+        writeValue(file, key);
+    }
+
+    keyPresses.clear();
+    frames++;
+}
+
+InputPlayback::InputPlayback(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    uint32_t version = readValue<uint32_t>(file);
+
+    if (!file || !std::equal(magic, magic + 4, recordingMagic) || version != recordingVersion) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "'" << fileName << "' is not a version " << recordingVersion << " input recording.";
+        throw std::runtime_error(errMsg.str());
+    }
+
+    seed = readValue<uint32_t>(file);
+    windowSize.x = readValue<int32_t>(file);
+    windowSize.y = readValue<int32_t>(file);
+
+    while (file.peek() != std::char_traits<char>::eof()) {
+        RecordedFrame frame;
+        frame.time = readValue<double>(file);
+        frame.deltaTime = readValue<float>(file);
+        frame.input.keys = readValue<uint16_t>(file);
+        frame.numKeyPresses = readValue<uint16_t>(file);
+        frame.input.cursorX = readValue<double>(file);
+        frame.input.cursorY = readValue<double>(file);
+        frame.cameraPos = readValue<glm::vec3>(file);
+        frame.cameraDir = readValue<glm::vec3>(file);
+
+        frame.firstKeyPress = uint32_t(keyPresses.size());
+        for (uint32_t i = 0; i < frame.numKeyPresses; i++) {
+            keyPresses.push_back(readValue<int16_t>(file));
+        }
+
+        if (!file) {
+            std::cerr << __FILE__ << ", " << __LINE__ << ": '" << fileName << "' ends with a partial frame, which was ignored." << std::endl;
+            break;
+        }
+
+        frames.push_back(frame);
+    }
+
+    if (frames.empty()) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "The input recording '" << fileName << "' has no frames.";
+        throw std::runtime_error(errMsg.str());
+    }
+
+    std::cout << "Replaying " << frames.size() << " frames from '" << fileName << "'." << std::endl;
+}
+
+void InputPlayback::nextFrame(const Camera &camera) {
+    const RecordedFrame &frame = currentFrame();
+
+    // Replays run the same code on the same inputs, so any difference means the replay is not deterministic:
+    const float tolerance = 1e-4f;
+    if (glm::length(camera.pos - frame.cameraPos) > tolerance || glm::length(camera.dir - frame.cameraDir) > tolerance) {
+        if (divergedFrames == 0)
+            std::cerr << "Replay diverged from the recording at frame " << frameIndex << "." << std::endl;
+        divergedFrames++;
+    }
+
+    frameIndex++;
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "scene/Camera.h"
+
+namespace scene {
+    /**
+     * Everything needed to replay one frame of an interactive session: the animation clock, the camera's timestep
+     * and controls, and the keys pressed during the frame.
+     *
+     * The camera's state at the end of the frame is recorded too, so that a replay can detect when it diverges.
+     */
+    struct RecordedFrame {
+        double time;
+        float deltaTime;
+        PlayerInput input;
+        glm::vec3 cameraPos;
+        glm::vec3 cameraDir;
+        uint32_t firstKeyPress; // Index into InputPlayback::keyPresses.
+        uint32_t numKeyPresses;
+    };
+
+    /**
+     * Writes an input recording: a small header (the scene's random seed and the window size) followed by one
+     * compact binary record per frame.
+     *
+     * Values are written in the host's byte order, so recordings are only portable between machines of the same
+     * endianness.
+     */
+    class InputRecorder {
+    public:
+        InputRecorder(const std::string &fileName, unsigned seed, glm::ivec2 windowSize);
+
+        //! Buffers a key press, to be written with the current frame.
+        void keyPressed(int key);
+
+        //! Writes the frame's record. Call it after the camera has been updated.
+        void endFrame(double time, float deltaTime, const PlayerInput &input, const Camera &camera);
+
+        unsigned frameCount() const { return frames; }
+
+    private:
+        std::ofstream file;
+        std::vector<int16_t> keyPresses;
+        unsigned frames = 0;
+    };
+
+    /**
+     * Reads an input recording, and steps through its frames.
+     *
+     * The whole recording is loaded up front, so playback does not touch the disk (or the heap) while frames are
+     * being rendered.
+     */
+    class InputPlayback {
+    public:
+        InputPlayback(const std::string &fileName);
+
+        bool finished() const { return frameIndex >= frames.size(); }
+        const RecordedFrame &currentFrame() const { return frames[frameIndex]; }
+        size_t currentFrameIndex() const { return frameIndex; }
+        size_t frameCount() const { return frames.size(); }
+
+        //! Compares the camera with its recorded state at the end of the current frame, and moves to the next frame.
+        void nextFrame(const Camera &camera);
+
+        unsigned seed;
+        glm::ivec2 windowSize;
+        std::vector<int16_t> keyPresses;
+        unsigned divergedFrames = 0; //!< Frames whose camera state did not match the recording.
+
+    private:
+        std::vector<RecordedFrame> frames;
+        size_t frameIndex = 0;
+    };
+}
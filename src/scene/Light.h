@@ -1,5 +1,8 @@
 #pragma once
 #include <memory>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <glm/glm.hpp>
 
 namespace scene {
@@ -26,6 +29,35 @@ namespace scene {
         float orthoSize = 10;
         bool enabled = true;
 
+        /**
+         * Returns the distance beyond which the light's attenuated diffuse and specular colours fall below the given
+         * threshold, so that it can be ignored for surfaces further away.
+         *
+         * Lights that are not attenuated with distance (directional lights, and the ambient term, which the shaders
+         * do not attenuate) have an infinite radius.
+         */
+        inline float influenceRadius(float threshold = 1.0f / 256) const {
+            const float infinity = std::numeric_limits<float>::infinity();
+            if (type == Type::directional || std::max(colAmbient.x, std::max(colAmbient.y, colAmbient.z)) > 0)
+                return infinity;
+
+            // Solve peak / (constant + linear*d + quadratic*d^2) = threshold for d:
+            float peak = std::max(std::max(colDiffuse.x, std::max(colDiffuse.y, colDiffuse.z)),
+                                  std::max(colSpecular.x, std::max(colSpecular.y, colSpecular.z)));
+            float target = peak / threshold - attenuationConstant;
+            if (target <= 0)
+                return 0;
+
+            if (attenuationQuadratic > 0) {
+                float b = attenuationLinear;
+                return (-b + std::sqrt(b * b + 4 * attenuationQuadratic * target)) / (2 * attenuationQuadratic);
+            }
+            if (attenuationLinear > 0)
+                return target / attenuationLinear;
+
+            return infinity;
+        }
+
         static std::shared_ptr<Light> makeSpotlight(
                 glm::vec3 pos = glm::vec3(0, 0, 0),
                 glm::vec3 dir = glm::vec3(0, 0, -1),
@@ -48,6 +80,22 @@ namespace scene {
             return light;
         }
 
+        static std::shared_ptr<Light> makePoint(
+                glm::vec3 pos = glm::vec3(0, 0, 0),
+                glm::vec3 colDiffuse = glm::vec3(1000),
+                glm::vec3 colSpecular = glm::vec3(1000),
+                glm::vec3 colAmbient = glm::vec3(0)) {
+            auto light = std::make_shared<Light>();
+
+            light->type = scene::Light::Type::point;
+            light->pos = pos;
+            light->colDiffuse = colDiffuse;
+            light->colSpecular = colSpecular;
+            light->colAmbient = colAmbient;
+
+            return light;
+        }
+
         static std::shared_ptr<Light> makeDirectional(
                 glm::vec3 pos = glm::vec3(0, 0, 0),
                 glm::vec3 dir = glm::vec3(0, 0, -1),
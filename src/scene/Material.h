@@ -1,12 +1,21 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <glm/glm.hpp>
 
 #include "NUGL/Texture.h"
 #include "NUGL/ShaderProgram.h"
 
 namespace scene {
+    //! A texture image referenced by a material, loaded once a GL context is available (see Model::loadTextures).
+    struct TextureSource {
+        std::string fileName; // Empty if the material has no such texture.
+        GLenum unit = GL_TEXTURE0;
+        GLint wrapS = GL_REPEAT;
+        GLint wrapT = GL_REPEAT;
+    };
+
     struct Material {
         // Colours.
         glm::vec3 colAmbient = {0.7, 0, 0.9};
@@ -34,6 +43,9 @@ namespace scene {
         std::shared_ptr<NUGL::Texture> texHeight;
         std::shared_ptr<NUGL::Texture> texEnvironmentMap;
 
+        TextureSource texDiffuseSource;
+        TextureSource texHeightSource;
+
         // Summarises the types of data this material offers.
         NUGL::MaterialInfo materialInfo;
     };
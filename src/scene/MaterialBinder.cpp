@@ -0,0 +1,109 @@
+#include "scene/MaterialBinder.h"
+#include <iostream>
+#include <memory>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "utility/debug.h"
+
+namespace scene {
+
+template <typename T>
+struct Uploader;
+
+template <>
+struct Uploader<glm::vec3> {
+    static void upload(GLint location, const void *value) {
+        glUniform3fv(location, 1, glm::value_ptr(*static_cast<const glm::vec3 *>(value)));
+    }
+};
+
+template <>
+struct Uploader<float> {
+    static void upload(GLint location, const void *value) {
+        glUniform1f(location, *static_cast<const float *>(value));
+    }
+};
+
+template <>
+struct Uploader<std::shared_ptr<NUGL::Texture>> {
+    static void upload(GLint location, const void *value) {
+        auto &texture = *static_cast<const std::shared_ptr<NUGL::Texture> *>(value);
+        texture->bind();
+        glUniform1i(location, texture->unit() - GL_TEXTURE0);
+    }
+};
+
+template <typename T, T Material::*member>
+static const void *field(const Material &material) {
+    return &(material.*member);
+}
+
+enum class ParamKind {
+    value,
+    valueOrZero, // Uploads 0 to programs that use the parameter when the material does not have it.
+    texture, // Skipped (with a warning) if the material's texture is null.
+};
+
+struct MaterialParam {
+    bool (*has)(const NUGL::MaterialInfo &info);
+    const char *name;
+    void (*upload)(GLint location, const void *value);
+    const void *(*value)(const Material &material);
+    ParamKind kind;
+};
+
+#define MATERIAL_PARAM(type, member, kind) { \
+        [](const NUGL::MaterialInfo &info) -> bool { return info.has.member; }, \
+        #member, &Uploader<type>::upload, &field<type, &Material::member>, kind }
+
+// The uniforms that materials can set, named after their MaterialInfo bits:
+static const MaterialParam materialParams[] = {
+    MATERIAL_PARAM(glm::vec3, colAmbient, ParamKind::value),
+    MATERIAL_PARAM(glm::vec3, colDiffuse, ParamKind::value),
+    MATERIAL_PARAM(glm::vec3, colSpecular, ParamKind::value),
+    MATERIAL_PARAM(glm::vec3, colTransparent, ParamKind::value),
+    MATERIAL_PARAM(float, opacity, ParamKind::value),
+    MATERIAL_PARAM(float, shininess, ParamKind::value),
+    MATERIAL_PARAM(float, reflectivity, ParamKind::valueOrZero),
+    MATERIAL_PARAM(float, emissive, ParamKind::valueOrZero),
+    MATERIAL_PARAM(float, shininessStrength, ParamKind::value),
+    MATERIAL_PARAM(std::shared_ptr<NUGL::Texture>, texEnvironmentMap, ParamKind::texture),
+    MATERIAL_PARAM(std::shared_ptr<NUGL::Texture>, texDiffuse, ParamKind::texture),
+    MATERIAL_PARAM(std::shared_ptr<NUGL::Texture>, texHeight, ParamKind::texture),
+};
+
+#undef MATERIAL_PARAM
+
+static const float zero = 0;
+
+MaterialBinder::MaterialBinder(const Material &material, NUGL::ShaderProgram &program) {
+    program.finishLink();
+
+    for (const auto &param : materialParams) {
+        if (!param.has(program.materialInfo))
+            continue;
+
+        const void *value = param.value(material);
+        if (!param.has(material.materialInfo)) {
+            if (param.kind != ParamKind::valueOrZero)
+                continue;
+            value = &zero;
+        } else if (param.kind == ParamKind::texture && *static_cast<const std::shared_ptr<NUGL::Texture> *>(value) == nullptr) {
+            std::cerr << "WARNING: material->materialInfo.has." << param.name << " was true, but "
+                    << param.name << " was null.";
+            continue;
+        }
+
+        uploads.push_back({param.upload, program.getUniformLocation(param.name), value});
+    }
+}
+
+void MaterialBinder::bind() const {
+    for (const auto &upload : uploads) {
+        upload.upload(upload.location, upload.value);
+    }
+    checkForAndPrintGLError(__FILE__, __LINE__);
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "NUGL/ShaderProgram.h"
+#include "scene/Material.h"
+
+namespace scene {
+    /**
+     * The uniform uploads that bind a material to a program, recorded once for the pair.
+     *
+     * Recording tests each of the material's MaterialInfo bits against the program's, and looks up the uniform
+     * locations; bind() then uploads exactly the parameters they share, without testing any bits.
+     *
+     * Values are read from the material when bound, so changing them does not require a new binder, but changing
+     * the material's MaterialInfo or textures does (see Mesh::invalidateMaterialBinders).
+     */
+    class MaterialBinder {
+    public:
+        MaterialBinder(const Material &material, NUGL::ShaderProgram &program);
+
+        //! Uploads the material's parameters to the program, which must be in use.
+        void bind() const;
+
+    private:
+        typedef void (*UploadFunction)(GLint location, const void *value);
+
+        struct Upload {
+            UploadFunction upload;
+            GLint location;
+            const void *value;
+        };
+
+        std::vector<Upload> uploads;
+    };
+}
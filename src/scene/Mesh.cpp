@@ -1,6 +1,10 @@
 #include "scene/Mesh.h"
 #include <iostream>
 #include <memory>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -8,177 +12,272 @@
 #include "NUGL/ShaderProgram.h"
 #include "utility/make_unique.h"
 #include "utility/debug.h"
+#include "utility/AllocationCounter.h"
 #include "utility/AssimpDebug.h"
 #include "scene/Camera.h"
+#include "scene/GeometryPool.h"
 
 namespace scene {
 
 void Mesh::draw(std::shared_ptr<NUGL::ShaderProgram> program) {
+    program = program->variant(shaderFeatures());
+    if (!program->isLinkComplete())
+        return; // Skipped until the driver has compiled the variant.
     program->use();
     prepareMaterialShaderProgram(program);
+    bindVertexArray(program->readsPositionOnly());
 
-    if (!vertexArrayMap.count(*program)) {
-        prepareVertexArrayForShaderProgram(program);
+    glDrawElementsBaseVertex(GL_TRIANGLES, geometryRange.indexCount, vertexFormat.indexType,
+            (const GLvoid *) geometryRange.indexOffset, geometryRange.baseVertex);
+    checkForAndPrintGLError(__FILE__, __LINE__);
+}
+
+void Mesh::bindVertexArray(bool positionOnly) {
+    NUGL::VertexArray *array;
+    if (geometryBuffer != nullptr)
+        array = (positionOnly ? geometryBuffer->positionVertexArray : geometryBuffer->vertexArray).get();
+    else
+        array = (positionOnly ? positionVertexArray : vertexArray).get();
+
+    if (array == nullptr) {
+        utility::ScopedAllowAllocations allow;
+        array = prepareVertexArray(positionOnly);
     }
 
-    if (!vertexArrayMap.count(*program)) {
-        std::stringstream errMsg;
-        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
-                << "Mesh has no vertex array for shader program: '" << program->name() << "'"
-                << ".";
-        throw std::runtime_error(errMsg.str().c_str());
+    array->bind();
+}
+
+struct AttributePointerOp {
+    NUGL::VertexArray &vertexArray;
+    NUGL::Buffer &vertices;
+
+    template <typename V>
+    void apply() {
+        vertexArray.setAttributePointers<V>(vertices, GL_ARRAY_BUFFER);
+    }
+};
+
+NUGL::VertexArray *Mesh::prepareVertexArray(bool positionOnly) {
+    NUGL::Buffer *vertices = (positionOnly ? positionBuffer : vertexBuffer).get();
+    NUGL::Buffer *indices = elementBuffer.get();
+    auto *array = positionOnly ? &positionVertexArray : &vertexArray;
+    if (geometryBuffer != nullptr) {
+        vertices = (positionOnly ? geometryBuffer->positionBuffer : geometryBuffer->vertexBuffer).get();
+        indices = geometryBuffer->elementBuffer.get();
+        array = positionOnly ? &geometryBuffer->positionVertexArray : &geometryBuffer->vertexArray;
     }
 
-    if (vertexBuffer == nullptr) {
+    if (vertices == nullptr || indices == nullptr) {
         std::stringstream errMsg;
         errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
                 << "Mesh has a null vertexBuffer.";
         throw std::runtime_error(errMsg.str().c_str());
     }
 
-    vertexArrayMap[*program]->bind();
-    vertexBuffer->bind(GL_ARRAY_BUFFER);
-    elementBuffer->bind(GL_ELEMENT_ARRAY_BUFFER);
-    glDrawElements(GL_TRIANGLES, elements.size(), GL_UNSIGNED_INT, 0);
-    checkForAndPrintGLError(__FILE__, __LINE__);
+    // Shared vertex arrays may already have been prepared by another mesh in the same buffer.
+    if (*array != nullptr)
+        return array->get();
+
+    *array = std::make_unique<NUGL::VertexArray>();
+    AttributePointerOp op = {**array, *vertices};
+    if (positionOnly)
+        vertexFormat.positionFormat().dispatch(op);
+    else
+        vertexFormat.dispatch(op);
+    indices->bind(GL_ELEMENT_ARRAY_BUFFER);
+
+    return array->get();
 }
 
-void Mesh::prepareVertexArrayForShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program) {
-    if (vertexBuffer == nullptr) {
-        std::stringstream errMsg;
-        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
-                << "Mesh has a null vertexBuffer.";
-        throw std::runtime_error(errMsg.str().c_str());
+uint32_t Mesh::shaderFeatures() {
+    uint32_t features = 0;
+    if (material->materialInfo.has.texDiffuse && material->texDiffuse != nullptr)
+        features |= NUGL::ShaderFeatures::texDiffuse;
+    if (material->materialInfo.has.texHeight && material->texHeight != nullptr)
+        features |= NUGL::ShaderFeatures::texHeight;
+    if (material->materialInfo.has.texEnvironmentMap && material->texEnvironmentMap != nullptr)
+        features |= NUGL::ShaderFeatures::texEnvironmentMap;
+    return features;
+}
+
+void Mesh::prepareMaterialShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program) {
+    auto binder = materialBinders.find(program->id());
+    if (binder == materialBinders.end()) {
+        utility::ScopedAllowAllocations allow;
+        binder = materialBinders.emplace(program->id(), MaterialBinder(*material, *program)).first;
     }
 
-    std::vector<NUGL::VertexAttribute> attribs = {
-            {"position", 3, GL_FLOAT, GL_FALSE, !program->attributeIsActive("position")},
-    };
+    binder->second.bind();
+}
+
+void Mesh::invalidateMaterialBinders() {
+    materialBinders.clear();
+}
 
-    if (hasNormals()) {
-        attribs.push_back({"normal", 3, GL_FLOAT, GL_FALSE, !program->attributeIsActive("normal")});
+VertexFormat Mesh::compactVertexFormat() {
+    VertexFormat format;
+    format.positionType = GL_SHORT;
+    format.normalType = GL_INT_2_10_10_10_REV;
+
+    // Half floats only have 10 mantissa bits, so keep full precision for texture coordinates that tile far
+    // outside the unit square.
+    format.texCoordType = GL_HALF_FLOAT;
+    for (auto &texCoord : texCoords) {
+        if (std::abs(texCoord.x) > 2 || std::abs(texCoord.y) > 2) {
+            format.texCoordType = GL_FLOAT;
+            break;
+        }
     }
 
-    if (isTextured()) {
-        attribs.push_back({"texcoord", 2, GL_FLOAT, GL_FALSE, !program->attributeIsActive("texcoord")});
+    if (vertices.size() <= std::numeric_limits<GLushort>::max() + size_t(1)) {
+        format.indexType = GL_UNSIGNED_SHORT;
     }
 
-    program->use();
+    return format;
+}
 
-    auto vertexArray = std::make_unique<NUGL::VertexArray>();
-    vertexArray->bind();
-    vertexArray->setAttributePointers(*program, *vertexBuffer, GL_ARRAY_BUFFER, attribs);
+void Mesh::setQuantizationBounds(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+    // Use a uniform scale, so that the decode transform doesn't skew normals.
+    glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+    float scale = std::max(halfExtent.x, std::max(halfExtent.y, halfExtent.z));
 
-    vertexArrayMap[*program] = move(vertexArray);
+    positionOffset = (boundsMin + boundsMax) * 0.5f;
+    positionScale = (scale > 0) ? scale : 1;
 }
 
-void Mesh::prepareMaterialShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program) {
-    if (material->materialInfo.has.colAmbient && program->materialInfo.has.colAmbient) {
-        program->setUniform("colAmbient", material->colAmbient);
-    }
+glm::mat4 Mesh::positionDecodeTransform() {
+    if (vertexFormat.positionType == GL_FLOAT)
+        return glm::mat4();
 
-    if (material->materialInfo.has.colDiffuse && program->materialInfo.has.colDiffuse) {
-        program->setUniform("colDiffuse", material->colDiffuse);
-    }
+    glm::mat4 decode;
+    decode = glm::translate(decode, positionOffset);
+    decode = glm::scale(decode, glm::vec3(positionScale));
+    return decode;
+}
 
-    if (material->materialInfo.has.colSpecular && program->materialInfo.has.colSpecular) {
-        program->setUniform("colSpecular", material->colSpecular);
-    }
+// Converts a float to an IEEE 754 half-precision float, rounding to nearest.
+static GLhalf floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
 
-    if (material->materialInfo.has.colTransparent && program->materialInfo.has.colTransparent) {
-        program->setUniform("colTransparent", material->colTransparent);
-    }
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = int32_t((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
 
-    if (material->materialInfo.has.opacity && program->materialInfo.has.opacity) {
-        program->setUniform("opacity", material->opacity);
+    if (exponent >= 31) {
+        return GLhalf(sign | 0x7C00); // Overflow to infinity.
     }
 
-    if (material->materialInfo.has.shininess && program->materialInfo.has.shininess) {
-        program->setUniform("shininess", material->shininess);
-    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return GLhalf(sign); // Underflow to zero.
+        }
 
-    if (material->materialInfo.has.reflectivity && program->materialInfo.has.reflectivity) {
-        program->setUniform("reflectivity", material->reflectivity);
-    } else {
-        program->setUniformIfActive("reflectivity", 0.0f);
+        // Denormalised half:
+        mantissa |= 0x800000;
+        uint32_t shift = uint32_t(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+        return GLhalf(sign | half);
     }
 
-    if (material->materialInfo.has.emissive && program->materialInfo.has.emissive) {
-        program->setUniform("emissive", material->emissive);
-    } else {
-        program->setUniformIfActive("emissive", 0.0f);
-    }
+    uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++; // A carry out of the mantissa correctly increments the exponent.
+    return GLhalf(half);
+}
 
-    if (material->materialInfo.has.shininessStrength && program->materialInfo.has.shininessStrength) {
-        program->setUniform("shininessStrength", material->shininessStrength);
-    }
+// Packs a unit vector into the signed normalized GL_INT_2_10_10_10_REV format.
+static GLuint packNormal(glm::vec3 normal) {
+    auto pack = [](float value) -> GLuint {
+        float clamped = std::max(-1.0f, std::min(1.0f, value));
+        GLint quantized = GLint(std::round(clamped * 511.0f));
+        return GLuint(quantized) & 0x3FF;
+    };
 
-//    if (material->materialInfo.has.reserved_value && program->materialInfo.has.reserved_value) {
-//        program->setUniform("reserved_value", material->reserved_value);
-//    }
+    return pack(normal.x) | (pack(normal.y) << 10) | (pack(normal.z) << 20);
+}
 
+static GLshort quantizeSnorm16(float value) {
+    float clamped = std::max(-1.0f, std::min(1.0f, value));
+    return GLshort(std::round(clamped * 32767.0f));
+}
 
-    program->setUniformIfActive("hasTexEnvironmentMap", false);
-    if (material->materialInfo.has.texEnvironmentMap && program->materialInfo.has.texEnvironmentMap) {
-        if (material->texEnvironmentMap != nullptr) {
-            material->texEnvironmentMap->bind();
-            program->setUniform("texEnvironmentMap", material->texEnvironmentMap);
-            program->setUniformIfActive("hasTexEnvironmentMap", true);
-        } else {
-            std::cerr << "WARNING: material->materialInfo.has.texEnvironmentMap was true, but texEnvironmentMap was null.";
-        }
-    }
+template<typename T>
+static void appendBytes(std::vector<GLubyte> &data, const T &value) {
+    auto bytes = reinterpret_cast<const GLubyte *>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
 
-    program->setUniformIfActive("hasTexDiffuse", false);
-    if (material->materialInfo.has.texDiffuse && program->materialInfo.has.texDiffuse) {
-        if (material->texDiffuse != nullptr) {
-            material->texDiffuse->bind();
-            program->setUniform("texDiffuse", material->texDiffuse);
-            program->setUniformIfActive("hasTexDiffuse", true);
-        } else {
-            std::cerr << "WARNING: material->materialInfo.has.texDiffuse was true, but texDiffuse was null.";
-        }
-    }
+static void encode(NUGL::Float3 &out, glm::vec3 value) {
+    out = {value.x, value.y, value.z};
+}
 
-    program->setUniformIfActive("hasTexHeight", false);
-    if (material->materialInfo.has.texHeight && program->materialInfo.has.texHeight) {
-        if (material->texHeight != nullptr) {
-            material->texHeight->bind();
-            program->setUniform("texHeight", material->texHeight);
-            program->setUniform("hasTexHeight", true);
-        } else {
-            std::cerr << "WARNING: material->materialInfo.has.texHeight was true, but texHeight was null.";
-        }
-    }
+static void encode(NUGL::Snorm16x3 &out, glm::vec3 value) {
+    out = {quantizeSnorm16(value.x), quantizeSnorm16(value.y), quantizeSnorm16(value.z), 0};
+}
 
-//    if (material->materialInfo.has.texSpecular && program->materialInfo.has.texSpecular) {
-//        material->texSpecular->bind();
-//        program->setUniform("texSpecular", material->texSpecular);
-//    }
-//
-//    if (material->materialInfo.has.texAmbient && program->materialInfo.has.texAmbient) {
-//        material->texAmbient->bind();
-//        program->setUniform("texAmbient", material->texAmbient);
-//    }
-//
-//    if (material->materialInfo.has.texNormals && program->materialInfo.has.texNormals) {
-//        material->texNormals->bind();
-//        program->setUniform("texNormals", material->texNormals);
-//    }
-//
-//    if (material->materialInfo.has.texShininess && program->materialInfo.has.texShininess) {
-//        material->texShininess->bind();
-//        program->setUniform("texShininess", material->texShininess);
-//    }
-//
-//    if (material->materialInfo.has.texOpacity && program->materialInfo.has.texOpacity) {
-//        material->texOpacity->bind();
-//        program->setUniform("texOpacity", material->texOpacity);
-//    }
+static void encode(NUGL::Half3 &out, glm::vec3 value) {
+    out = {floatToHalf(value.x), floatToHalf(value.y), floatToHalf(value.z), 0};
 }
 
-void Mesh::generateBuffers(bool forceTexcoords) {
-    // Verify element buffer correctness:
+static void encode(NUGL::Int2101010 &out, glm::vec3 value) {
+    out.bits = packNormal(value);
+}
+
+static void encode(NUGL::Float2 &out, glm::vec2 value) {
+    out = {value.x, value.y};
+}
+
+static void encode(NUGL::Half2 &out, glm::vec2 value) {
+    out = {floatToHalf(value.x), floatToHalf(value.y)};
+}
+
+// Vertex types without normals or texture coordinates ignore them:
+template <typename Position, typename Normal, typename TexCoord>
+static void encodeNormal(NUGL::Vertex<Position, Normal, TexCoord> &vertex, const std::vector<glm::vec3> &normals, size_t i) {
+    encode(vertex.normal, normals[i]);
+}
+
+template <typename Position, typename TexCoord>
+static void encodeNormal(NUGL::Vertex<Position, NUGL::NoAttribute, TexCoord> &, const std::vector<glm::vec3> &, size_t) {
+}
+
+template <typename Position, typename Normal, typename TexCoord>
+static void encodeTexCoord(NUGL::Vertex<Position, Normal, TexCoord> &vertex, const std::vector<glm::vec2> &texCoords, size_t i) {
+    encode(vertex.texcoord, texCoords[i]);
+}
+
+template <typename Position, typename Normal>
+static void encodeTexCoord(NUGL::Vertex<Position, Normal, NUGL::NoAttribute> &, const std::vector<glm::vec2> &, size_t) {
+}
+
+//! Writes the mesh's vertices as structs of the vertex type of its format, and their positions alone.
+struct VertexWriteOp {
+    Mesh &mesh;
+    std::vector<GLubyte> &data;
+    std::vector<GLubyte> &positionData;
+
+    template <typename V>
+    void apply() {
+        typedef decltype(V::position) Position;
+        static_assert(sizeof(NUGL::Vertex<Position>) == sizeof(Position), "Position-only vertices must be packed.");
+
+        data.resize(mesh.vertices.size() * sizeof(V));
+        positionData.resize(mesh.vertices.size() * sizeof(Position));
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            V vertex;
+            encode(vertex.position, (mesh.vertices[i] - mesh.positionOffset) / mesh.positionScale);
+            encodeNormal(vertex, mesh.normals, i);
+            encodeTexCoord(vertex, mesh.texCoords, i);
+            std::memcpy(data.data() + i * sizeof(V), &vertex, sizeof(V));
+            std::memcpy(positionData.data() + i * sizeof(Position), &vertex.position, sizeof(Position));
+        }
+    }
+};
+
+void Mesh::validateElements() {
     for (unsigned int e : elements) {
         if (e >= vertices.size()) {
             std::stringstream errMsg;
@@ -188,35 +287,75 @@ void Mesh::generateBuffers(bool forceTexcoords) {
             throw std::runtime_error(errMsg.str().c_str());
         }
     }
+}
 
-    std::vector<GLfloat> vertexBufferData;
-    for (unsigned int i = 0; i < vertices.size(); i++) {
-        auto &vertex = vertices[i];
-        vertexBufferData.push_back(vertex.x);
-        vertexBufferData.push_back(vertex.y);
-        vertexBufferData.push_back(vertex.z);
-
-        if (hasNormals()) {
-            auto &normal = normals[i];
-            vertexBufferData.push_back(normal.x);
-            vertexBufferData.push_back(normal.y);
-            vertexBufferData.push_back(normal.z);
-        }
+void Mesh::buildBufferData(std::vector<GLubyte> &vertexBufferData, std::vector<GLubyte> &positionData,
+        std::vector<GLubyte> &indexData, bool forceTexcoords) {
+    // Verify element buffer correctness:
+    validateElements();
+
+    if (vertexFormat.indexType == GL_UNSIGNED_SHORT && vertices.size() > std::numeric_limits<GLushort>::max() + size_t(1)) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Mesh has too many vertices for 16-bit indices (" << vertices.size() << " vertices).";
+        throw std::runtime_error(errMsg.str().c_str());
+    }
+
+    vertexFormat.hasNormals = hasNormals();
+    vertexFormat.hasTexCoords = isTextured() || forceTexcoords;
+
+    if (vertexFormat.positionType == GL_FLOAT) {
+        positionOffset = {0, 0, 0};
+        positionScale = 1;
+    }
 
-        if (isTextured() || forceTexcoords) {
-            auto &texCoord = texCoords[i];
-//                vertexBufferData.push_back(1 - texCoord.x);
-//                vertexBufferData.push_back(1 - texCoord.y);
-            vertexBufferData.push_back(texCoord.x);
-            vertexBufferData.push_back(texCoord.y);
+    VertexWriteOp op = {*this, vertexBufferData, positionData};
+    vertexFormat.dispatch(op);
+
+    indexData.clear();
+    for (GLint e : elements) {
+        if (vertexFormat.indexType == GL_UNSIGNED_SHORT) {
+            appendBytes(indexData, GLushort(e));
+        } else {
+            appendBytes(indexData, GLuint(e));
         }
     }
+}
+
+void Mesh::generateBuffers(bool forceTexcoords) {
+    std::vector<GLubyte> vertexData;
+    std::vector<GLubyte> positionData;
+    std::vector<GLubyte> indexData;
+    buildBufferData(vertexData, positionData, indexData, forceTexcoords);
 
     vertexBuffer = std::make_unique<NUGL::Buffer>();
-    vertexBuffer->setData(GL_ARRAY_BUFFER, vertexBufferData, GL_STATIC_DRAW);
+    vertexBuffer->setData(GL_ARRAY_BUFFER, vertexData, GL_STATIC_DRAW);
+
+    positionBuffer = std::make_unique<NUGL::Buffer>();
+    positionBuffer->setData(GL_ARRAY_BUFFER, positionData, GL_STATIC_DRAW);
 
     elementBuffer = std::make_unique<NUGL::Buffer>();
-    elementBuffer->setData(GL_ELEMENT_ARRAY_BUFFER, elements, GL_STATIC_DRAW);
+    elementBuffer->setData(GL_ELEMENT_ARRAY_BUFFER, indexData, GL_STATIC_DRAW);
+
+    geometryBuffer = nullptr;
+    geometryRange = GeometryRange();
+    geometryRange.indexCount = elements.size();
+}
+
+void Mesh::generateBuffers(GeometryPool &pool) {
+    std::vector<GLubyte> vertexData;
+    std::vector<GLubyte> positionData;
+    std::vector<GLubyte> indexData;
+    buildBufferData(vertexData, positionData, indexData);
+
+    vertexBuffer = nullptr;
+    positionBuffer = nullptr;
+    elementBuffer = nullptr;
+    vertexArray = nullptr;
+    positionVertexArray = nullptr;
+
+    geometryBuffer = &pool.bufferForFormat(vertexFormat);
+    geometryRange = geometryBuffer->append(vertexData, positionData, indexData);
 }
 
 
@@ -2,15 +2,121 @@
 
 #include <memory>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <unordered_map>
 
 #include "NUGL/Buffer.h"
 #include "NUGL/Texture.h"
 #include "NUGL/VertexArray.h"
+#include "NUGL/VertexLayout.h"
 #include "NUGL/ShaderProgram.h"
 #include "scene/Material.h"
+#include "scene/MaterialBinder.h"
 
 namespace scene {
+    /**
+     * Describes how a mesh's vertex attributes and indices are stored on the GPU.
+     *
+     * Quantized positions (GL_SHORT, normalized, or GL_HALF_FLOAT) are stored relative to the mesh's
+     * quantization bounds, and are mapped back to object space by Mesh::positionDecodeTransform().
+     */
+    struct VertexFormat {
+        GLenum positionType = GL_FLOAT; // GL_FLOAT, GL_HALF_FLOAT, or GL_SHORT.
+        GLenum normalType = GL_FLOAT; // GL_FLOAT or GL_INT_2_10_10_10_REV.
+        GLenum texCoordType = GL_FLOAT; // GL_FLOAT or GL_HALF_FLOAT.
+        GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT.
+
+        // Set by Mesh::generateBuffers to record which attributes the vertex buffer contains.
+        bool hasNormals = false;
+        bool hasTexCoords = false;
+
+        //! Returns the number of bytes occupied by each vertex in this format.
+        GLsizei vertexSize() const;
+
+        //! Returns the format of the position-only vertex stream (see Mesh::buildBufferData).
+        inline VertexFormat positionFormat() const {
+            VertexFormat format = *this;
+            format.hasNormals = false;
+            format.hasTexCoords = false;
+            return format;
+        }
+
+        /**
+         * Calls op.template apply<V>(), where V is the NUGL::Vertex type that stores vertices in this format, so
+         * that vertices can be written and described by code generated for each format.
+         */
+        template <typename Op>
+        void dispatch(Op &op) const;
+
+        inline bool operator==(const VertexFormat& other) const {
+            return positionType == other.positionType && normalType == other.normalType
+                    && texCoordType == other.texCoordType && indexType == other.indexType
+                    && hasNormals == other.hasNormals && hasTexCoords == other.hasTexCoords;
+        }
+    };
+
+    namespace detail {
+        template <typename Position, typename Normal, typename Op>
+        inline void dispatchTexCoord(const VertexFormat &format, Op &op) {
+            if (!format.hasTexCoords)
+                op.template apply<NUGL::Vertex<Position, Normal, NUGL::NoAttribute>>();
+            else if (format.texCoordType == GL_HALF_FLOAT)
+                op.template apply<NUGL::Vertex<Position, Normal, NUGL::Half2>>();
+            else
+                op.template apply<NUGL::Vertex<Position, Normal, NUGL::Float2>>();
+        }
+
+        template <typename Position, typename Op>
+        inline void dispatchNormal(const VertexFormat &format, Op &op) {
+            if (!format.hasNormals)
+                dispatchTexCoord<Position, NUGL::NoAttribute>(format, op);
+            else if (format.normalType == GL_INT_2_10_10_10_REV)
+                dispatchTexCoord<Position, NUGL::Int2101010>(format, op);
+            else
+                dispatchTexCoord<Position, NUGL::Float3>(format, op);
+        }
+
+        struct VertexSizeOp {
+            GLsizei size = 0;
+
+            template <typename V>
+            void apply() {
+                size = sizeof(V);
+            }
+        };
+    }
+
+    template <typename Op>
+    inline void VertexFormat::dispatch(Op &op) const {
+        switch (positionType) {
+            case GL_SHORT:
+                detail::dispatchNormal<NUGL::Snorm16x3>(*this, op);
+                break;
+            case GL_HALF_FLOAT:
+                detail::dispatchNormal<NUGL::Half3>(*this, op);
+                break;
+            default:
+                detail::dispatchNormal<NUGL::Float3>(*this, op);
+                break;
+        }
+    }
+
+    inline GLsizei VertexFormat::vertexSize() const {
+        detail::VertexSizeOp op;
+        dispatch(op);
+        return op.size;
+    }
+
+    //! The location of a mesh's indices and vertices within its (possibly shared) buffers.
+    struct GeometryRange {
+        GLsizei indexCount = 0;
+        GLintptr indexOffset = 0; // In bytes.
+        GLint baseVertex = 0;
+    };
+
+    class GeometryBuffer;
+    class GeometryPool;
+
     struct Mesh {
         int materialIndex;
         std::shared_ptr<Material> material;
@@ -20,15 +126,34 @@ namespace scene {
         std::vector<glm::vec2> texCoords;
         std::vector<GLint> elements;
 
+        VertexFormat vertexFormat;
+        GeometryRange geometryRange;
+
+        // Quantized positions are decoded as: positionOffset + positionScale * storedPosition.
+        glm::vec3 positionOffset = {0, 0, 0};
+        float positionScale = 1;
+
+        // Set when the mesh owns its buffers (see generateBuffers).
         std::unique_ptr<NUGL::Buffer> vertexBuffer;
+        std::unique_ptr<NUGL::Buffer> positionBuffer; // The positions alone, for depth-only passes.
         std::unique_ptr<NUGL::Buffer> elementBuffer;
 
+        // Set when the mesh's data was appended to a shared GeometryPool, which owns the buffer.
+        GeometryBuffer *geometryBuffer = nullptr;
+
         std::shared_ptr<NUGL::ShaderProgram> shaderProgram;
 
-        std::unordered_map<NUGL::ShaderProgram, std::unique_ptr<NUGL::VertexArray>> vertexArrayMap;
+        // Set when the mesh owns its buffers. Attributes have fixed locations, so one vertex array serves every program.
+        std::unique_ptr<NUGL::VertexArray> vertexArray;
+        std::unique_ptr<NUGL::VertexArray> positionVertexArray;
 
+        // The material's binder for each program it has been drawn with, by program id.
+        std::unordered_map<GLuint, MaterialBinder> materialBinders;
+
+        // Instanced meshes (see Model::createInstance) have no CPU-side vertex data, so check the uploaded format.
         inline bool isTextured() {
-            return (bool)(material->materialInfo.has.texDiffuse || material->materialInfo.has.texHeight) && !texCoords.empty();
+            return (bool)(material->materialInfo.has.texDiffuse || material->materialInfo.has.texHeight)
+                    && (!texCoords.empty() || vertexFormat.hasTexCoords);
         }
 
         inline bool hasNormals() {
@@ -39,9 +164,50 @@ namespace scene {
             return (bool)material->materialInfo.has.texEnvironmentMap;
         }
 
+        //! Throws if any element refers to a vertex that the mesh does not have.
+        void validateElements();
+
+        //! Returns the smallest vertex format that represents this mesh without visible loss of precision.
+        VertexFormat compactVertexFormat();
+
+        //! Sets the box that quantized positions are stored relative to (must contain every vertex).
+        void setQuantizationBounds(glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+        //! Maps positions stored in the vertex buffer back to object space.
+        glm::mat4 positionDecodeTransform();
+
+        /**
+         * Encodes the mesh's vertices and indices in its vertexFormat. The positions are also written alone, in the
+         * same order, to positionData.
+         */
+        void buildBufferData(std::vector<GLubyte> &vertexData, std::vector<GLubyte> &positionData,
+                std::vector<GLubyte> &indexData, bool forceTexcoords = false);
+
+        //! Uploads the mesh into buffers owned by the mesh.
         void generateBuffers(bool forceTexcoords = false);
+
+        //! Appends the mesh to the shared buffer for its vertex format in the given pool.
+        void generateBuffers(GeometryPool &pool);
+
+        /**
+         * Binds the vertex array of the mesh's buffers (shared by all meshes in a GeometryBuffer), creating it if
+         * required. Programs that only read positions (see NUGL::ShaderProgram::readsPositionOnly) should use the
+         * position-only vertex array, which fetches a third to a half as many bytes per vertex.
+         */
+        void bindVertexArray(bool positionOnly = false);
+
+        //! Creates the vertex array of the mesh's buffers, if it does not already exist, and returns it.
+        NUGL::VertexArray *prepareVertexArray(bool positionOnly = false);
+
+        //! The shader features of the mesh's material (its textures), for choosing program variants.
+        uint32_t shaderFeatures();
+
         void draw(std::shared_ptr<NUGL::ShaderProgram> program);
-        void prepareVertexArrayForShaderProgram(std::shared_ptr<NUGL::ShaderProgram> shadowMapProgram);
+
+        //! Uploads the material's parameters to the program (which must be in use), recording a binder for the pair on first use.
         void prepareMaterialShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program);
+
+        //! Discards the recorded binders, which must be done after changing the material's MaterialInfo or textures.
+        void invalidateMaterialBinders();
     };
 }
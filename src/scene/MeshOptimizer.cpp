@@ -0,0 +1,359 @@
+#include "scene/MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace scene {
+
+// Simulates a FIFO post-transform cache. A vertex is cached while fewer than cacheSize misses have occurred
+// since it was last transformed.
+class FifoCacheSimulator {
+public:
+    FifoCacheSimulator(size_t vertexCount, unsigned cacheSize)
+            : timestamps(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1) { }
+
+    //! Returns the number of vertices of the triangle that had to be transformed.
+    inline unsigned addTriangle(GLint a, GLint b, GLint c) {
+        return addVertex(a) + addVertex(b) + addVertex(c);
+    }
+
+    inline void flush() {
+        time += cacheSize + 1;
+    }
+
+private:
+    inline unsigned addVertex(GLint v) {
+        if (time - timestamps[v] > cacheSize) {
+            timestamps[v] = time++;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::vector<unsigned> timestamps;
+    unsigned cacheSize;
+    unsigned time;
+};
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<GLint>& elements, size_t vertexCount, unsigned cacheSize) {
+    VertexCacheStatistics stats;
+    stats.triangles = elements.size() / 3;
+    stats.vertices = vertexCount;
+
+    FifoCacheSimulator cache(vertexCount, cacheSize);
+    for (size_t i = 0; i + 2 < elements.size(); i += 3) {
+        stats.vertexTransforms += cache.addTriangle(elements[i], elements[i + 1], elements[i + 2]);
+    }
+
+    return stats;
+}
+
+// Scoring parameters from: https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+static const int forsythCacheSize = 32;
+static const float forsythCacheDecayPower = 1.5f;
+static const float forsythLastTriangleScore = 0.75f;
+static const float forsythValenceBoostScale = 2.0f;
+static const float forsythValenceBoostPower = 0.5f;
+
+static float forsythVertexScore(int cachePosition, unsigned remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1;
+
+    float score = 0;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The vertices of the last triangle are scored lower, to discourage strip-like orders.
+            score = forsythLastTriangleScore;
+        } else {
+            float scaler = 1.0f / (forsythCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, forsythCacheDecayPower);
+        }
+    }
+
+    // Boost vertices with few remaining triangles, so that lone triangles don't get left behind:
+    score += forsythValenceBoostScale * std::pow(float(remainingTriangles), -forsythValenceBoostPower);
+
+    return score;
+}
+
+void optimizeVertexCache(std::vector<GLint>& elements, size_t vertexCount) {
+    size_t triangleCount = elements.size() / 3;
+    if (triangleCount == 0 || elements.size() % 3 != 0)
+        return;
+
+    // Vertex to triangle adjacency. The first liveTriangles[v] entries of each range are not yet emitted.
+    std::vector<unsigned> liveTriangles(vertexCount, 0);
+    for (GLint e : elements)
+        liveTriangles[e]++;
+
+    std::vector<unsigned> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<unsigned> adjacency(elements.size());
+    std::vector<unsigned> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[elements[t * 3 + k]]++] = t;
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = forsythVertexScore(-1, liveTriangles[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    long bestTriangle = -1;
+    float bestScore = -1;
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[elements[t * 3]] + vertexScores[elements[t * 3 + 1]] + vertexScores[elements[t * 3 + 2]];
+        if (triangleScores[t] > bestScore) {
+            bestScore = triangleScores[t];
+            bestTriangle = t;
+        }
+    }
+
+    std::vector<GLint> result;
+    result.reserve(elements.size());
+
+    GLint cache[forsythCacheSize + 3];
+    int cacheCount = 0;
+    GLint newCache[forsythCacheSize + 3];
+    size_t scanCursor = 0;
+
+    while (result.size() < elements.size()) {
+        if (bestTriangle < 0) {
+            // Nothing in the cache is adjacent to a live triangle, so start again from the next unused one:
+            while (emitted[scanCursor])
+                scanCursor++;
+            bestTriangle = scanCursor;
+        }
+
+        const GLint *tri = &elements[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+
+        for (int k = 0; k < 3; k++) {
+            GLint v = tri[k];
+            result.push_back(v);
+
+            // Remove the triangle from the vertex's live adjacency list:
+            unsigned *begin = &adjacency[adjacencyOffsets[v]];
+            unsigned *end = begin + liveTriangles[v];
+            unsigned *found = std::find(begin, end, unsigned(bestTriangle));
+            std::swap(*found, *(end - 1));
+            liveTriangles[v]--;
+        }
+
+        // Move the triangle's vertices to the front of the cache:
+        int newCacheCount = 0;
+        for (int k = 0; k < 3; k++)
+            newCache[newCacheCount++] = tri[k];
+        for (int i = 0; i < cacheCount; i++) {
+            GLint v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheCount++] = v;
+        }
+
+        for (int i = 0; i < newCacheCount; i++) {
+            GLint v = newCache[i];
+            cachePosition[v] = (i < forsythCacheSize) ? i : -1;
+            vertexScores[v] = forsythVertexScore(cachePosition[v], liveTriangles[v]);
+        }
+
+        // Rescore the live triangles touching the cache, and pick the next one from them:
+        bestTriangle = -1;
+        bestScore = -1;
+        for (int i = 0; i < newCacheCount; i++) {
+            GLint v = newCache[i];
+            for (unsigned j = 0; j < liveTriangles[v]; j++) {
+                unsigned t = adjacency[adjacencyOffsets[v] + j];
+                float score = vertexScores[elements[t * 3]] + vertexScores[elements[t * 3 + 1]] + vertexScores[elements[t * 3 + 2]];
+                triangleScores[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cacheCount = std::min(newCacheCount, forsythCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+    }
+
+    elements.swap(result);
+}
+
+void optimizeOverdraw(std::vector<GLint>& elements, const std::vector<glm::vec3>& vertices, float threshold) {
+    const unsigned cacheSize = 16;
+    size_t triangleCount = elements.size() / 3;
+    if (triangleCount < 2 || elements.size() % 3 != 0)
+        return;
+
+    // Hard boundaries: triangles whose vertices are all cache misses can start a cluster for free.
+    std::vector<size_t> hardBoundaries;
+    {
+        FifoCacheSimulator cache(vertices.size(), cacheSize);
+        for (size_t t = 0; t < triangleCount; t++) {
+            unsigned misses = cache.addTriangle(elements[t * 3], elements[t * 3 + 1], elements[t * 3 + 2]);
+            if (t == 0 || misses == 3)
+                hardBoundaries.push_back(t);
+        }
+        hardBoundaries.push_back(triangleCount);
+    }
+
+    // Soft boundaries: split hard clusters where the cluster so far is already cache efficient enough.
+    std::vector<size_t> boundaries;
+    for (size_t h = 0; h + 1 < hardBoundaries.size(); h++) {
+        size_t start = hardBoundaries[h];
+        size_t end = hardBoundaries[h + 1];
+
+        FifoCacheSimulator cache(vertices.size(), cacheSize);
+        unsigned clusterMisses = 0;
+        for (size_t t = start; t < end; t++)
+            clusterMisses += cache.addTriangle(elements[t * 3], elements[t * 3 + 1], elements[t * 3 + 2]);
+        float clusterThreshold = threshold * float(clusterMisses) / (end - start);
+
+        cache.flush();
+        boundaries.push_back(start);
+        size_t subStart = start;
+        unsigned subMisses = 0;
+        for (size_t t = start; t < end; t++) {
+            subMisses += cache.addTriangle(elements[t * 3], elements[t * 3 + 1], elements[t * 3 + 2]);
+
+            if (t + 1 < end && float(subMisses) / (t - subStart + 1) <= clusterThreshold) {
+                boundaries.push_back(t + 1);
+                subStart = t + 1;
+                subMisses = 0;
+                cache.flush();
+            }
+        }
+    }
+    boundaries.push_back(triangleCount);
+
+    // Area weighted centroid of the whole mesh:
+    glm::vec3 meshCentroid = {0, 0, 0};
+    float meshArea = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        const glm::vec3 &a = vertices[elements[t * 3]];
+        const glm::vec3 &b = vertices[elements[t * 3 + 1]];
+        const glm::vec3 &c = vertices[elements[t * 3 + 2]];
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    if (meshArea > 0)
+        meshCentroid /= meshArea;
+
+    // Sort clusters so that those facing away from the mesh centre (which occlude the rest) draw first:
+    struct Cluster {
+        size_t start;
+        size_t end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+        Cluster cluster = {boundaries[i], boundaries[i + 1], 0};
+
+        glm::vec3 centroid = {0, 0, 0};
+        glm::vec3 normal = {0, 0, 0};
+        float area = 0;
+        for (size_t t = cluster.start; t < cluster.end; t++) {
+            const glm::vec3 &a = vertices[elements[t * 3]];
+            const glm::vec3 &b = vertices[elements[t * 3 + 1]];
+            const glm::vec3 &c = vertices[elements[t * 3 + 2]];
+            glm::vec3 faceNormal = glm::cross(b - a, c - a);
+            float faceArea = glm::length(faceNormal);
+            centroid += (a + b + c) * (faceArea / 3.0f);
+            normal += faceNormal;
+            area += faceArea;
+        }
+
+        float normalLength = glm::length(normal);
+        if (area > 0 && normalLength > 0) {
+            centroid /= area;
+            cluster.sortKey = glm::dot(centroid - meshCentroid, normal / normalLength);
+        }
+
+        clusters.push_back(cluster);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &c1, const Cluster &c2) {
+        return c1.sortKey > c2.sortKey;
+    });
+
+    std::vector<GLint> result;
+    result.reserve(elements.size());
+    for (auto &cluster : clusters) {
+        result.insert(result.end(), elements.begin() + cluster.start * 3, elements.begin() + cluster.end * 3);
+    }
+
+    elements.swap(result);
+}
+
+void optimizeVertexFetch(Mesh& mesh) {
+    size_t vertexCount = mesh.vertices.size();
+
+    // The attributes are remapped together, so each must have one value per vertex (or none at all):
+    if ((!mesh.normals.empty() && mesh.normals.size() != vertexCount)
+            || (!mesh.texCoords.empty() && mesh.texCoords.size() != vertexCount)) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Mesh has " << mesh.normals.size() << " normals and " << mesh.texCoords.size()
+                << " texture coordinates for " << vertexCount << " vertices.";
+        throw std::runtime_error(errMsg.str());
+    }
+
+    std::vector<GLint> remap(vertexCount, -1);
+
+    GLint nextVertex = 0;
+    for (auto &e : mesh.elements) {
+        if (remap[e] < 0)
+            remap[e] = nextVertex++;
+        e = remap[e];
+    }
+
+    // Unreferenced vertices are dropped.
+    std::vector<glm::vec3> vertices(nextVertex);
+    std::vector<glm::vec3> normals(mesh.normals.empty() ? 0 : nextVertex);
+    std::vector<glm::vec2> texCoords(mesh.texCoords.empty() ? 0 : nextVertex);
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] < 0)
+            continue;
+
+        vertices[remap[v]] = mesh.vertices[v];
+        if (!normals.empty())
+            normals[remap[v]] = mesh.normals[v];
+        if (!texCoords.empty())
+            texCoords[remap[v]] = mesh.texCoords[v];
+    }
+
+    mesh.vertices.swap(vertices);
+    mesh.normals.swap(normals);
+    mesh.texCoords.swap(texCoords);
+}
+
+MeshOptimizationResult optimizeMesh(Mesh& mesh) {
+    // The optimizers index per-vertex arrays with the elements, so they must be checked first:
+    mesh.validateElements();
+
+    MeshOptimizationResult result;
+    result.before = analyzeVertexCache(mesh.elements, mesh.vertices.size());
+
+    // Only triangle lists can be reordered.
+    if (mesh.elements.size() % 3 != 0) {
+        result.after = result.before;
+        return result;
+    }
+
+    optimizeVertexCache(mesh.elements, mesh.vertices.size());
+    optimizeOverdraw(mesh.elements, mesh.vertices);
+    optimizeVertexFetch(mesh);
+
+    result.after = analyzeVertexCache(mesh.elements, mesh.vertices.size());
+    return result;
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+#include <GL/glew.h>
+
+#include "scene/Mesh.h"
+
+namespace scene {
+    /**
+     * Post-transform vertex cache statistics for a triangle list, simulated with a FIFO cache.
+     *
+     * ACMR (average cache miss ratio) is vertex shader invocations per triangle (0.5 is ideal for large grids,
+     * 3 is the worst case). ATVR (average transformed vertex ratio) is invocations per vertex (1 is ideal).
+     */
+    struct VertexCacheStatistics {
+        unsigned vertexTransforms = 0;
+        unsigned triangles = 0;
+        unsigned vertices = 0;
+
+        inline float acmr() const {
+            return triangles == 0 ? 0 : float(vertexTransforms) / triangles;
+        }
+
+        inline float atvr() const {
+            return vertices == 0 ? 0 : float(vertexTransforms) / vertices;
+        }
+
+        inline VertexCacheStatistics& operator+=(const VertexCacheStatistics& other) {
+            vertexTransforms += other.vertexTransforms;
+            triangles += other.triangles;
+            vertices += other.vertices;
+            return *this;
+        }
+    };
+
+    //! The elements must be in range (see Mesh::validateElements).
+    VertexCacheStatistics analyzeVertexCache(const std::vector<GLint>& elements, size_t vertexCount, unsigned cacheSize = 16);
+
+    //! Reorders triangles for post-transform cache efficiency (Tom Forsyth's linear-speed algorithm).
+    void optimizeVertexCache(std::vector<GLint>& elements, size_t vertexCount);
+
+    /**
+     * Reorders clusters of a cache optimised triangle list so that outward-facing clusters are drawn first.
+     *
+     * Clusters are only split where doing so raises the ACMR by less than the given threshold.
+     */
+    void optimizeOverdraw(std::vector<GLint>& elements, const std::vector<glm::vec3>& vertices, float threshold = 1.05f);
+
+    /**
+     * Renumbers vertices in the order they are first referenced, so vertex fetches are sequential.
+     *
+     * Throws if the mesh's normals or texture coordinates do not match its vertices one to one.
+     */
+    void optimizeVertexFetch(Mesh& mesh);
+
+    struct MeshOptimizationResult {
+        VertexCacheStatistics before;
+        VertexCacheStatistics after;
+    };
+
+    //! Validates the mesh's elements, then runs all optimization stages on it. Must be called before Mesh::generateBuffers.
+    MeshOptimizationResult optimizeMesh(Mesh& mesh);
+}
@@ -1,6 +1,7 @@
 #include "scene/Model.h"
 #include <iostream>
 #include <memory>
+#include <limits>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -14,8 +15,11 @@
 #include "utility/make_unique.h"
 #include "utility/debug.h"
 #include "utility/AssimpDebug.h"
+#include "utility/AllocationCounter.h"
 #include "scene/Camera.h"
 #include "scene/Mesh.h"
+#include "scene/MeshOptimizer.h"
+#include "scene/UniformBlocks.h"
 
 namespace scene {
 
@@ -116,7 +120,7 @@ Light copyAiLight(const std::string &fileName, const aiLight *srcLight) {
     return light;
 }
 
-std::unique_ptr<NUGL::Texture> loadAiMaterialTexture(unsigned int texNum, std::string const &fileName, aiMaterial const *srcMaterial, aiTextureType texType, unsigned int texUnit) {
+TextureSource getAiMaterialTextureSource(unsigned int texNum, std::string const &fileName, aiMaterial const *srcMaterial, aiTextureType texType, unsigned int texUnit) {
     aiString path;
     auto mapModes = std::vector<aiTextureMapMode>(3);
     srcMaterial->GetTexture(texType, texNum, &path, nullptr, nullptr, nullptr, nullptr,
@@ -125,14 +129,24 @@ std::unique_ptr<NUGL::Texture> loadAiMaterialTexture(unsigned int texNum, std::s
     boost::filesystem::path dir = p.parent_path();
     dir += "/";
     dir += path.C_Str();
-    std::cout << "Texture " << texNum << ": " << dir.string() << std::endl;
 
-    auto texture = std::make_unique<NUGL::Texture>(texUnit, GL_TEXTURE_2D);
-    texture->loadFromImage(dir.string());
+    TextureSource source;
+    source.fileName = dir.string();
+    source.unit = texUnit;
     //      TODO: Read texture settings from Assimp (+ Check for other texture types/layers).
     //      TODO: Support 3D textures.
-    texture->setParam(GL_TEXTURE_WRAP_S, getGLTextureWrapForAiTextureMapMode(mapModes[0]));
-    texture->setParam(GL_TEXTURE_WRAP_T, getGLTextureWrapForAiTextureMapMode(mapModes[1]));
+    source.wrapS = getGLTextureWrapForAiTextureMapMode(mapModes[0]);
+    source.wrapT = getGLTextureWrapForAiTextureMapMode(mapModes[1]);
+    return source;
+}
+
+std::unique_ptr<NUGL::Texture> loadMaterialTexture(const TextureSource &source) {
+    std::cout << "Texture: " << source.fileName << std::endl;
+
+    auto texture = std::make_unique<NUGL::Texture>(source.unit, GL_TEXTURE_2D);
+    texture->loadFromImage(source.fileName);
+    texture->setParam(GL_TEXTURE_WRAP_S, source.wrapS);
+    texture->setParam(GL_TEXTURE_WRAP_T, source.wrapT);
     //        texture->setParam(GL_TEXTURE_WRAP_R, getGLTextureWrapForAiTextureMapMode(mapModes[2]));
     texture->setParam(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     texture->setParam(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -140,7 +154,7 @@ std::unique_ptr<NUGL::Texture> loadAiMaterialTexture(unsigned int texNum, std::s
     return std::move(texture);
 }
 
-Material copyAiMaterial(const std::string &fileName, const aiMaterial *srcMaterial) {
+Material copyAiMaterial(const std::string &fileName, const aiMaterial *srcMaterial, std::ostream &log) {
     // TODO: Support remaining material properties from http://assimp.sourceforge.net/lib_html/materials.html
     Material material;
     material.materialInfo.bitSet = 0;
@@ -224,16 +238,14 @@ Material copyAiMaterial(const std::string &fileName, const aiMaterial *srcMateri
     //  - http://renderman.pixar.com/view/cook-torrance-shader
     aiShadingMode shadingMode;
     if (!srcMaterial->Get(AI_MATKEY_SHADING_MODEL, shadingMode)) {
-        std::cerr << __func__ << "Shading mode: " << utility::getAiShadingModeName(shadingMode) << std::endl;
+        log << __func__ << "Shading mode: " << utility::getAiShadingModeName(shadingMode) << std::endl;
     }
 
     auto diffTexCount = srcMaterial->GetTextureCount(aiTextureType_DIFFUSE);
     for (unsigned int t = 0; t < diffTexCount; t++) {
         material.materialInfo.has.texDiffuse = true;
 
-        std::unique_ptr<NUGL::Texture> texDiffuse = loadAiMaterialTexture(t, fileName, srcMaterial, aiTextureType_DIFFUSE, GL_TEXTURE0 + t);
-
-        material.texDiffuse = std::move(texDiffuse);
+        material.texDiffuseSource = getAiMaterialTextureSource(t, fileName, srcMaterial, aiTextureType_DIFFUSE, GL_TEXTURE0 + t);
         break; // Only use first texture. TODO: Support multiple textures.
     }
 
@@ -241,9 +253,7 @@ Material copyAiMaterial(const std::string &fileName, const aiMaterial *srcMateri
     for (unsigned int t = 0; t < heightTexCount; t++) {
         material.materialInfo.has.texHeight = true;
 
-        std::unique_ptr<NUGL::Texture> texHeight = loadAiMaterialTexture(t, fileName, srcMaterial, aiTextureType_HEIGHT, GL_TEXTURE4 + t);
-
-        material.texHeight = std::move(texHeight);
+        material.texHeightSource = getAiMaterialTextureSource(t, fileName, srcMaterial, aiTextureType_HEIGHT, GL_TEXTURE4 + t);
         break; // Only use first texture. TODO: Support multiple textures.
     }
 
@@ -266,7 +276,40 @@ void copyAiNode(const aiNode *pNode, Model::Node &node) {
 }
 
 std::shared_ptr<Model> Model::loadFromFile(const std::string &fileName) {
-    std::cout << "Loading '" << fileName << "'..."<< std::endl;
+    auto model = importFromFile(fileName);
+    model->loadTextures();
+    return model;
+}
+
+void Model::decodeTextures(TextureCache &cache, std::ostream &log) const {
+    for (auto &material : materials) {
+        cache.decode(material->texDiffuseSource, log);
+        cache.decode(material->texHeightSource, log);
+    }
+}
+
+void Model::loadTextures(TextureCache &cache) {
+    for (auto &material : materials) {
+        if (!material->texDiffuse && !material->texDiffuseSource.fileName.empty())
+            material->texDiffuse = cache.get(material->texDiffuseSource);
+
+        if (!material->texHeight && !material->texHeightSource.fileName.empty())
+            material->texHeight = cache.get(material->texHeightSource);
+    }
+}
+
+void Model::loadTextures() {
+    for (auto &material : materials) {
+        if (!material->texDiffuse && !material->texDiffuseSource.fileName.empty())
+            material->texDiffuse = loadMaterialTexture(material->texDiffuseSource);
+
+        if (!material->texHeight && !material->texHeightSource.fileName.empty())
+            material->texHeight = loadMaterialTexture(material->texHeightSource);
+    }
+}
+
+std::shared_ptr<Model> Model::importFromFile(const std::string &fileName, std::ostream &log) {
+    log << "Loading '" << fileName << "'..."<< std::endl;
 
     Assimp::Importer importer;
     const aiScene *scene = importer.ReadFile(fileName, getPostProcessingFlags());
@@ -285,7 +328,7 @@ std::shared_ptr<Model> Model::loadFromFile(const std::string &fileName) {
 
     for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
         auto *material = scene->mMaterials[i];
-        sceneModel->materials.push_back(std::make_shared<Material>(copyAiMaterial(fileName, material)));
+        sceneModel->materials.push_back(std::make_shared<Material>(copyAiMaterial(fileName, material, log)));
     }
 
     for (unsigned int i = 0; i < scene->mNumLights; i++) {
@@ -387,9 +430,89 @@ std::shared_ptr<Model> Model::createIcosahedron() {
     return sceneModel;
 }
 
-void Model::createMeshBuffers() {
+void Model::createMeshBuffers(GeometryPool &pool) {
+    meshStatistics = MeshOptimizationResult();
+    for (auto &mesh : meshes) {
+        auto result = optimizeMesh(mesh);
+        meshStatistics.before += result.before;
+        meshStatistics.after += result.after;
+    }
+
+    std::cout << "Optimized meshes of '" << modelName << "':"
+              << " ACMR " << meshStatistics.before.acmr() << " -> " << meshStatistics.after.acmr() << ","
+              << " ATVR " << meshStatistics.before.atvr() << " -> " << meshStatistics.after.atvr() << std::endl;
+
+    // Quantize all meshes against the same box, so that they share the node transform uniforms:
+    glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
     for (auto &mesh : meshes) {
-        mesh.generateBuffers();
+        for (auto &vertex : mesh.vertices) {
+            boundsMin = glm::min(boundsMin, vertex);
+            boundsMax = glm::max(boundsMax, vertex);
+        }
+    }
+
+    for (auto &mesh : meshes) {
+        mesh.vertexFormat = mesh.compactVertexFormat();
+        mesh.setQuantizationBounds(boundsMin, boundsMax);
+        mesh.generateBuffers(pool);
+    }
+
+    if (!meshes.empty()) {
+        positionDecode = meshes[0].positionDecodeTransform();
+    }
+}
+
+std::shared_ptr<Model> Model::createInstance() const {
+    for (auto &mesh : meshes) {
+        if (mesh.geometryBuffer == nullptr) {
+            std::stringstream errMsg;
+            errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                    << "Model '" << modelName << "' must be added to a GeometryPool before it is instanced.";
+            throw std::logic_error(errMsg.str());
+        }
+    }
+
+    auto instance = std::make_shared<Model>(modelName);
+    for (auto &material : materials) {
+        instance->materials.push_back(std::make_shared<Material>(*material));
+    }
+    for (auto &light : lights) {
+        instance->lights.push_back(std::make_shared<Light>(*light));
+    }
+
+    instance->meshes.resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Mesh &source = meshes[i];
+        Mesh &mesh = instance->meshes[i];
+        mesh.materialIndex = source.materialIndex;
+        mesh.material = instance->materials[source.materialIndex];
+        mesh.vertexFormat = source.vertexFormat;
+        mesh.geometryRange = source.geometryRange;
+        mesh.positionOffset = source.positionOffset;
+        mesh.positionScale = source.positionScale;
+        mesh.geometryBuffer = source.geometryBuffer;
+    }
+
+    instance->rootNode = rootNode;
+    instance->positionDecode = positionDecode;
+    instance->meshStatistics = meshStatistics;
+    return instance;
+}
+
+void Model::shareMaterials(const Model &other) {
+    if (other.materials.size() != materials.size()) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Model '" << modelName << "' has " << materials.size() << " materials, but '" << other.modelName
+                << "' has " << other.materials.size() << ".";
+        throw std::invalid_argument(errMsg.str());
+    }
+
+    materials = other.materials;
+    for (auto &mesh : meshes) {
+        mesh.material = materials[mesh.materialIndex];
+        mesh.invalidateMaterialBinders();
     }
 }
 
@@ -405,138 +528,263 @@ void Model::createVertexArrays() {
         }
         mesh.shaderProgram = program;
 
-        mesh.prepareVertexArrayForShaderProgram(program);
+        mesh.prepareVertexArray();
     }
+
+    flattenNodes();
+    buildDrawBatches();
 }
 
-glm::mat4 Model::buildModelTransform(glm::vec3 pos, glm::vec3 dir, glm::vec3 up, glm::vec3 scale) {
-    glm::mat4 model;
-    model = glm::scale(model, scale);
+void Model::flattenNodes() {
+    nodes.clear();
+    flattenNode(rootNode, -1);
+    nodesDirty = true;
+}
 
-    glm::mat4 orientation = glm::lookAt(pos, pos + dir, up);
+void Model::flattenNode(Model::Node &node, int parent) {
+    int index = nodes.size();
+    nodes.push_back({parent, node.meshes, node.transform, node.transform, node.transform});
 
-    return glm::inverse(orientation) * model;
+    for (auto &child : node.children) {
+        flattenNode(child, index);
+    }
 }
 
-void Model::draw(Camera &camera, std::shared_ptr<NUGL::ShaderProgram> program, bool transparentOnly) {
-    transform = modelTransform();
+void Model::buildDrawBatches() {
+    // Meshes are grouped regardless of their nodes, as each draw binds its node's object block:
+    drawBatches.clear();
+    for (int n = 0; n < int(nodes.size()); n++) {
+        for (int index : nodes[n].meshes) {
+            auto &mesh = meshes[index];
+
+            DrawBatch *batch = nullptr;
+            if (mesh.geometryBuffer != nullptr) {
+                for (auto &candidate : drawBatches) {
+                    if (candidate.geometryBuffer == mesh.geometryBuffer && candidate.material == mesh.material
+                            && candidate.program == mesh.shaderProgram) {
+                        batch = &candidate;
+                        break;
+                    }
+                }
+            }
 
-    drawNodeWithProgram(rootNode, transform, camera, program, transparentOnly);
+            if (batch == nullptr) {
+                drawBatches.emplace_back();
+                batch = &drawBatches.back();
+                batch->material = mesh.material;
+                batch->program = mesh.shaderProgram;
+                batch->geometryBuffer = mesh.geometryBuffer;
+            }
+
+            batch->meshes.push_back(index);
+            batch->nodes.push_back(n);
+            batch->counts.push_back(mesh.geometryRange.indexCount);
+            batch->indexOffsets.push_back((const GLvoid *) mesh.geometryRange.indexOffset);
+            batch->baseVertices.push_back(mesh.geometryRange.baseVertex);
+        }
+    }
 }
 
-void Model::draw(Camera &camera, std::shared_ptr<Light> light, std::shared_ptr<LightCamera> lightCamera, bool transparentOnly) {
-    transform = modelTransform();
+void Model::setNodeTransform(int nodeIndex, const glm::mat4 &transform) {
+    if (nodeIndex < 0 || nodeIndex >= int(nodes.size())) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Node index " << nodeIndex << " is out of range for model '" << modelName << "'"
+                << " (" << nodes.size() << " nodes).";
+        throw std::out_of_range(errMsg.str());
+    }
 
-    drawNode(rootNode, transform, camera, light, lightCamera, transparentOnly);
+    nodes[nodeIndex].local = transform;
+    nodesDirty = true;
 }
 
-void Model::drawNodeWithProgram(Model::Node &node, glm::mat4 parentNodeTransform, Camera &camera, std::shared_ptr<NUGL::ShaderProgram> program, bool transparentOnly) {
-    glm::mat4 model = parentNodeTransform * node.transform;
+void Model::updateTransforms() {
+    bool moved = !transformsValid || pos != lastPos || dir != lastDir || up != lastUp || scale != lastScale;
+    if (!moved && !nodesDirty)
+        return;
+
+    if (moved) {
+        transform = modelTransform();
+        lastPos = pos;
+        lastDir = dir;
+        lastUp = up;
+        lastScale = scale;
+        transformsValid = true;
+    }
 
-    program->use();
-    setCameraUniformsOnShaderProgram(program, camera, model);
+    if (nodesDirty) {
+        // The batches do not depend on the node transforms, so only the matrices are recomputed (parents precede
+        // their children):
+        for (auto &node : nodes) {
+            node.model = (node.parent < 0) ? node.local : nodes[node.parent].model * node.local;
+        }
+        nodesDirty = false;
+    }
 
-    for (int index : node.meshes) {
-        auto &mesh = meshes[index];
+    if (transformStore != nullptr && int(nodes.size()) != numTransforms) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Model '" << modelName << "' has " << nodes.size() << " nodes, but " << numTransforms
+                << " transforms were reserved for it (its nodes were flattened after attachTransformStore).";
+        throw std::logic_error(errMsg.str());
+    }
 
-        if (transparentOnly == (mesh.material->opacity == 1))
-            continue;
+    boundsValid = false;
+    for (int i = 0; i < int(nodes.size()); i++) {
+        nodes[i].world = transform * nodes[i].model * positionDecode;
 
-        mesh.draw(program);
+        if (transformStore != nullptr)
+            transformStore->set(firstTransform + i, nodes[i].world);
     }
+}
 
-    for (auto &child : node.children) {
-        drawNodeWithProgram(child, model, camera, program, transparentOnly);
+void Model::attachTransformStore(utility::math::TransformStore &store) {
+    // The store holds one transform per flattened node:
+    if (nodes.empty() && !meshes.empty()) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Model '" << modelName << "' has no flattened nodes (createVertexArrays must be called first).";
+        throw std::logic_error(errMsg.str());
     }
-}
 
-void Model::drawNode(Model::Node &node, glm::mat4 parentNodeTransform, Camera &camera, std::shared_ptr<Light> light,
-                    std::shared_ptr<LightCamera> lightCamera, bool transparentOnly) {
-    glm::mat4 model = parentNodeTransform * node.transform;
+    transformStore = &store;
+    numTransforms = int(nodes.size());
+    firstTransform = store.allocate(numTransforms);
+
+    // Force the next update to fill in the store:
+    transformsValid = false;
+}
 
-    // TODO: Find a better way of managing shader programs!
-    setCameraUniformsOnShaderPrograms(camera, model);
-    setLightUniformsOnShaderProgram(environmentMapProgram, light, lightCamera);
+void Model::computeWorldBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+    if (boundsValid) {
+        boundsMin = worldBoundsMin;
+        boundsMax = worldBoundsMax;
+        return;
+    }
 
-    for (int index : node.meshes) {
-        auto &mesh = meshes[index];
+    boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
 
-        if (transparentOnly == (mesh.material->opacity == 1))
+    // The quantized positions of every mesh lie in [-1, 1]^3, so transform the corners of that cube:
+    for (auto &node : nodes) {
+        if (node.meshes.empty())
             continue;
 
-        mesh.draw(mesh.shaderProgram);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 pos = {(corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f, 1.0f};
+            glm::vec3 world = glm::vec3(node.world * pos);
+            boundsMin = glm::min(boundsMin, world);
+            boundsMax = glm::max(boundsMax, world);
+        }
     }
 
-    for (auto &child : node.children) {
-        drawNode(child, model, camera, light, lightCamera, transparentOnly);
-    }
+    worldBoundsMin = boundsMin;
+    worldBoundsMax = boundsMax;
+    boundsValid = true;
 }
 
+glm::mat4 Model::buildModelTransform(glm::vec3 pos, glm::vec3 dir, glm::vec3 up, glm::vec3 scale) {
+    glm::mat4 model;
+    model = glm::scale(model, scale);
 
-void Model::setCameraUniformsOnShaderPrograms(Camera &camera, glm::mat4 model) {
-    if (textureProgram != nullptr) {
-        setCameraUniformsOnShaderProgram(textureProgram, camera, model);
-    }
+    glm::mat4 orientation = glm::lookAt(pos, pos + dir, up);
 
-    if (flatProgram != nullptr) {
-        setCameraUniformsOnShaderProgram(flatProgram, camera, model);
+    return glm::inverse(orientation) * model;
+}
+
+void Model::draw(Camera &camera, GLintptr objectBlocks, std::shared_ptr<NUGL::ShaderProgram> program, bool transparentOnly) {
+    if (uniformStream == nullptr) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Model '" << modelName << "' has no uniform stream (it must be added to a scene before drawing).";
+        throw std::logic_error(errMsg.str());
     }
 
-    if (environmentMapProgram != nullptr) {
-        setCameraUniformsOnShaderProgram(environmentMapProgram, camera, model);
+    uniformStream->writeAndBind(cameraBlockBinding, CameraBlock(camera));
+    GLsizeiptr objectBlockStride = uniformStream->alignedSize(sizeof(ObjectBlock));
+
+    for (auto &batch : drawBatches) {
+        if (transparentOnly == (batch.material->opacity == 1))
+            continue;
+
+        if (!bindBatch(batch, program, 0, nullptr))
+            continue;
+        GLenum indexType = meshes[batch.meshes[0]].vertexFormat.indexType;
+
+        // Submit each node's meshes together:
+        size_t numMeshes = batch.meshes.size();
+        for (size_t begin = 0, end; begin < numMeshes; begin = end) {
+            for (end = begin + 1; end < numMeshes && batch.nodes[end] == batch.nodes[begin]; end++);
+
+            uniformStream->bindRange(objectBlockBinding, objectBlocks + (firstTransform + batch.nodes[begin]) * objectBlockStride, sizeof(ObjectBlock));
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, &batch.counts[begin], indexType,
+                    &batch.indexOffsets[begin], GLsizei(end - begin), &batch.baseVertices[begin]);
+            checkForAndPrintGLError(__FILE__, __LINE__);
+        }
     }
 }
 
-void Model::setCameraUniformsOnShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program, Camera &camera, glm::mat4 model) {
-    glm::mat4 mvp = camera.proj * camera.view * model;
+bool Model::bindBatch(DrawBatch &batch, std::shared_ptr<NUGL::ShaderProgram> program, uint32_t lightFeatures,
+        const LightCamera *lightCamera, bool litOnly) {
+    // All meshes in the batch share a material and vertex array:
+    auto &mesh = meshes[batch.meshes[0]];
 
-    program->use();
-    program->setUniformIfActive("model", model);
-    program->setUniformIfActive("view", camera.view);
-    program->setUniformIfActive("proj", camera.proj);
+    uint32_t features = mesh.shaderFeatures() | lightFeatures;
+    DrawBatch::BoundProgram *bound = nullptr;
+    for (auto &candidate : batch.boundPrograms) {
+        if (candidate.requested == program && candidate.features == features) {
+            bound = &candidate;
+            break;
+        }
+    }
 
-    program->setUniformIfActive("mvp", mvp);
+    if (bound == nullptr) {
+        auto variant = program->variant(features);
+        if (!variant->isLinkComplete())
+            return false;
+
+        utility::ScopedAllowAllocations allow;
+        GLint shadowMapLocation = -1;
+        if (variant->uniformIsActive("lightTexShadowMap"))
+            shadowMapLocation = variant->getUniformLocation("lightTexShadowMap");
+        batch.boundPrograms.push_back({program, features, variant, shadowMapLocation,
+                variant->uniformBlockIsActive("LightBlock"), MaterialBinder(*batch.material, *variant)});
+        bound = &batch.boundPrograms.back();
+    }
 
-    // We don't invert the transforms relating to the model's internal structure.
-    glm::mat4 modelViewInverse = glm::inverse(camera.view * transform);
-    program->setUniformIfActive("modelViewInverse", modelViewInverse);
+    if (litOnly && !bound->lit)
+        return false;
 
-    glm::mat4 viewInverse = glm::inverse(camera.view);
-    program->setUniformIfActive("viewInverse", viewInverse);
+    bound->variant->use();
+    if (lightCamera != nullptr && bound->shadowMapLocation != -1)
+        bound->variant->setUniform(bound->shadowMapLocation, lightCamera->shadowMap);
+    bound->binder.bind();
+    mesh.bindVertexArray(bound->variant->readsPositionOnly());
+    return true;
 }
 
-void Model::setLightUniformsOnShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program, std::shared_ptr<Light> light, std::shared_ptr<LightCamera> lightCamera) {
-    if (program != nullptr) {
-        if (program->uniformIsActive("light.pos")) {
-            program->use();
-            program->setUniform("light.pos", light->pos);
-            program->setUniform("light.dir", light->dir);
-            program->setUniform("light.attenuationConstant", light->attenuationConstant);
-            program->setUniform("light.attenuationLinear", light->attenuationLinear);
-            program->setUniform("light.attenuationQuadratic", light->attenuationQuadratic);
-            program->setUniform("light.colDiffuse", light->colDiffuse);
-            program->setUniform("light.colSpecular", light->colSpecular);
-            program->setUniform("light.colAmbient", light->colAmbient);
-            program->setUniform("light.angleConeInner", light->angleConeInner);
-            program->setUniform("light.angleConeOuter", light->angleConeOuter);
-            program->setUniformIfActive("light.isSpotlight", light->type == Light::Type::spot);
-            program->setUniformIfActive("light.isDirectional", light->type == Light::Type::directional);
-
-            if (program->uniformIsActive("light.texShadowMap")) {
-                program->use();
-
-                if (lightCamera != nullptr) {
-                    program->setUniformIfActive("light.hasShadowMap", true);
-                    program->setUniformIfActive("light.texShadowMap", lightCamera->shadowMap);
-                    program->setUniformIfActive("light.view", lightCamera->view);
-                    program->setUniformIfActive("light.proj", lightCamera->proj);
-                    program->setUniformIfActive("light.fov", lightCamera->fov);
-                } else {
-                    program->setUniformIfActive("light.hasShadowMap", false);
-                    program->setUniformIfActive("light.fov", 20.0f); // More than 2*Pi
-                }
-            }
-        }
+
+uint32_t Model::lightShaderFeatures(const Light &light, const LightCamera *lightCamera) {
+    uint32_t features = 0;
+    if (light.type == Light::Type::spot)
+        features |= NUGL::ShaderFeatures::spotlight;
+    if (light.type == Light::Type::directional)
+        features |= NUGL::ShaderFeatures::directionalLight;
+    if (lightCamera != nullptr)
+        features |= NUGL::ShaderFeatures::shadowMap;
+    return features;
+}
+
+void Model::setLightUniformsOnShaderProgram(NUGL::StreamBuffer &stream, std::shared_ptr<NUGL::ShaderProgram> program,
+        const Light &light, const LightCamera *lightCamera) {
+    if (program == nullptr || !program->uniformBlockIsActive("LightBlock"))
+        return;
+
+    stream.writeAndBind(lightBlockBinding, LightBlock(light, lightCamera));
+
+    if (lightCamera != nullptr && program->uniformIsActive("lightTexShadowMap")) {
+        program->use();
+        program->setUniform("lightTexShadowMap", lightCamera->shadowMap);
     }
 }
 
@@ -547,6 +795,11 @@ void Model::setEnvironmentMap(std::shared_ptr<NUGL::Texture> envMap) {
     for (auto &mesh : meshes) {
         mesh.material->texEnvironmentMap = envMap;
         mesh.material->materialInfo.has.texEnvironmentMap = true;
+        mesh.invalidateMaterialBinders();
+    }
+
+    for (auto &batch : drawBatches) {
+        batch.boundPrograms.clear();
     }
 }
 
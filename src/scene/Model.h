@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <iostream>
 #include <glm/glm.hpp>
 
 #include "NUGL/Buffer.h"
@@ -8,9 +9,14 @@
 #include "NUGL/VertexArray.h"
 #include "NUGL/ShaderProgram.h"
 #include "scene/Mesh.h"
+#include "scene/MeshOptimizer.h"
 #include "scene/Light.h"
 #include "scene/Camera.h"
 #include "scene/Material.h"
+#include "scene/GeometryPool.h"
+#include "scene/TextureCache.h"
+#include "NUGL/StreamBuffer.h"
+#include "utility/math/TransformStore.h"
 
 namespace scene {
     class Model {
@@ -21,6 +27,47 @@ namespace scene {
             glm::mat4 transform;
         };
 
+        //! A node of the flattened hierarchy. Nodes are stored depth-first, so parents precede their children.
+        struct FlatNode {
+            int parent; // -1 for the root node.
+            std::vector<int> meshes;
+            glm::mat4 local; // The node's transform relative to its parent.
+            glm::mat4 model; // The node's transform relative to the model.
+            glm::mat4 world; // The node's world transform, including the model's position decode.
+        };
+
+        /**
+         * Meshes that share a geometry buffer, material, and shader program, from any of the model's nodes.
+         *
+         * The meshes are stored in node order. Each run of meshes on one node is submitted with a single
+         * glMultiDrawElementsBaseVertex call, with that node's object block bound (Scene::buildBatches also merges
+         * batches that share their state across models).
+         */
+        struct DrawBatch {
+            //! A program variant the batch is drawn with, resolved by bindBatch the first time it is requested.
+            struct BoundProgram {
+                std::shared_ptr<NUGL::ShaderProgram> requested; // The program passed to bindBatch.
+                uint32_t features; // The material's and the light's features.
+                std::shared_ptr<NUGL::ShaderProgram> variant;
+                GLint shadowMapLocation; // -1 if the variant does not sample a shadow map.
+                bool lit; // Whether the variant reads the light (i.e. its LightBlock is active).
+                MaterialBinder binder; // Binds the batch's material to the variant.
+            };
+
+            std::shared_ptr<Material> material;
+            std::shared_ptr<NUGL::ShaderProgram> program;
+            GeometryBuffer *geometryBuffer = nullptr;
+
+            std::vector<int> meshes;
+            std::vector<int> nodes; // The node that each mesh is drawn with.
+            std::vector<GLsizei> counts;
+            std::vector<const GLvoid *> indexOffsets;
+            std::vector<GLint> baseVertices;
+
+            // Only a few programs and light types are used per batch, so they are found by a linear search.
+            std::vector<BoundProgram> boundPrograms;
+        };
+
         Model() = delete;
 
         Model(std::string modelName) {
@@ -33,6 +80,8 @@ namespace scene {
         std::vector<std::shared_ptr<Light>> lights;
         std::vector<std::shared_ptr<Material>> materials;
         Node rootNode;
+        std::vector<FlatNode> nodes; // Flattened from rootNode by createVertexArrays.
+        std::vector<DrawBatch> drawBatches;
 
         std::shared_ptr<NUGL::ShaderProgram> flatProgram;
         std::shared_ptr<NUGL::ShaderProgram> textureProgram;
@@ -45,38 +94,129 @@ namespace scene {
 
         bool hidden = false;
 
+        //! Per-draw uniform blocks are written to this buffer (set by Scene::addModel).
+        std::shared_ptr<NUGL::StreamBuffer> uniformStream;
+
+        // The nodes' world transforms are stored at [firstTransform, firstTransform + numTransforms) in the store.
+        utility::math::TransformStore *transformStore = nullptr;
+        int firstTransform = 0;
+        int numTransforms = 0;
+
         glm::vec3 pos = {0, 0, 0}; // The object's position in world space.
         glm::vec3 dir = {1, 0, 0}; // The object's x-axis in world space.
         glm::vec3 up  = {0, 0, 1}; // Along with 'dir', defines the plane containing the object's z-axis.
         glm::vec3 scale = {1, 1, 1}; // Scale along each of the object's axes.
-        glm::mat4 transform; // Model transform generated from the above components.
+        glm::mat4 transform; // Model transform generated from the above components (cached by updateTransforms).
+        glm::mat4 positionDecode; // Maps the meshes' quantized vertex positions to object space.
+
+        //! The vertex cache statistics of all of the model's meshes, before and after createMeshBuffers optimized them.
+        MeshOptimizationResult meshStatistics;
 
         glm::mat4 buildModelTransform(glm::vec3 pos, glm::vec3 dir, glm::vec3 up, glm::vec3 scale);
         glm::mat4 modelTransform() {
             return buildModelTransform(pos, dir, up, scale);
         }
 
-        void createMeshBuffers();
-
+        /**
+         * Optimizes the meshes for the vertex cache and vertex fetch (recording meshStatistics, and printing its
+         * ACMR and ATVR), then appends them to the pool in compact vertex formats, quantized against the model's bounds.
+         */
+        void createMeshBuffers(GeometryPool &pool);
+
+        /**
+         * Returns a model that draws this model's geometry, which must already be in a GeometryPool (see
+         * createMeshBuffers), so that models loaded from the same file share one copy. The instance has its own
+         * transform, and copies of the model's nodes, lights, and materials (which share their textures). Call
+         * createVertexArrays on the instance, but not createMeshBuffers.
+         */
+        std::shared_ptr<Model> createInstance() const;
+
+        /**
+         * Makes the model use another instance's materials (of the same model), so that their meshes can be drawn
+         * in the same batches. Must be called before createVertexArrays.
+         */
+        void shareMaterials(const Model &other);
+
+        //! Selects each mesh's shader program, and groups the meshes into draw batches.
         void createVertexArrays();
 
-        void draw(Camera &camera, std::shared_ptr<Light> light, std::shared_ptr<LightCamera> lightCamera, bool transparentOnly = false);
-        void drawNode(Model::Node &node, glm::mat4 parentModel, Camera &camera, std::shared_ptr<Light> light,
-                std::shared_ptr<LightCamera> lightCamera, bool transparentOnly = false);
+        void flattenNodes();
+        void flattenNode(Model::Node &node, int parent);
+        void buildDrawBatches();
+
+        //! Replaces the local transform of a node in the flattened hierarchy.
+        void setNodeTransform(int nodeIndex, const glm::mat4 &transform);
+
+        /**
+         * Recomputes the cached model and node world transforms, if the model has moved or a node
+         * transform has changed since the last update.
+         */
+        void updateTransforms();
+
+        //! Reserves space for the model's node transforms in the store. Throws if createVertexArrays has not been called.
+        void attachTransformStore(utility::math::TransformStore &store);
+
+        /**
+         * Returns the world space bounds of the model's meshes, computed from the cached node transforms. The
+         * bounds are cached too, and only recomputed after updateTransforms has changed the transforms.
+         */
+        void computeWorldBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax);
+
+        // objectBlocks is the offset of the camera's object blocks in the uniform stream (see Scene::prepareObjectBlocks).
+        void draw(Camera &camera, GLintptr objectBlocks, std::shared_ptr<NUGL::ShaderProgram> program, bool transparentOnly = false);
+
+        /**
+         * Uses the variant of the program for the batch's material and the light's features (see
+         * lightShaderFeatures), and binds the batch's material, vertex array, and the light's shadow map to it. The
+         * variant, its shadow map uniform, and its material binder are found once per program and feature set (see
+         * DrawBatch::boundPrograms). Returns false, binding nothing, if the variant has not finished linking (see NUGL::ShaderProgram::isLinkComplete),
+         * or if litOnly is set and the variant does not read the light (so that light passes skip unlit materials,
+         * which are drawn once with the light-independent terms).
+         */
+        bool bindBatch(DrawBatch &batch, std::shared_ptr<NUGL::ShaderProgram> program, uint32_t lightFeatures,
+                const LightCamera *lightCamera, bool litOnly = false);
+
+        //! Imports the model and loads its textures.
+        static std::shared_ptr<Model> loadFromFile(const std::string &fileName);
 
-        void draw(Camera &camera, std::shared_ptr<NUGL::ShaderProgram> program, bool transparentOnly = false);
-        void drawNodeWithProgram(Model::Node &node, glm::mat4 parentModel, Camera &camera, std::shared_ptr<NUGL::ShaderProgram> program, bool transparentOnly = false);
+        /**
+         * Imports the model's meshes, materials, lights, and node hierarchy, without making any GL calls, so that
+         * models can be imported on worker threads. The materials' textures are loaded later, by loadTextures.
+         * Progress and warnings are written to the log.
+         */
+        static std::shared_ptr<Model> importFromFile(const std::string &fileName, std::ostream &log = std::cout);
 
-        static std::shared_ptr<Model> loadFromFile(const std::string &fileName);
+        //! Loads the textures referenced by the model's materials (on the thread that owns the GL context).
+        void loadTextures();
 
-        static std::shared_ptr<Model> createIcosahedron();
+        //! Decodes the images of the model's materials into the cache (safe to call from worker threads).
+        void decodeTextures(TextureCache &cache, std::ostream &log) const;
 
-        void setEnvironmentMap(std::shared_ptr<NUGL::Texture> envMap);
+        //! Loads the textures referenced by the model's materials from the cache, sharing them with other models.
+        void loadTextures(TextureCache &cache);
 
-        void setCameraUniformsOnShaderPrograms(Camera &camera, glm::mat4 model);
+        static std::shared_ptr<Model> createIcosahedron();
 
-        static void setLightUniformsOnShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program, std::shared_ptr<Light> light, std::shared_ptr<LightCamera> lightCamera);
+        //! Sets the environment map of every mesh's material, discarding the material binders recorded for them.
+        void setEnvironmentMap(std::shared_ptr<NUGL::Texture> envMap);
 
-        void setCameraUniformsOnShaderProgram(std::shared_ptr<NUGL::ShaderProgram> program, Camera &camera, glm::mat4 model);
+        //! The shader features of the light (its type, and whether it has a shadow map), for choosing program variants.
+        static uint32_t lightShaderFeatures(const Light &light, const LightCamera *lightCamera);
+
+        //! Writes the light's uniform block to the stream, and binds the light's shadow map to the program.
+        static void setLightUniformsOnShaderProgram(NUGL::StreamBuffer &stream, std::shared_ptr<NUGL::ShaderProgram> program,
+                const Light &light, const LightCamera *lightCamera);
+
+    private:
+        // The components the cached transforms were last computed from:
+        bool transformsValid = false;
+        bool nodesDirty = true;
+        bool boundsValid = false; // Whether worldBoundsMin and worldBoundsMax match the cached transforms.
+        glm::vec3 worldBoundsMin;
+        glm::vec3 worldBoundsMax;
+        glm::vec3 lastPos;
+        glm::vec3 lastDir;
+        glm::vec3 lastUp;
+        glm::vec3 lastScale;
     };
 }
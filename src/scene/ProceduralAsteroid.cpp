@@ -62,12 +62,11 @@ static void subdivide(std::mt19937 &gen, scene::Mesh &mesh, float noiseFactor) {
     mesh.elements = newElements;
 }
 
-std::shared_ptr<Model> createAsteroid(float baseNoise, float subDivisionNoise, int subdivisions) {
+std::shared_ptr<Model> createAsteroid(float baseNoise, float subDivisionNoise, int subdivisions, unsigned seed) {
     auto model = scene::Model::createIcosahedron();
     Mesh &mesh = model->meshes[0];
 
-    std::random_device rd;
-    std::mt19937 mt(rd());
+    std::mt19937 mt(seed);
     std::uniform_real_distribution<float> distrib(-1, 1);
 
     for (unsigned i = 0; i < mesh.vertices.size(); i ++)
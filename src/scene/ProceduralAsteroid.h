@@ -3,5 +3,6 @@
 #include <memory>
 
 namespace scene {
-    std::shared_ptr<Model> createAsteroid(float baseNoise, float subDivisionNoise, int subdivisions);
+    //! Creates a randomly deformed icosphere. The same seed always produces the same asteroid.
+    std::shared_ptr<Model> createAsteroid(float baseNoise, float subDivisionNoise, int subdivisions, unsigned seed);
 }
@@ -1,10 +1,16 @@
 #include "scene/Scene.h"
 #include <tuple>
+#include <map>
+#include <algorithm>
+#include <cassert>
+#include <limits>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "NUGL/Framebuffer.h"
 #include "NUGL/Renderbuffer.h"
 #include "utility/PostprocessingScreen.h"
+#include "scene/UniformBlocks.h"
+#include "utility/AllocationCounter.h"
 
 namespace scene {
 
@@ -24,6 +30,8 @@ namespace scene {
         prepareGBuffer(windowSize);
 
         screen = std::make_unique<utility::PostprocessingScreen>(screenProgram, screenAlphaProgram);
+
+        uniformStream = std::make_shared<NUGL::StreamBuffer>(GL_UNIFORM_BUFFER);
     }
 
     void Scene::prepareFramebuffer(glm::ivec2 size) {
@@ -136,26 +144,26 @@ namespace scene {
         NUGL::Framebuffer::useDefault();
     }
 
-    void Scene::renderReflectionMap(std::shared_ptr<Model> model) {
-        std::shared_ptr<Camera> mapCamera = std::make_shared<Camera>();
+    void Scene::renderReflectionMap(Renderable &renderable, Model &model) {
+        Camera mapCamera;
         // TODO: Add actual renderReflectionMap origin offset.
-        glm::vec4 pos = model->transform * glm::vec4(0, 0, 1.2, 1);
-        mapCamera->pos = {pos.x, pos.y, pos.z};
-        mapCamera->dir = {0, -1, 0};
-        mapCamera->up = {0, 0, -1};
-        mapCamera->fov = M_PI_2;
-        mapCamera->frameWidth = reflectionMapSize;
-        mapCamera->frameHeight = reflectionMapSize;
-        mapCamera->near_ = 1;
-        mapCamera->prepareTransforms();
-
-        auto sharedLight = std::make_shared<scene::Light>();
-        sharedLight->type = scene::Light::Type::point;
-        sharedLight->colDiffuse = {0, 0, 0};
-        sharedLight->colSpecular = {0, 0, 0};
-        sharedLight->colAmbient = {1, 1, 1};
-
-        std::vector<std::tuple<GLenum, glm::vec3, glm::vec3>> directions = {
+        glm::vec4 pos = model.transform * glm::vec4(0, 0, 1.2, 1);
+        mapCamera.pos = {pos.x, pos.y, pos.z};
+        mapCamera.dir = {0, -1, 0};
+        mapCamera.up = {0, 0, -1};
+        mapCamera.fov = M_PI_2;
+        mapCamera.frameWidth = reflectionMapSize;
+        mapCamera.frameHeight = reflectionMapSize;
+        mapCamera.near_ = 1;
+        mapCamera.prepareTransforms();
+
+        scene::Light ambientLight;
+        ambientLight.type = scene::Light::Type::point;
+        ambientLight.colDiffuse = {0, 0, 0};
+        ambientLight.colSpecular = {0, 0, 0};
+        ambientLight.colAmbient = {1, 1, 1};
+
+        static const std::tuple<GLenum, glm::vec3, glm::vec3> directions[] = {
 //                std::make_tuple<GLenum, glm::vec3, glm::vec3>(GL_TEXTURE_CUBE_MAP_POSITIVE_X, {0, -1, 0}, {0, 0, -1}),
 //                std::make_tuple<GLenum, glm::vec3, glm::vec3>(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, {0,  1, 0}, {0, 0, -1}),
 //                std::make_tuple<GLenum, glm::vec3, glm::vec3>(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, {0, 0,  1}, {-1, 0, 0}),
@@ -175,39 +183,68 @@ namespace scene {
 
             // Render one face each frame:
             static int i = 0;
-            i = (i + 1) % directions.size();
-            auto params = directions[i];
+            i = (i + 1) % 6;
+            auto &params = directions[i];
 
             GLenum target;
-            std::tie(target, mapCamera->dir, mapCamera->up) = params;
+            std::tie(target, mapCamera.dir, mapCamera.up) = params;
 
-            mapCamera->prepareTransforms();
-            reflectionFramebuffer->attach(model->texEnvironmentMap, target);
+            mapCamera.prepareTransforms();
+            reflectionFramebuffer->attach(model.texEnvironmentMap, target);
 
             reflectionFramebuffer->bind();
-            glViewport(0, 0, mapCamera->frameWidth, mapCamera->frameHeight);
+            glViewport(0, 0, mapCamera.frameWidth, mapCamera.frameHeight);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+            // The model does not reflect itself:
+            bool hidden = renderable.hidden;
+            renderable.hidden = true;
+
             if (forwardRenderReflections) {
-                model->hidden = true;
-                profiler.push("forwardRenderReflections");
-                forwardRender(reflectionFramebuffer, {mapCamera->frameWidth, mapCamera->frameHeight}, mapCamera);
+                profiler.push(PROFILER_LABEL("forwardRenderReflections"));
+                forwardRender(reflectionFramebuffer, {mapCamera.frameWidth, mapCamera.frameHeight}, mapCamera);
                 profiler.pop();
-                model->hidden = false;
             } else {
-                for (auto drawModel : models) {
-                    if (model == drawModel)
-                        continue;
+                selectRenderables(nullptr);
+                GLintptr mapObjectBlocks = prepareObjectBlocks(mapCamera);
+                drawLightIndependent(false, mapCamera, mapObjectBlocks);
 
-                    drawModel->draw(*mapCamera, sharedLight, nullptr);
-                }
+                // Add the ambient light over the light-independent terms:
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                glDepthFunc(GL_LEQUAL);
+                glDepthMask(GL_FALSE);
+                drawModels(ambientLight, nullptr, false, mapCamera, mapObjectBlocks);
+                glDepthMask(GL_TRUE);
+                glDepthFunc(GL_LESS);
+                glDisable(GL_BLEND);
             }
+
+            renderable.hidden = hidden;
 //        }
     }
 
     void Scene::render() {
         glClearColor(0, 0, 0, 1.0);
-        profiler.split("other");
+        profiler.split(PROFILER_LABEL("other"));
+
+        size_t allocationsBefore = utility::AllocationCounter::count();
+        frameArena.reset();
+        uniformStream->beginFrame();
+
+        if (batchesDirty) {
+            utility::ScopedAllowAllocations allow;
+            buildBatches();
+        }
+
+        // Every pass reads the cached model and node transforms:
+        auto renderable = renderables.begin();
+        for (auto &model : models) {
+            model->updateTransforms();
+            model->computeWorldBounds(renderable->boundsMin, renderable->boundsMax);
+            renderable->hidden = model->hidden;
+            ++renderable;
+        }
 
         renderDynamicReflectionMaps();
 
@@ -219,7 +256,16 @@ namespace scene {
         if (useDeferredRendering)
             deferredRender();
         else
-            forwardRender(nullptr, framebufferSize, camera);
+            forwardRender(nullptr, framebufferSize, *camera);
+
+        uniformStream->endFrame();
+
+        size_t frameAllocations = utility::AllocationCounter::count() - allocationsBefore;
+        if (++frameNumber > allocationWarmupFrames && frameAllocations != 0) {
+            std::cerr << __FILE__ << ", " << __LINE__ << ": Frame " << frameNumber << " performed "
+                    << frameAllocations << " heap allocations." << std::endl;
+            assert(!assertNoAllocations);
+        }
 
         profiler.printEvery(1);
     }
@@ -242,23 +288,14 @@ namespace scene {
         glViewport(0, 0, camera->frameWidth, camera->frameHeight);
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
-        drawModels(gBufferProgram, *camera);
+        selectRenderables(nullptr);
+        GLintptr cameraObjectBlocks = prepareObjectBlocks(*camera);
+        drawModels(gBufferProgram, *camera, cameraObjectBlocks);
         glDisable(GL_CULL_FACE);
 
-        profiler.split("render g-buffer");
+        profiler.split(PROFILER_LABEL("render g-buffer"));
 
-        // Attach g-buffer uniforms to the deferred shaders:
         gBuffer->bindTextures();
-        deferredShadingProgram->use();
-        deferredShadingProgram->setUniform("texDepthStencil", gBuffer->textureAttachments[GL_DEPTH_STENCIL_ATTACHMENT]);
-        deferredShadingProgram->setUniform("texNormal", gBuffer->textureAttachments[GL_COLOR_ATTACHMENT0]);
-        deferredShadingProgram->setUniform("texAlbedoRoughness", gBuffer->textureAttachments[GL_COLOR_ATTACHMENT1]);
-        deferredShadingProgram->setUniform("texEnvMapColSpecIntensity", gBuffer->textureAttachments[GL_COLOR_ATTACHMENT2]);
-        glm::mat4 projInverse = glm::inverse(camera->proj);
-        deferredShadingProgram->setUniform("projInverse", projInverse);
-        glm::mat4 viewInverse = glm::inverse(camera->view);
-        deferredShadingProgram->setUniform("viewInverse", viewInverse);
-        deferredShadingProgram->setUniform("view", camera->view);
 
         // Clear the framebuffer:
         framebuffer->bind();
@@ -274,11 +311,11 @@ namespace scene {
 
         // Run the deferred shader over the framebuffer for each light:
         int lightNum = 1;
-        for (auto light : lights) {
-            auto sharedLight = light.lock();
+        for (auto &sceneLight : lights) {
+            Light &light = *sceneLight.light;
 
-            if (sharedLight->enabled) {
-                auto lightCamera = prepareShadowMap(lightNum, sharedLight);
+            if (light.enabled) {
+                auto lightCamera = prepareShadowMap(lightNum, light);
 
                 framebuffer->bind();
                 glViewport(0, 0, camera->frameWidth, camera->frameHeight);
@@ -287,25 +324,38 @@ namespace scene {
                 gBuffer->bindTextures();
                 screen->setTexture(framebuffer->textureAttachments[GL_COLOR_ATTACHMENT0]);
 
-                Model::setLightUniformsOnShaderProgram(deferredShadingProgram, sharedLight, lightCamera);
+                // The shadow map pass rebinds the camera block to the light's camera:
+                uniformStream->writeAndBind(cameraBlockBinding, CameraBlock(*camera));
+                // Attach g-buffer uniforms to the light's variant of the deferred shader:
+                auto lightProgram = deferredShadingProgram->variant(Model::lightShaderFeatures(light, lightCamera));
+                if (!lightProgram->isLinkComplete()) {
+                    lightNum++;
+                    continue; // Skipped until the driver has compiled the variant.
+                }
+                lightProgram->use();
+                lightProgram->setUniform("texDepthStencil", gBuffer->textureAttachments[GL_DEPTH_STENCIL_ATTACHMENT]);
+                lightProgram->setUniform("texNormal", gBuffer->textureAttachments[GL_COLOR_ATTACHMENT0]);
+                lightProgram->setUniform("texAlbedoRoughness", gBuffer->textureAttachments[GL_COLOR_ATTACHMENT1]);
+                lightProgram->setUniform("texEnvMapColSpecIntensity", gBuffer->textureAttachments[GL_COLOR_ATTACHMENT2]);
+                Model::setLightUniformsOnShaderProgram(*uniformStream, lightProgram, light, lightCamera);
 
                 glEnable(GL_BLEND);
                 glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-                screen->render(deferredShadingProgram);
+                screen->render(lightProgram);
                 glDisable(GL_BLEND);
 
-                profiler.split("deferred light ", lightNum);
+                profiler.split(PROFILER_LABEL("deferred light "), lightNum);
 
 //            // Add the light's contribution to the screen:
 //            addFramebufferToTarget();
 
                 // Render a tiny shadow map:
-                if (!previewOptions.disable && (sharedLight->type == scene::Light::Type::spot ||
-                        sharedLight->type == scene::Light::Type::directional)) {
+                if (!previewOptions.disable && (light.type == scene::Light::Type::spot ||
+                        light.type == scene::Light::Type::directional)) {
                     drawShadowMapThumbnail(lightNum - 1);
                 }
 
-                profiler.split("drawShadowMapThumbnail ", lightNum);
+                profiler.split(PROFILER_LABEL("drawShadowMapThumbnail "), lightNum);
             }
 
             lightNum++;
@@ -319,17 +369,23 @@ namespace scene {
         framebuffer->attach(gBuffer->textureAttachments[GL_DEPTH_STENCIL_ATTACHMENT], GL_TEXTURE_2D, GL_DEPTH_STENCIL_ATTACHMENT);
 
         // Draw skybox first:
-        skyBox->draw(*camera, skyBox->environmentMapProgram);
+        skyBox->draw(*camera, cameraObjectBlocks, skyBox->environmentMapProgram);
 
         // Draw all transparent meshes:
         // Disable depth buffer writes (for order invariant drawing):
         glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        drawLightIndependent(true, *camera, cameraObjectBlocks);
+        glDisable(GL_BLEND);
+
         lightNum = 1;
-        for (auto light : lights) {
-            auto sharedLight = light.lock();
+        for (auto &sceneLight : lights) {
+            Light &light = *sceneLight.light;
 
-            if (sharedLight->enabled) {
-                auto lightCamera = prepareShadowMap(lightNum, sharedLight);
+            // Lights that reach none of the models add nothing, so their passes (and shadow maps) are skipped:
+            if (light.enabled && selectRenderables(&light) != 0) {
+                auto lightCamera = prepareShadowMap(lightNum, light);
 
                 framebuffer->bind();
                 glViewport(0, 0, camera->frameWidth, camera->frameHeight);
@@ -339,10 +395,10 @@ namespace scene {
 //            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                 checkForAndPrintGLError(__FILE__, __LINE__);
 
-                drawModels(sharedLight, lightCamera, true, *camera);
+                drawModels(light, lightCamera, true, *camera, cameraObjectBlocks);
                 glDisable(GL_BLEND);
 
-                profiler.split("transparent: light ", lightNum);
+                profiler.split(PROFILER_LABEL("transparent: light "), lightNum);
             }
 
             lightNum++;
@@ -355,7 +411,7 @@ namespace scene {
         framebuffer->attach(std::move(framebuffer->renderbufferAttachment));
 
 
-        profiler.split("deferred lighting");
+        profiler.split(PROFILER_LABEL("deferred lighting"));
 
         if (previewOptions.disable) {
             addFramebufferToTarget(framebufferSize, nullptr);
@@ -369,23 +425,92 @@ namespace scene {
             drawGBufferThumbnails();
     }
 
-    void Scene::forwardRender(std::shared_ptr<NUGL::Framebuffer> target, glm::ivec2 targetSize, std::shared_ptr<Camera> camera) {
+    void Scene::forwardRender(std::shared_ptr<NUGL::Framebuffer> target, glm::ivec2 targetSize, Camera &camera) {
+        // Every pass draws a subset of the models that are not hidden:
+        selectRenderables(nullptr);
+        GLintptr cameraObjectBlocks = prepareObjectBlocks(camera);
+
+        // The sky box's vertex shader fixes it to the far plane (see skybox.vert), which the depth pre-pass does not
+        // reproduce, so it is kept out of the depth tested passes, and drawn after the light-independent terms:
+        Renderable *skyBoxRenderable = findRenderable(skyBox.get());
+        bool skyBoxHidden = true;
+        if (skyBoxRenderable != nullptr) {
+            skyBoxHidden = skyBoxRenderable->hidden;
+            skyBoxRenderable->hidden = true;
+        }
+
+        if (forwardDepthPrepass) {
+            // Lay down the depth of the opaque geometry once, using the shadow map program (which only reads
+            // positions), so that each light pass only shades the visible surfaces:
+            framebuffer->bind();
+            glViewport(0, 0, camera.frameWidth, camera.frameHeight);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            drawModels(shadowMapProgram, camera, cameraObjectBlocks);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            profiler.split(PROFILER_LABEL("depth pre-pass"));
+        }
+
+        // Draw the terms that do not depend on the light (environment map reflections, and unlit materials) once,
+        // rather than adding them in every light pass (as the deferred renderer does with the g-buffer):
+        framebuffer->bind();
+        glViewport(0, 0, camera.frameWidth, camera.frameHeight);
+        if (forwardDepthPrepass) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        } else {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        drawLightIndependent(false, camera, cameraObjectBlocks);
+
+        if (!skyBoxHidden) {
+            // Only where nothing else was drawn (its object block was written above, while it was selected):
+            glDepthFunc(GL_LEQUAL);
+            glDepthMask(GL_FALSE);
+            skyBox->draw(camera, cameraObjectBlocks, skyBox->environmentMapProgram);
+        }
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+
+        addFramebufferToTarget(targetSize, target);
+
+        profiler.split(PROFILER_LABEL("light-independent pass"));
+
         int lightNum = 1;
-        for (auto light : lights) {
-            profiler.push("light ", lightNum);
+        for (auto &sceneLight : lights) {
+            profiler.push(PROFILER_LABEL("light "), lightNum);
 
-            auto sharedLight = light.lock();
+            Light &light = *sceneLight.light;
 
-            if (sharedLight->enabled) {
-                auto lightCamera = prepareShadowMap(lightNum, sharedLight);
+            // Lights that reach none of the models add nothing, so their passes (and shadow maps) are skipped:
+            if (light.enabled && selectRenderables(&light) != 0) {
+                auto lightCamera = prepareShadowMap(lightNum, light);
 
                 // Render the light's contribution to the framebuffer:
                 framebuffer->bind();
-                glViewport(0, 0, camera->frameWidth, camera->frameHeight);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-                drawModels(sharedLight, lightCamera, false, *camera);
+                glViewport(0, 0, camera.frameWidth, camera.frameHeight);
+                if (forwardDepthPrepass) {
+                    // Only shade the fragments that won the pre-pass (the vertex shaders declare gl_Position
+                    // invariant, so that their depths match exactly):
+                    glClear(GL_COLOR_BUFFER_BIT);
+                    glDepthFunc(GL_EQUAL);
+                    glDepthMask(GL_FALSE);
+                } else {
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                }
+
+                drawModels(light, lightCamera, false, camera, cameraObjectBlocks);
+
+                if (forwardDepthPrepass) {
+                    glDepthFunc(GL_LESS);
+                    glDepthMask(GL_TRUE);
+                }
 
-                profiler.split("drawModels");
+                profiler.split(PROFILER_LABEL("drawModels"));
 
                 // Add the light's contribution to the screen:
                 addFramebufferToTarget(targetSize, target);
@@ -394,12 +519,24 @@ namespace scene {
                 if (!previewOptions.disable)
                     drawShadowMapThumbnail(lightNum - 1);
 
-                profiler.split("addFramebufferToTarget");
+                profiler.split(PROFILER_LABEL("addFramebufferToTarget"));
             }
 
             lightNum++;
             profiler.pop();
         }
+
+        if (skyBoxRenderable != nullptr)
+            skyBoxRenderable->hidden = skyBoxHidden;
+    }
+
+    Renderable *Scene::findRenderable(const Model *model) {
+        for (size_t i = 0; i < models.size(); i++) {
+            if (models[i].get() == model)
+                return &renderables.begin()[i];
+        }
+
+        return nullptr;
     }
 
     void Scene::drawGBufferThumbnails() {
@@ -422,7 +559,7 @@ namespace scene {
             texNum++;
         }
 
-        profiler.split("g-buffer thumbnails");
+        profiler.split(PROFILER_LABEL("g-buffer thumbnails"));
     }
 
     void Scene::drawShadowMapThumbnail(int lightNum) {
@@ -462,11 +599,11 @@ namespace scene {
         glDisable(GL_BLEND);
     }
 
-    std::shared_ptr<LightCamera> Scene::prepareShadowMap(int lightNum, std::shared_ptr<Light> sharedLight) {
-        std::shared_ptr<LightCamera> lightCamera;
+    LightCamera *Scene::prepareShadowMap(int lightNum, Light &light) {
+        LightCamera *lightCamera = nullptr;
 
-        if (sharedLight->type == Light::Type::spot || sharedLight->type == scene::Light::Type::directional) {
-            lightCamera = LightCamera::fromLight(*sharedLight, shadowMapSize);
+        if (light.type == Light::Type::spot || light.type == scene::Light::Type::directional) {
+            lightCamera = frameArena.create<LightCamera>(LightCamera::fromLight(light, shadowMapSize));
             // Render light's perspective into shadowMap.
             shadowMapFramebuffer->bind();
             glViewport(0, 0, lightCamera->frameWidth, lightCamera->frameHeight);
@@ -478,62 +615,272 @@ namespace scene {
             glEnable(GL_CULL_FACE);
             glCullFace(GL_FRONT);
 
-            for (auto model : models) {
-                model->draw(*lightCamera, shadowMapProgram);
-            }
+            // Every model within the light's reach casts shadows, including hidden ones (those further away can
+            // only shadow surfaces that the light does not reach either):
+            selectRenderables(&light, true);
+            GLintptr lightObjectBlocks = prepareObjectBlocks(*lightCamera);
+            uniformStream->writeAndBind(cameraBlockBinding, CameraBlock(*lightCamera));
+            drawBatches(shadowMapProgram, 0, nullptr, false, lightObjectBlocks);
 
             glDisable(GL_CULL_FACE);
 
             lightCamera->shadowMap = shadowMapFramebuffer->textureAttachments[GL_DEPTH_ATTACHMENT];
 
-            profiler.split("shadow map ", lightNum);
+            profiler.split(PROFILER_LABEL("shadow map "), lightNum);
         }
 
         return lightCamera;
     }
 
-    void Scene::drawModels(std::shared_ptr<Light> sharedLight, std::shared_ptr<LightCamera> lightCamera, bool transparentOnly, Camera &camera) {
-        for (auto model : models) {
-            if (model->hidden)
+    size_t Scene::selectRenderables(const Light *light, bool includeHidden) {
+        float radius = (light != nullptr) ? light->influenceRadius() : std::numeric_limits<float>::infinity();
+
+        size_t index = 0;
+        size_t count = 0;
+        for (auto &renderable : renderables) {
+            bool visible = includeHidden || !renderable.hidden;
+
+            // Skip models that are out of the light's reach (i.e. whose bounds do not intersect its sphere of
+            // influence):
+            if (visible && radius < std::numeric_limits<float>::infinity()) {
+                glm::vec3 offset = glm::clamp(light->pos, renderable.boundsMin, renderable.boundsMax) - light->pos;
+                visible = glm::dot(offset, offset) <= radius * radius;
+            }
+
+            visibleRenderables[index++] = visible;
+            count += visible;
+        }
+
+        return count;
+    }
+
+    GLintptr Scene::prepareObjectBlocks(Camera &camera) {
+        if (transforms.size() == 0)
+            return 0;
+
+        // Blocks are addressed by transform index, so the whole store is mapped, but only the blocks of the
+        // selected renderables are computed (in as few runs as possible):
+        size_t stride = uniformStream->alignedSize(sizeof(ObjectBlock));
+        GLintptr offset;
+        void *blocks = uniformStream->map(transforms.size() * stride, offset);
+
+        int begin = 0;
+        int end = 0;
+        size_t index = 0;
+        for (auto &renderable : renderables) {
+            if (!visibleRenderables[index++])
                 continue;
 
-            model->draw(camera, sharedLight, lightCamera, transparentOnly);
+            if (renderable.firstTransform != end) {
+                transforms.computeViewTransforms(camera.view, camera.proj, blocks, stride, begin, end);
+                begin = renderable.firstTransform;
+            }
+            end = renderable.firstTransform + renderable.numTransforms;
+        }
+        transforms.computeViewTransforms(camera.view, camera.proj, blocks, stride, begin, end);
+
+        uniformStream->unmap();
+
+        return offset;
+    }
+
+    void Scene::drawModels(const Light &light, const LightCamera *lightCamera, bool transparentOnly, Camera &camera, GLintptr objectBlocks) {
+        selectRenderables(&light);
+
+        uniformStream->writeAndBind(cameraBlockBinding, CameraBlock(camera));
+        uniformStream->writeAndBind(lightBlockBinding, LightBlock(light, lightCamera));
+        drawBatches(nullptr, Model::lightShaderFeatures(light, lightCamera), lightCamera, transparentOnly, objectBlocks, true);
+    }
+
+    void Scene::drawLightIndependent(bool transparentOnly, Camera &camera, GLintptr objectBlocks) {
+        selectRenderables(nullptr);
+
+        uniformStream->writeAndBind(cameraBlockBinding, CameraBlock(camera));
+        drawBatches(nullptr, NUGL::ShaderFeatures::lightIndependent, nullptr, transparentOnly, objectBlocks);
+    }
+
+    void Scene::drawModels(std::shared_ptr<NUGL::ShaderProgram> program, Camera &camera, GLintptr objectBlocks) {
+        selectRenderables(nullptr);
+
+        uniformStream->writeAndBind(cameraBlockBinding, CameraBlock(camera));
+        drawBatches(program, 0, nullptr, false, objectBlocks);
+    }
+
+    void Scene::buildBatches() {
+        batches.clear();
+
+        // Batches are merged by their state. Meshes that are not in a shared geometry buffer each have their own
+        // vertex array, so their batches are never merged:
+        std::map<std::tuple<GeometryBuffer *, Material *, NUGL::ShaderProgram *>, size_t> batchIndices;
+
+        for (uint32_t index = 0; index < uint32_t(models.size()); index++) {
+            Model &model = *models[index];
+
+            for (auto &batch : model.drawBatches) {
+                size_t batchIndex = batches.size();
+                if (batch.geometryBuffer != nullptr) {
+                    auto key = std::make_tuple(batch.geometryBuffer, batch.material.get(), batch.program.get());
+                    batchIndex = batchIndices.emplace(key, batchIndex).first->second;
+                }
+
+                if (batchIndex == batches.size()) {
+                    batches.emplace_back();
+                    batches.back().model = &model;
+                    batches.back().batch = &batch;
+                    batches.back().indexType = model.meshes[batch.meshes[0]].vertexFormat.indexType;
+                }
+
+                SceneBatch &sceneBatch = batches[batchIndex];
+                for (size_t i = 0; i < batch.meshes.size(); i++) {
+                    sceneBatch.renderables.push_back(index);
+                    sceneBatch.transforms.push_back(model.firstTransform + batch.nodes[i]);
+                    sceneBatch.counts.push_back(batch.counts[i]);
+                    sceneBatch.indexOffsets.push_back(batch.indexOffsets[i]);
+                    sceneBatch.baseVertices.push_back(batch.baseVertices[i]);
+                }
+            }
         }
+
+        visibleRenderables.assign(renderables.size(), 1);
+        batchesDirty = false;
     }
 
-    void Scene::drawModels(std::shared_ptr<NUGL::ShaderProgram> program, Camera &camera) {
-        for (auto model : models) {
-            if (model->hidden)
+    void Scene::drawBatches(std::shared_ptr<NUGL::ShaderProgram> program, uint32_t lightFeatures,
+            const LightCamera *lightCamera, bool transparentOnly, GLintptr objectBlocks, bool litOnly) {
+        GLsizeiptr objectBlockStride = uniformStream->alignedSize(sizeof(ObjectBlock));
+
+        for (auto &sceneBatch : batches) {
+            Model::DrawBatch &batch = *sceneBatch.batch;
+            if (transparentOnly == (batch.material->opacity == 1))
                 continue;
 
-            model->draw(camera, program);
+            // The batch's state is only bound once one of its draws is visible (and the batch is skipped until its
+            // program is ready, or if litOnly is set and its program does not read the light):
+            bool bound = false;
+
+            size_t numDraws = sceneBatch.transforms.size();
+            for (size_t begin = 0, end; begin < numDraws; begin = end) {
+                GLint transform = sceneBatch.transforms[begin];
+                for (end = begin + 1; end < numDraws && sceneBatch.transforms[end] == transform; end++);
+
+                if (!visibleRenderables[sceneBatch.renderables[begin]])
+                    continue;
+
+                if (!bound) {
+                    if (!sceneBatch.model->bindBatch(batch, program != nullptr ? program : batch.program, lightFeatures,
+                            lightCamera, litOnly))
+                        break;
+                    bound = true;
+                }
+
+                uniformStream->bindRange(objectBlockBinding, objectBlocks + transform * objectBlockStride, sizeof(ObjectBlock));
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, &sceneBatch.counts[begin], sceneBatch.indexType,
+                        &sceneBatch.indexOffsets[begin], GLsizei(end - begin), &sceneBatch.baseVertices[begin]);
+                checkForAndPrintGLError(__FILE__, __LINE__);
+            }
         }
     }
 
     void Scene::renderDynamicReflectionMaps() {
         int refMapNum = 1;
-        for (auto model : models) {
-            if (!model->dynamicReflections)
+        for (size_t i = 0; i < models.size(); i++) {
+            Model &model = *models[i];
+            if (!model.dynamicReflections)
                 continue;
 
-            if (model->texEnvironmentMap == nullptr) {
+            if (model.texEnvironmentMap == nullptr) {
+                utility::ScopedAllowAllocations allow;
                 auto tex = createCubeMapTexture(reflectionMapSize);
-                model->setEnvironmentMap(move(tex));
+                model.setEnvironmentMap(move(tex));
             }
 
-            renderReflectionMap(model);
+            renderReflectionMap(renderables.begin()[i], model);
 
-            profiler.split("reflection map ", refMapNum++);
+            profiler.split(PROFILER_LABEL("reflection map "), refMapNum++);
         }
     }
 
-    void Scene::addModel(std::shared_ptr<Model> model) {
+    ModelHandle Scene::addModel(std::shared_ptr<Model> model) {
+        model->uniformStream = uniformStream;
+        model->attachTransformStore(transforms);
+
+        Renderable renderable;
+        renderable.firstTransform = model->firstTransform;
+        renderable.numTransforms = model->numTransforms;
+        renderable.boundsMin = renderable.boundsMax = model->pos;
+        renderable.hidden = model->hidden;
+        ModelHandle handle = renderables.insert(renderable);
         models.push_back(model);
+        batchesDirty = true;
 
-        for (auto light : model->lights) {
+        for (auto &light : model->lights) {
             light->dir = glm::normalize(light->dir);
-            std::weak_ptr<Light> weak(light);
-            lights.push_back(weak);
+
+            if (deferredShadingProgram != nullptr)
+                deferredShadingProgram->variant(Model::lightShaderFeatures(*light, nullptr) | lightShadowFeatures(*light));
+
+            SceneLight sceneLight;
+            sceneLight.light = light.get();
+            sceneLight.model = handle;
+            lights.insert(sceneLight);
+        }
+
+        requestShaderVariants(*model);
+
+        return handle;
+    }
+
+    uint32_t Scene::lightShadowFeatures(const Light &light) {
+        // Matches prepareShadowMap:
+        if (light.type == Light::Type::spot || light.type == Light::Type::directional)
+            return NUGL::ShaderFeatures::shadowMap;
+        return 0;
+    }
+
+    void Scene::requestShaderVariants(Model &model) {
+        static const uint32_t lightFeatures[] = {
+                NUGL::ShaderFeatures::spotlight | NUGL::ShaderFeatures::shadowMap,
+                NUGL::ShaderFeatures::directionalLight | NUGL::ShaderFeatures::shadowMap,
+                0, // Point lights, and the ambient light of reflection maps.
+                NUGL::ShaderFeatures::lightIndependent,
+        };
+
+        for (auto &batch : model.drawBatches) {
+            uint32_t features = model.meshes[batch.meshes[0]].shaderFeatures();
+            if (model.dynamicReflections)
+                features |= NUGL::ShaderFeatures::texEnvironmentMap; // Assigned on the first frame.
+
+            if (batch.program != nullptr) {
+                for (uint32_t light : lightFeatures)
+                    batch.program->variant(features | light);
+            }
+            if (gBufferProgram != nullptr)
+                gBufferProgram->variant(features);
+        }
+    }
+
+    void Scene::removeModel(ModelHandle handle) {
+        size_t index = renderables.denseIndexOf(handle);
+
+        // Iterate backwards, as erasing moves the last light into the erased light's place:
+        for (size_t i = lights.size(); i-- > 0;) {
+            LightHandle lightHandle = lights.handleAt(i);
+            if (lights[lightHandle].model == handle)
+                lights.erase(lightHandle);
         }
+
+        // Keep the models parallel to the renderables, whose last element is moved into the erased one's place:
+        renderables.erase(handle);
+        models[index] = std::move(models.back());
+        models.pop_back();
+
+        batchesDirty = true;
+    }
+
+    Model *Scene::getModel(ModelHandle handle) {
+        if (!renderables.contains(handle))
+            return nullptr;
+
+        return models[renderables.denseIndexOf(handle)].get();
     }
 }
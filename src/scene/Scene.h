@@ -3,15 +3,55 @@
 #include <memory>
 #include <vector>
 #include "scene/Model.h"
+#include "scene/GeometryPool.h"
 #include "scene/Camera.h"
 #include "scene/Light.h"
 #include "utility/make_unique.h"
 #include "utility/PostprocessingScreen.h"
 #include "utility/Profiler.h"
+#include "utility/math/TransformStore.h"
+#include "utility/SlotMap.h"
+#include "utility/FrameArena.h"
 #include "NUGL/Framebuffer.h"
+#include "NUGL/StreamBuffer.h"
 
 namespace scene {
 
+    typedef utility::SlotHandle ModelHandle;
+    typedef utility::SlotHandle LightHandle;
+
+    //! The data the render passes read for a model in the scene (whose Model is at the same index in Scene::models).
+    struct Renderable {
+        int firstTransform; // The model's node transforms are [firstTransform, firstTransform + numTransforms).
+        int numTransforms;
+        glm::vec3 boundsMin; // World space bounds, updated at the start of each frame.
+        glm::vec3 boundsMax;
+        bool hidden; // Copied from the model at the start of each frame.
+    };
+
+    /**
+     * Model draw batches that share a geometry buffer, material, and shader program, merged across models.
+     *
+     * Each draw names the renderable it belongs to and the transform (i.e. the object block) it is drawn with. The
+     * draws of one node are consecutive, and are submitted with a single glMultiDrawElementsBaseVertex call.
+     */
+    struct SceneBatch {
+        Model *model; // The model and batch that the shared state is bound from (see Model::bindBatch).
+        Model::DrawBatch *batch;
+        GLenum indexType;
+
+        std::vector<uint32_t> renderables; // Indices into the renderables' dense array.
+        std::vector<GLint> transforms;
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid *> indexOffsets;
+        std::vector<GLint> baseVertices;
+    };
+
+    struct SceneLight {
+        Light *light;
+        ModelHandle model; // The model the light is attached to.
+    };
+
     class Scene {
     public:
         Scene(std::shared_ptr<NUGL::ShaderProgram> screenProgram,
@@ -20,22 +60,54 @@ namespace scene {
                 glm::ivec2 framebufferSize);
 
         void render();
-        void forwardRender(std::shared_ptr<NUGL::Framebuffer> target, glm::ivec2 targetSize, std::shared_ptr<Camera> camera);
+        void forwardRender(std::shared_ptr<NUGL::Framebuffer> target, glm::ivec2 targetSize, Camera &camera);
         void deferredRender();
 
-        void addModel(std::shared_ptr<Model>);
+        //! Adds the model and its lights to the scene, which shares ownership of the model.
+        ModelHandle addModel(std::shared_ptr<Model>);
+
+        /**
+         * Removes the model and its lights from the scene. The model's slots in the transform store are not reused
+         * (no pass computes or draws them once its renderable is gone).
+         */
+        void removeModel(ModelHandle handle);
+
+        //! Returns the model, or nullptr if it has been removed.
+        Model *getModel(ModelHandle handle);
+
+        //! Returns the model's renderable (found by a linear search), or nullptr if the model is not in the scene.
+        Renderable *findRenderable(const Model *model);
 
         void prepareFramebuffer(glm::ivec2 windowSize);
         void prepareShadowMapFramebuffer(int size);
         void prepareReflectionFramebuffer(int size);
 
-        std::vector<std::shared_ptr<Model>> models;
+        /*
+         * The render passes iterate these arrays directly. Models are only touched when their transforms are
+         * updated at the start of each frame, and when their batches are bound.
+         */
+        utility::SlotMap<Renderable> renderables;
+        utility::SlotMap<SceneLight> lights;
+        std::vector<std::shared_ptr<Model>> models; // In the order of the renderables' dense array.
+
+        //! Shared buffers holding the static geometry of all models in the scene.
+        GeometryPool geometryPool;
+
+        //! Per-frame uniform block data for all models in the scene.
+        std::shared_ptr<NUGL::StreamBuffer> uniformStream;
+
+        //! The world transforms of every node of every model, in the order of their object blocks.
+        utility::math::TransformStore transforms;
+
+        //! The renderables' draw batches (rebuilt by render() when models are added or removed).
+        std::vector<SceneBatch> batches;
+        bool batchesDirty = false;
+
+        //! Whether each renderable (by its index in the dense array) is drawn by the current pass.
+        std::vector<uint8_t> visibleRenderables;
+
         std::shared_ptr<Model> skyBox;
 
-        /**
-         * Weak pointers to all lights attached to all models in the scene.
-         */
-        std::vector<std::weak_ptr<Light>> lights;
         std::shared_ptr<PlayerCamera> camera;
         std::unique_ptr<NUGL::Framebuffer> framebuffer;
         std::unique_ptr<NUGL::Framebuffer> shadowMapFramebuffer;
@@ -48,12 +120,25 @@ namespace scene {
 
         Profiler profiler;
 
+        //! Holds objects that only live for the current frame (e.g. light cameras). Reset at the start of render().
+        utility::FrameArena frameArena;
+
+        /*
+         * Debug builds warn about frames in which render() performs heap allocations, once this many frames have
+         * been rendered (see utility::AllocationCounter), and assert that there are none if assertNoAllocations is
+         * set.
+         */
+        unsigned allocationWarmupFrames = 60;
+        bool assertNoAllocations = true;
+        unsigned frameNumber = 0;
+
         int shadowMapSize = 1024;
         int reflectionMapSize = 128;
         glm::ivec2 windowSize = {800, 600};
         glm::ivec2 framebufferSize = {800, 600};
         bool useDeferredRendering = true;
         bool forwardRenderReflections = false;
+        bool forwardDepthPrepass = true; // Draw depth first, so that the forward renderer shades each pixel once per light.
         bool flashlightOn = false;
         bool paused = false;
         bool cameraLocked = true;
@@ -67,12 +152,53 @@ namespace scene {
 
         bool fpsMode = true;
 
-        void renderReflectionMap(std::shared_ptr<Model> shared_ptr);
+        void renderReflectionMap(Renderable &renderable, Model &model);
         void renderDynamicReflectionMaps();
 
-        void drawModels(std::shared_ptr<Light> sharedLight, std::shared_ptr<LightCamera> lightCamera, bool transparentOnly, Camera &camera);
+        /**
+         * Marks the renderables that the next pass draws (see visibleRenderables): those that are not hidden (unless
+         * includeHidden is set), and, given a light, that are within its reach. Returns how many were marked.
+         */
+        size_t selectRenderables(const Light *light, bool includeHidden = false);
+
+        /**
+         * Writes the ObjectBlocks of the selected renderables (see selectRenderables) as seen from the camera to the
+         * uniform stream, and returns the offset of the block of the first transform in the store (to be passed to
+         * drawModels and Model::draw). Passes that use the blocks must only draw renderables selected here.
+         */
+        GLintptr prepareObjectBlocks(Camera &camera);
+
+        //! Adds the light's contribution to the selected renderables that read the light (see Model::bindBatch).
+        void drawModels(const Light &light, const LightCamera *lightCamera, bool transparentOnly, Camera &camera, GLintptr objectBlocks);
+
+        /**
+         * Draws the terms of the visible renderables that do not depend on any light (see
+         * NUGL::ShaderFeatures::lightIndependent): environment map reflections, and the colours of unlit materials.
+         */
+        void drawLightIndependent(bool transparentOnly, Camera &camera, GLintptr objectBlocks);
+
+        //! Groups the draw batches of every renderable by their geometry buffer, material, and shader program.
+        void buildBatches();
+
+        /**
+         * Draws the batches of the visible renderables, with their own programs or the given one. The camera and
+         * light uniform blocks must already be bound. If litOnly is set, batches whose programs do not read the
+         * light are skipped.
+         */
+        void drawBatches(std::shared_ptr<NUGL::ShaderProgram> program, uint32_t lightFeatures,
+                const LightCamera *lightCamera, bool transparentOnly, GLintptr objectBlocks, bool litOnly = false);
+
+        //! Renders the light's shadow map, and returns its camera (allocated from the frame arena), or nullptr.
+        LightCamera *prepareShadowMap(int lightNum, Light &light);
+
+        //! The shadowMap feature if prepareShadowMap renders shadow maps for the light's type, otherwise 0.
+        static uint32_t lightShadowFeatures(const Light &light);
 
-        std::shared_ptr<LightCamera> prepareShadowMap(int lightNum, std::shared_ptr<Light> sharedLight);
+        /**
+         * Requests the program variants that the model's batches will be drawn with (see NUGL::ShaderFeatures), so
+         * that they are compiled while the scene loads rather than on the frame they are first drawn.
+         */
+        void requestShaderVariants(Model &model);
 
         void addFramebufferToTarget(glm::ivec2 targetSize, std::shared_ptr<NUGL::Framebuffer> target = nullptr, float gridDim = 1, float gridX = 0, float gridY = 0);
 
@@ -80,7 +206,7 @@ namespace scene {
 
         void prepareGBuffer(glm::ivec2 ivec2);
 
-        void drawModels(std::shared_ptr<NUGL::ShaderProgram> shared_ptr, Camera &camera);
+        void drawModels(std::shared_ptr<NUGL::ShaderProgram> shared_ptr, Camera &camera, GLintptr objectBlocks);
 
         void drawGBufferThumbnails();
     };
@@ -0,0 +1,592 @@
+#include "scene/SceneFile.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "utility/Json.h"
+#include "scene/ProceduralAsteroid.h"
+
+namespace scene {
+
+using utility::JsonValue;
+
+/**
+ * Runs model loading jobs on a pool of worker threads.
+ *
+ * The jobs must not make GL calls. Each job writes its messages to its own log, and wait() prints the logs in the
+ * order the jobs were added, so that output from different threads is not interleaved. Exceptions thrown by jobs are
+ * rethrown by wait(), so a missing file is reported the same way as it would be when loading on the main thread.
+ */
+class ParallelModelLoader {
+public:
+    typedef std::function<std::shared_ptr<Model>(std::ostream &log)> Job;
+
+    ~ParallelModelLoader() {
+        join();
+    }
+
+    //! Adds a job, returning the index of its result.
+    size_t add(Job job) {
+        jobs.push_back(std::move(job));
+        return jobs.size() - 1;
+    }
+
+    void start() {
+        results.resize(jobs.size());
+        errors.resize(jobs.size());
+        logs.resize(jobs.size());
+        nextJob = 0;
+
+        unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+        numThreads = std::min(numThreads, unsigned(jobs.size()));
+        for (unsigned i = 0; i < numThreads; i++) {
+            threads.emplace_back([this]() {
+                for (size_t job = nextJob++; job < jobs.size(); job = nextJob++) {
+                    std::stringstream log;
+                    try {
+                        results[job] = jobs[job](log);
+                    } catch (...) {
+                        errors[job] = std::current_exception();
+                    }
+                    logs[job] = log.str();
+                }
+            });
+        }
+    }
+
+    //! Waits for all jobs to finish, and returns their results in the order they were added.
+    std::vector<std::shared_ptr<Model>> &wait() {
+        join();
+
+        for (auto &log : logs) {
+            std::cout << log;
+        }
+        logs.clear();
+
+        for (auto &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        return results;
+    }
+
+private:
+    void join() {
+        for (auto &thread : threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+        threads.clear();
+    }
+
+    std::vector<Job> jobs;
+    std::vector<std::shared_ptr<Model>> results;
+    std::vector<std::exception_ptr> errors;
+    std::vector<std::string> logs;
+    std::atomic<size_t> nextJob;
+    std::vector<std::thread> threads;
+};
+
+//! Reads a vector given either as an array of three numbers, or as a single number for all three components.
+static glm::vec3 readVec3(const JsonValue &object, const std::string &key, glm::vec3 defaultValue) {
+    const JsonValue *value = object.find(key);
+    if (value == nullptr)
+        return defaultValue;
+
+    if (value->isNumber())
+        return glm::vec3(float(value->number));
+
+    if (!value->isArray() || value->size() != 3) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "'" << key << "' must be a number or an array of three numbers.";
+        throw std::invalid_argument(errMsg.str());
+    }
+
+    return glm::vec3((*value)[0].asNumber(), (*value)[1].asNumber(), (*value)[2].asNumber());
+}
+
+template<typename T>
+static std::shared_ptr<T> findNamed(const std::map<std::string, std::shared_ptr<T>> &objects,
+        const std::string &name, const char *kind) {
+    auto it = objects.find(name);
+    if (it == objects.end()) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "The scene file has no " << kind << " named '" << name << "'.";
+        throw std::invalid_argument(errMsg.str());
+    }
+    return it->second;
+}
+
+static std::shared_ptr<NUGL::ShaderProgram> loadProgram(const std::string &name, const JsonValue &desc) {
+    auto program = NUGL::ShaderProgram::createSharedFromFiles(name, {
+            {GL_VERTEX_SHADER, desc["vertex"].asString()},
+            {GL_FRAGMENT_SHADER, desc["fragment"].asString()},
+    });
+
+    if (desc.has("outputs")) {
+        const JsonValue &outputs = desc["outputs"];
+        for (size_t i = 0; i < outputs.size(); i++) {
+            program->bindFragDataLocation(GLuint(i), outputs[i].asString());
+        }
+    } else {
+        program->bindFragDataLocation(0, "outColor");
+    }
+
+    program->link(); // Finished when the program is first used, while the models load.
+    return program;
+}
+
+static std::shared_ptr<NUGL::Texture> loadEnvironmentMap(const JsonValue &desc) {
+    const JsonValue &faces = desc["faces"];
+    std::vector<std::string> faceFileNames;
+    for (size_t i = 0; i < faces.size(); i++) {
+        faceFileNames.push_back(faces[i].asString());
+    }
+
+    // TODO: Find a way to manage texture units!
+    auto cubeMap = std::make_shared<NUGL::Texture>(GL_TEXTURE0 + GLenum(desc.get("unit", 2.0)), GL_TEXTURE_CUBE_MAP);
+    cubeMap->loadCubeMap(faceFileNames);
+    cubeMap->setParam(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    cubeMap->setParam(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    cubeMap->setParam(GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    cubeMap->setParam(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    cubeMap->setParam(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    cubeMap->setParam(GL_TEXTURE_BASE_LEVEL, 0);
+    cubeMap->setParam(GL_TEXTURE_MAX_LEVEL, 0);
+    return cubeMap;
+}
+
+static std::shared_ptr<Light> readLight(const JsonValue &desc) {
+    std::string type = desc.get("type", "spot");
+    glm::vec3 pos = readVec3(desc, "pos", glm::vec3(0));
+    glm::vec3 dir = readVec3(desc, "dir", glm::vec3(0, 0, -1));
+    if (glm::length(dir) > 0)
+        dir = glm::normalize(dir);
+
+    float intensity = float(desc.get("intensity", 1.0));
+    glm::vec3 diffuse = readVec3(desc, "diffuse", glm::vec3(1)) * intensity;
+    glm::vec3 specular = desc.has("specular") ? readVec3(desc, "specular", glm::vec3(1)) * intensity : diffuse;
+    glm::vec3 ambient = readVec3(desc, "ambient", glm::vec3(0));
+
+    std::shared_ptr<Light> light;
+    if (type == "directional") {
+        light = Light::makeDirectional(pos, dir, float(desc.get("orthoSize", 10.0)), diffuse, specular, ambient);
+    } else if (type == "spot") {
+        light = Light::makeSpotlight(pos, dir, float(desc.get("outerAngle", 2.0)), float(desc.get("innerAngle", 1.0)),
+                diffuse, specular, ambient);
+    } else if (type == "point") {
+        // Point lights are not shadowed.
+        light = Light::makePoint(pos, diffuse, specular, ambient);
+    } else {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Unknown light type '" << type << "' (expected 'directional', 'point', or 'spot').";
+        throw std::invalid_argument(errMsg.str());
+    }
+
+    light->enabled = desc.get("enabled", true);
+    return light;
+}
+
+static std::shared_ptr<Model> generateAsteroid(const JsonValue &desc, unsigned seed) {
+    return createAsteroid(float(desc.get("baseNoise", 0.2)), float(desc.get("subdivisionNoise", 0.2)),
+            int(desc.get("subdivisions", 2.0)), seed);
+}
+
+static void applyMaterialOverrides(Model &model, const JsonValue &overrides) {
+    for (size_t i = 0; i < overrides.size(); i++) {
+        const JsonValue &desc = overrides[i];
+
+        // Overrides without an index apply to every material:
+        size_t first = 0;
+        size_t last = model.materials.size();
+        if (desc.has("index")) {
+            first = size_t(desc["index"].asNumber());
+            last = first + 1;
+            if (first >= model.materials.size()) {
+                std::stringstream errMsg;
+                errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                        << "Material index " << first << " is out of range for '" << model.modelName
+                        << "' (materials.size() == " << model.materials.size() << ").";
+                throw std::invalid_argument(errMsg.str());
+            }
+        }
+
+        for (size_t m = first; m < last; m++) {
+            Material &material = *model.materials[m];
+            if (desc.has("emissive")) {
+                material.materialInfo.has.emissive = true;
+                material.emissive = float(desc["emissive"].asNumber());
+            }
+            if (desc.has("reflectivity")) {
+                material.materialInfo.has.reflectivity = true;
+                material.reflectivity = float(desc["reflectivity"].asNumber());
+            }
+            if (desc.has("shininess")) {
+                material.materialInfo.has.shininess = true;
+                material.shininess = float(desc["shininess"].asNumber());
+            }
+            if (desc.has("specular")) {
+                material.materialInfo.has.colSpecular = true;
+                material.colSpecular = readVec3(desc, "specular", glm::vec3(1));
+            }
+            if (desc.has("opacity")) {
+                // Materials with an opacity below 1 are drawn in the transparent pass.
+                material.materialInfo.has.opacity = true;
+                material.opacity = float(desc["opacity"].asNumber());
+            }
+        }
+    }
+}
+
+static ModelAnimation readAnimation(const JsonValue &desc, std::shared_ptr<Model> model, float phase) {
+    ModelAnimation animation;
+    animation.model = model;
+
+    std::string type = desc["type"].asString();
+    if (type == "bob") {
+        animation.type = ModelAnimation::Type::bob;
+        animation.center = readVec3(desc, "center", model->pos);
+        animation.radius = float(desc.get("height", 3.0));
+    } else if (type == "patrol") {
+        animation.type = ModelAnimation::Type::patrol;
+        animation.radius = float(desc.get("radius", 11.0));
+        animation.wobble = float(desc.get("wobble", 3.0));
+    } else if (type == "orbit") {
+        // The phase (in [0, 1)) sets the radius, tilt, and spin of each asteroid in a field:
+        float minRadius = float(desc.get("minRadius", 80.0));
+        float maxRadius = float(desc.get("maxRadius", 160.0));
+        animation.type = ModelAnimation::Type::orbit;
+        animation.radius = minRadius + phase * (maxRadius - minRadius);
+        animation.speed = float(desc.get("speed", 1600.0));
+        animation.tilt = phase * float(desc.get("maxTilt", 0.5));
+        animation.phase = phase * 1097;
+        animation.spin = phase * 5;
+    } else {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "Unknown animation type '" << type << "' (expected 'bob', 'patrol', or 'orbit').";
+        throw std::invalid_argument(errMsg.str());
+    }
+
+    return animation;
+}
+
+/**
+ * Whether two models loaded from the same file with these descriptions would have the same materials, and so can
+ * share them (see Model::shareMaterials).
+ */
+static bool canShareMaterials(const JsonValue &desc, const JsonValue &other) {
+    if (desc.get("dynamicReflections", false) || other.get("dynamicReflections", false))
+        return false; // Their environment maps are rendered per model.
+
+    for (const char *key : {"programs", "environmentMap", "materials"}) {
+        const JsonValue *value = desc.find(key);
+        const JsonValue *otherValue = other.find(key);
+        if ((value == nullptr) != (otherValue == nullptr) || (value != nullptr && *value != *otherValue))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Configures a loaded model as described, uploads it (unless it is an instance, whose geometry is already
+ * uploaded), and adds it to the scene (on the GL thread).
+ */
+static void addModel(SceneFile &sceneFile, Scene &scene, TextureCache &textures, const JsonValue &root,
+        const JsonValue &desc, std::shared_ptr<Model> model, const std::string &name, float animationPhase = 0,
+        bool instance = false) {
+    model->modelName = name;
+    model->loadTextures(textures);
+
+    // Programs are named per model, or shared by default:
+    const JsonValue *programs = desc.find("programs");
+    if (programs == nullptr)
+        programs = root.find("defaultPrograms");
+    if (programs == nullptr) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "'" << name << "' has no programs, and the scene file has no defaultPrograms.";
+        throw std::invalid_argument(errMsg.str());
+    }
+    model->flatProgram = findNamed(sceneFile.programs, (*programs)["flat"].asString(), "program");
+    model->textureProgram = findNamed(sceneFile.programs, (*programs)["texture"].asString(), "program");
+    model->environmentMapProgram = findNamed(sceneFile.programs, (*programs)["environmentMap"].asString(), "program");
+
+    const JsonValue *environmentMap = desc.find("environmentMap");
+    if (environmentMap != nullptr && !environmentMap->isNull())
+        model->setEnvironmentMap(findNamed(sceneFile.environmentMaps, environmentMap->asString(), "environment map"));
+    else
+        model->setEnvironmentMap(nullptr); // TODO: Improve environment map management.
+    model->dynamicReflections = desc.get("dynamicReflections", false);
+
+    if (desc.has("materials"))
+        applyMaterialOverrides(*model, desc["materials"]);
+
+    if (!instance)
+        model->createMeshBuffers(scene.geometryPool);
+    model->createVertexArrays();
+
+    model->pos = readVec3(desc, "pos", model->pos);
+    model->dir = readVec3(desc, "dir", model->dir);
+    model->up = readVec3(desc, "up", model->up);
+    model->scale = readVec3(desc, "scale", model->scale);
+
+    // Lights are described in model space:
+    std::vector<ModelAnimation::AttachedLight> attachedLights;
+    if (desc.has("lights")) {
+        glm::mat4 transform = model->modelTransform();
+
+        const JsonValue &lights = desc["lights"];
+        for (size_t i = 0; i < lights.size(); i++) {
+            auto light = readLight(lights[i]);
+            attachedLights.push_back({light, light->pos, light->dir});
+
+            light->pos = glm::vec3(transform * glm::vec4(light->pos, 1));
+            if (glm::length(light->dir) > 0)
+                light->dir = glm::normalize(glm::vec3(transform * glm::vec4(light->dir, 0)));
+            model->lights.push_back(light);
+        }
+    }
+
+    if (desc.has("animation")) {
+        sceneFile.animations.push_back(readAnimation(desc["animation"], model, animationPhase));
+        sceneFile.animations.back().lights = attachedLights;
+    }
+
+    sceneFile.models[name] = model;
+    scene.addModel(model);
+}
+
+//! Adds a model holding only the described light, which is given in world space.
+static std::shared_ptr<Light> addLight(Scene &scene, const JsonValue &desc, const std::string &defaultName) {
+    auto lightModel = std::make_shared<Model>(desc.get("name", defaultName.c_str()));
+    auto light = readLight(desc);
+    lightModel->lights.push_back(light);
+    scene.addModel(lightModel);
+    return light;
+}
+
+void SceneFile::animate(double time) {
+    float t = float(time);
+
+    for (auto &animation : animations) {
+        Model &model = *animation.model;
+
+        switch (animation.type) {
+            case ModelAnimation::Type::bob:
+                model.pos = animation.center + glm::vec3(0, 0, animation.radius) * std::sin(t);
+                model.dir = glm::normalize(glm::vec3(std::sin(2 * t) + std::cos(3 * t), std::cos(2 * t), std::cos(3 * t)));
+                break;
+
+            case ModelAnimation::Type::patrol: {
+                float radius = animation.radius + std::sin(t / 1.5f) * animation.wobble;
+                glm::vec3 lastPos = model.pos;
+                model.pos = glm::vec3(std::cos(t / 6), std::sin(t / 6), 0) * radius;
+                if (glm::length(model.pos - lastPos) > 0)
+                    model.dir = glm::normalize(model.pos - lastPos);
+                break;
+            }
+
+            case ModelAnimation::Type::orbit: {
+                float orbitTime = t + animation.phase;
+                float angle = orbitTime * animation.speed / (animation.radius * animation.radius);
+
+                glm::vec4 pos = glm::vec4(std::cos(angle), std::sin(angle), 0, 1);
+                glm::mat4 rot;
+                rot = glm::rotate(rot, animation.tilt, glm::vec3(0, 1, 0));
+                pos = rot * pos;
+                model.pos = glm::vec3(pos.x, pos.y, pos.z) * animation.radius;
+                model.dir = glm::vec3(std::sin(animation.spin * orbitTime), std::cos(animation.spin * orbitTime), 0);
+                break;
+            }
+        }
+
+        if (!animation.lights.empty()) {
+            model.updateTransforms();
+            for (auto &attached : animation.lights) {
+                attached.light->pos = glm::vec3(model.transform * glm::vec4(attached.pos, 1));
+                attached.light->dir = glm::normalize(glm::vec3(model.transform * glm::vec4(attached.dir, 0)));
+            }
+        }
+    }
+}
+
+SceneFile loadSceneFile(const std::string &fileName, Scene &scene, unsigned seed) {
+    return loadSceneDescription(JsonValue::parseFile(fileName), scene, seed, fileName);
+}
+
+SceneFile loadSceneDescription(const JsonValue &root, Scene &scene, unsigned seed, const std::string &name) {
+    std::cout << "Loading scene '" << name << "'..." << std::endl;
+
+    SceneFile sceneFile;
+
+    // Seeds are drawn in file order, before any work is started, so that generated models are reproducible:
+    std::mt19937 seeds(seed);
+    std::uniform_real_distribution<float> phases(0, 1);
+
+    // Start importing and generating models on worker threads:
+    struct PendingModel {
+        const JsonValue *desc;
+        std::string name;
+        size_t job;
+        float phase;
+    };
+    std::vector<PendingModel> pendingModels;
+    std::map<std::string, size_t> fileJobs; // Each file is imported once, however many models use it.
+    std::vector<int> jobUsers;
+    TextureCache textures; // Declared before the loader, so that it outlives the loader's threads.
+    ParallelModelLoader loader;
+
+    auto addJob = [&](const JsonValue &desc, const JsonValue &source, const std::string &name, float phase) {
+        size_t job;
+        if (source.has("file")) {
+            std::string modelFile = source["file"].asString();
+            auto it = fileJobs.find(modelFile);
+            if (it != fileJobs.end()) {
+                job = it->second;
+            } else {
+                job = loader.add([modelFile, &textures](std::ostream &log) {
+                    auto model = Model::importFromFile(modelFile, log);
+                    model->decodeTextures(textures, log);
+                    return model;
+                });
+                fileJobs[modelFile] = job;
+            }
+        } else if (source.has("asteroid")) {
+            const JsonValue *asteroid = &source["asteroid"];
+            unsigned asteroidSeed = seeds();
+            job = loader.add([asteroid, asteroidSeed](std::ostream &) { return generateAsteroid(*asteroid, asteroidSeed); });
+        } else {
+            std::stringstream errMsg;
+            errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                    << "'" << name << "' needs a 'file' or 'asteroid' member.";
+            throw std::invalid_argument(errMsg.str());
+        }
+        jobUsers.resize(std::max(jobUsers.size(), job + 1), 0);
+        jobUsers[job]++;
+        pendingModels.push_back({&desc, name, job, phase});
+    };
+
+    if (root.has("models")) {
+        const JsonValue &models = root["models"];
+        for (size_t i = 0; i < models.size(); i++) {
+            addJob(models[i], models[i], models[i].get("name", ("model " + std::to_string(i)).c_str()), 0);
+        }
+    }
+
+    if (root.has("asteroidFields")) {
+        const JsonValue &fields = root["asteroidFields"];
+        for (size_t f = 0; f < fields.size(); f++) {
+            const JsonValue &field = fields[f];
+            std::string name = field.get("name", ("asteroid field " + std::to_string(f)).c_str());
+            int count = int(field["count"].asNumber());
+            for (int i = 0; i < count; i++) {
+                addJob(field, field, name + " " + std::to_string(i), phases(seeds));
+            }
+        }
+    }
+
+    if (root.has("skyBox"))
+        addJob(root["skyBox"], root["skyBox"], "sky box", 0);
+
+    loader.start();
+
+    // Meanwhile, load the GL resources:
+    if (root.has("programs")) {
+        for (const auto &program : root["programs"].object) {
+            sceneFile.programs[program.first] = loadProgram(program.first, program.second);
+        }
+    }
+
+    if (root.has("environmentMaps")) {
+        for (const auto &environmentMap : root["environmentMaps"].object) {
+            sceneFile.environmentMaps[environmentMap.first] = loadEnvironmentMap(environmentMap.second);
+        }
+    }
+
+    if (root.has("lights")) {
+        const JsonValue &lights = root["lights"];
+        for (size_t i = 0; i < lights.size(); i++) {
+            addLight(scene, lights[i], "light " + std::to_string(i));
+        }
+    }
+
+    if (root.has("flashlight"))
+        sceneFile.flashlight = addLight(scene, root["flashlight"], "flashlight");
+
+    /*
+     * Upload the models and add them to the scene, in file order. Files used by several models are uploaded once,
+     * and each model is an instance of the import. Instances whose materials would be the same share them.
+     */
+    auto &models = loader.wait();
+    std::vector<std::vector<std::pair<const JsonValue *, std::shared_ptr<Model>>>> jobInstances(models.size());
+    for (const auto &pending : pendingModels) {
+        auto model = models[pending.job];
+        if (jobUsers[pending.job] == 1) {
+            addModel(sceneFile, scene, textures, root, *pending.desc, model, pending.name, pending.phase);
+            continue;
+        }
+
+        auto &instances = jobInstances[pending.job];
+        if (instances.empty())
+            model->createMeshBuffers(scene.geometryPool);
+
+        auto instance = model->createInstance();
+        for (const auto &other : instances) {
+            if (canShareMaterials(*pending.desc, *other.first)) {
+                instance->shareMaterials(*other.second);
+                break;
+            }
+        }
+        instances.emplace_back(pending.desc, instance);
+
+        addModel(sceneFile, scene, textures, root, *pending.desc, instance, pending.name, pending.phase, true);
+    }
+
+    if (root.has("skyBox"))
+        scene.skyBox = sceneFile.models["sky box"];
+
+    if (root.has("camera")) {
+        const JsonValue &desc = root["camera"];
+        PlayerCamera &camera = *scene.camera;
+        camera.pos = readVec3(desc, "pos", camera.pos);
+        camera.dir = glm::normalize(readVec3(desc, "dir", camera.dir));
+        camera.up = readVec3(desc, "up", camera.up);
+        camera.fov = float(desc.get("fov", double(camera.fov)));
+        camera.near_ = float(desc.get("near", double(camera.near_)));
+        camera.far_ = float(desc.get("far", double(camera.far_)));
+        camera.speed = float(desc.get("speed", double(camera.speed)));
+        camera.lookSpeed = float(desc.get("lookSpeed", double(camera.lookSpeed)));
+        camera.prepareTransforms();
+        camera.initializeAngles();
+    }
+
+    if (root.has("cameraPath")) {
+        const JsonValue &desc = root["cameraPath"];
+        sceneFile.cameraPath.loop = desc.get("loop", true);
+
+        const JsonValue &keyframes = desc["keyframes"];
+        for (size_t i = 0; i < keyframes.size(); i++) {
+            sceneFile.cameraPath.addKeyframe(keyframes[i]["time"].asNumber(),
+                    readVec3(keyframes[i], "pos", glm::vec3(0)), readVec3(keyframes[i], "target", glm::vec3(0)));
+        }
+    }
+
+    std::cout << "Loaded scene '" << name << "' (" << pendingModels.size() << " models)." << std::endl;
+    return sceneFile;
+}
+
+}
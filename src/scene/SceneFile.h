@@ -0,0 +1,89 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "NUGL/ShaderProgram.h"
+#include "NUGL/Texture.h"
+#include "scene/Model.h"
+#include "scene/Light.h"
+#include "scene/Scene.h"
+#include "scene/CameraPath.h"
+#include "utility/Json.h"
+
+namespace scene {
+
+    //! A model that SceneFile::animate moves each frame.
+    struct ModelAnimation {
+        enum class Type {
+            bob,    // Bobs up and down around a centre, tumbling.
+            patrol, // Circles the origin at a varying radius, facing the way it moves.
+            orbit,  // Orbits the origin on a tilted plane (used for asteroid fields).
+        };
+
+        //! A light that follows the model, with its position and direction in model space.
+        struct AttachedLight {
+            std::shared_ptr<Light> light;
+            glm::vec3 pos;
+            glm::vec3 dir;
+        };
+
+        Type type;
+        std::shared_ptr<Model> model;
+        glm::vec3 center;
+        float radius = 0; // The bob height, patrol radius, or orbit radius.
+        float wobble = 0; // How far the patrol radius varies.
+        float speed = 0;  // Orbits: speed * radius^-2 radians per second.
+        float tilt = 0;   // Orbits: rotation of the orbital plane about the y-axis.
+        float phase = 0;  // Orbits: time offset in seconds.
+        float spin = 0;   // Orbits: how fast the model turns.
+
+        std::vector<AttachedLight> lights;
+    };
+
+    /**
+     * The objects a scene description file defines, other than those it adds to the Scene.
+     *
+     * Scene files are JSON documents. Their top level members are:
+     *  - programs: shader programs for models, by name ({"vertex": file, "fragment": file, "outputs": [names]}).
+     *  - defaultPrograms: the flat, texture, and environmentMap programs of models that do not name their own.
+     *  - environmentMaps: cube maps, by name ({"faces": [+X, -X, +Y, -Y, +Z, -Z image files], "unit": n}).
+     *  - models: models loaded from a file ("file") or generated ("asteroid": {baseNoise, subdivisionNoise,
+     *    subdivisions}), with their transform, environmentMap, material overrides, lights, and animation.
+     *  - asteroidFields: "count" generated asteroids sharing one description, each with an orbit animation.
+     *  - lights: lights that are not attached to a model ("type": "spot", "point", or "directional").
+     *  - flashlight: a light that the application moves with the camera.
+     *  - skyBox: a model drawn around the camera.
+     *  - camera: the camera's initial position, direction, and projection.
+     *  - cameraPath: keyframes for benchmark runs ({"loop": bool, "keyframes": [{time, pos, target}]}).
+     *
+     * See assets/scenes/ for examples.
+     */
+    struct SceneFile {
+        std::map<std::string, std::shared_ptr<NUGL::ShaderProgram>> programs;
+        std::map<std::string, std::shared_ptr<NUGL::Texture>> environmentMaps;
+        std::map<std::string, std::shared_ptr<Model>> models;
+        std::vector<ModelAnimation> animations;
+        std::shared_ptr<Light> flashlight;
+        CameraPath cameraPath;
+
+        //! Moves the animated models (and their lights) to their positions at the given time.
+        void animate(double time);
+    };
+
+    /**
+     * Builds the scene described by the file, adding its models and lights to the scene and setting up its camera.
+     *
+     * Models are imported and generated (and their texture images decoded) on worker threads, while the shader
+     * programs and environment maps are loaded on the calling thread (which must own the GL context). The models are
+     * then uploaded and added to the scene in file order, sharing textures that name the same image. Procedural models are generated from seeds drawn in file order from the given seed, so
+     * the result does not depend on thread timing.
+     */
+    SceneFile loadSceneFile(const std::string &fileName, Scene &scene, unsigned seed);
+
+    //! Builds a scene from an already parsed (or generated) description, as loadSceneFile does. The name is for logging.
+    SceneFile loadSceneDescription(const utility::JsonValue &root, Scene &scene, unsigned seed, const std::string &name);
+}
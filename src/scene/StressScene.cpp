@@ -0,0 +1,245 @@
+#include "scene/StressScene.h"
+#include <sstream>
+#include <stdexcept>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+
+namespace scene {
+
+using utility::JsonValue;
+
+struct NamedParam {
+    const char *name;
+    int StressSceneParams::*value;
+};
+
+static const NamedParam namedParams[] = {
+    {"asteroids", &StressSceneParams::asteroids},
+    {"ships", &StressSceneParams::ships},
+    {"transparent", &StressSceneParams::transparent},
+    {"reflectors", &StressSceneParams::reflectors},
+    {"spotLights", &StressSceneParams::spotLights},
+    {"pointLights", &StressSceneParams::pointLights},
+    {"directionalLights", &StressSceneParams::directionalLights},
+};
+
+int *StressSceneParams::find(const std::string &name) {
+    for (const auto &param : namedParams) {
+        if (name == param.name)
+            return &(this->*param.value);
+    }
+    return nullptr;
+}
+
+bool StressSceneParams::set(const std::string &name, int value) {
+    int *param = find(name);
+    if (param == nullptr || value < 0)
+        return false;
+
+    *param = value;
+    return true;
+}
+
+bool StressSceneParams::parse(const std::string &params) {
+    std::stringstream stream(params);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty())
+            continue;
+
+        size_t equals = item.find('=');
+        if (equals == std::string::npos)
+            return false;
+
+        const char *valueStr = item.c_str() + equals + 1;
+        char *end;
+        long value = std::strtol(valueStr, &end, 10);
+        if (end == valueStr || *end != '\0' || !set(item.substr(0, equals), int(value)))
+            return false;
+    }
+    return true;
+}
+
+std::string StressSceneParams::str() const {
+    std::stringstream stream;
+    for (const auto &param : namedParams) {
+        if (param.value != namedParams[0].value)
+            stream << ",";
+        stream << param.name << "=" << this->*param.value;
+    }
+    return stream.str();
+}
+
+static JsonValue makeNumber(double number) {
+    JsonValue value;
+    value.type = JsonValue::Type::number;
+    value.number = number;
+    return value;
+}
+
+static JsonValue makeString(const std::string &string) {
+    JsonValue value;
+    value.type = JsonValue::Type::string;
+    value.string = string;
+    return value;
+}
+
+static JsonValue makeVec3(glm::vec3 vec) {
+    JsonValue value;
+    value.type = JsonValue::Type::array;
+    value.array = {makeNumber(vec.x), makeNumber(vec.y), makeNumber(vec.z)};
+    return value;
+}
+
+//! Replaces the object's member, or adds it if the object has no member with that name.
+static void setMember(JsonValue &object, const std::string &key, JsonValue value) {
+    for (auto &member : object.object) {
+        if (member.first == key) {
+            member.second = std::move(value);
+            return;
+        }
+    }
+    object.object.emplace_back(key, std::move(value));
+}
+
+//! Returns a copy of the object's array member, or an empty array if it has none.
+static JsonValue copyArray(const JsonValue &object, const std::string &key) {
+    if (object.has(key))
+        return object[key];
+
+    JsonValue array;
+    array.type = JsonValue::Type::array;
+    return array;
+}
+
+//! Returns the named template from the stress member, which must be an object.
+static const JsonValue &findTemplate(const JsonValue &stress, const char *name) {
+    const JsonValue &desc = stress[name];
+    if (!desc.isObject()) {
+        std::stringstream errMsg;
+        errMsg << __FILE__ << ", " << __LINE__ << ", " << __func__ << ": "
+                << "The stress template '" << name << "' must be an object.";
+        throw std::invalid_argument(errMsg.str());
+    }
+    return desc;
+}
+
+/**
+ * Scatters objects through a disc around the origin (leaving space for the camera path's target at the centre).
+ *
+ * Each kind of object has its own random sequence, seeded from the scene's seed and the kind's index.
+ */
+class Scatter {
+public:
+    Scatter(unsigned seed, unsigned kind, float radius, float height)
+            : radius(radius), height(height) {
+        std::seed_seq seq = {seed, kind};
+        rng.seed(seq);
+    }
+
+    glm::vec3 position() {
+        float r = radius * std::sqrt(uniform(0.04f, 1.0f));
+        float angle = uniform(0, 2 * float(M_PI));
+        return {r * std::cos(angle), r * std::sin(angle), uniform(-height, height)};
+    }
+
+    glm::vec3 direction() {
+        float z = uniform(-1, 1);
+        float angle = uniform(0, 2 * float(M_PI));
+        float r = std::sqrt(1 - z * z);
+        return {r * std::cos(angle), r * std::sin(angle), z};
+    }
+
+    float uniform(float min, float max) {
+        return std::uniform_real_distribution<float>(min, max)(rng);
+    }
+
+    float radius;
+    float height;
+
+private:
+    std::mt19937 rng;
+};
+
+JsonValue buildStressScene(const JsonValue &base, const StressSceneParams &params, unsigned seed) {
+    const JsonValue &stress = base["stress"];
+    float radius = float(stress.get("radius", 150.0));
+    float height = float(stress.get("height", 40.0));
+
+    JsonValue root;
+    root.type = JsonValue::Type::object;
+    for (const auto &member : base.object) {
+        if (member.first != "stress")
+            root.object.push_back(member);
+    }
+
+    JsonValue models = copyArray(base, "models");
+    JsonValue lights = copyArray(base, "lights");
+    unsigned kind = 0;
+
+    auto addModels = [&](const char *templateName, int count) {
+        Scatter scatter(seed, kind++, radius, height);
+        if (count == 0)
+            return;
+
+        const JsonValue &desc = findTemplate(stress, templateName);
+        for (int i = 0; i < count; i++) {
+            JsonValue model = desc;
+            setMember(model, "name", makeString(std::string(templateName) + " " + std::to_string(i)));
+            setMember(model, "pos", makeVec3(scatter.position()));
+            setMember(model, "dir", makeVec3(scatter.direction()));
+            models.array.push_back(std::move(model));
+        }
+    };
+
+    auto addLights = [&](const char *templateName, int count) {
+        Scatter scatter(seed, kind++, radius, height);
+        if (count == 0)
+            return;
+
+        const JsonValue &desc = findTemplate(stress, templateName);
+        std::string type = desc.get("type", "spot");
+        for (int i = 0; i < count; i++) {
+            JsonValue light = desc;
+            glm::vec3 pos = scatter.position();
+            glm::vec3 dir = {0, 0, -1};
+            if (type == "spot") {
+                // Spotlights hang above the disc, shining at a point in it:
+                pos.z = height * 2;
+                dir = glm::normalize(scatter.position() - pos);
+            } else if (type == "directional") {
+                // Directional lights shine down on the disc from all sides, from outside it:
+                dir = scatter.direction();
+                dir.z = -std::abs(dir.z) - 0.5f;
+                dir = glm::normalize(dir);
+                pos = -dir * radius;
+            }
+
+            setMember(light, "name", makeString(std::string(templateName) + " " + std::to_string(i)));
+            setMember(light, "pos", makeVec3(pos));
+            setMember(light, "dir", makeVec3(dir));
+            lights.array.push_back(std::move(light));
+        }
+    };
+
+    addModels("asteroid", params.asteroids);
+    addModels("ship", params.ships);
+    addModels("transparent", params.transparent);
+    addModels("reflector", params.reflectors);
+    addLights("spotLight", params.spotLights);
+    addLights("pointLight", params.pointLights);
+    addLights("directionalLight", params.directionalLights);
+
+    setMember(root, "models", std::move(models));
+    setMember(root, "lights", std::move(lights));
+    return root;
+}
+
+SceneFile loadStressScene(const std::string &baseFileName, const StressSceneParams &params, Scene &scene,
+        unsigned seed) {
+    JsonValue root = buildStressScene(JsonValue::parseFile(baseFileName), params, seed);
+    return loadSceneDescription(root, scene, seed, baseFileName + " (" + params.str() + ")");
+}
+
+}
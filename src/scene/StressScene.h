@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+
+#include "utility/Json.h"
+#include "scene/Scene.h"
+#include "scene/SceneFile.h"
+
+namespace scene {
+    /**
+     * The object and light counts of a generated stress scene, for measuring how frame time scales with each.
+     *
+     * Parameters are written as "name=value" pairs separated by commas (e.g. "asteroids=500,pointLights=16"),
+     * so that a scene can be named on the command line.
+     */
+    struct StressSceneParams {
+        int asteroids = 100;
+        int ships = 4;
+        int transparent = 10;
+        int reflectors = 1; // Models with dynamic reflection maps.
+        int spotLights = 4;
+        int pointLights = 4;
+        int directionalLights = 1;
+
+        //! Sets the named parameter. Returns false if there is no such parameter, or the value is negative.
+        bool set(const std::string &name, int value);
+
+        //! Returns a pointer to the named parameter, or nullptr if there is none.
+        int *find(const std::string &name);
+
+        //! Sets the parameters listed in the string. Returns false if it is invalid.
+        bool parse(const std::string &params);
+
+        //! Lists every parameter in the form parse accepts.
+        std::string str() const;
+    };
+
+    /**
+     * Generates a scene description from a base description and the parameters.
+     *
+     * The base's "stress" member holds a model description for each kind of object (asteroid, ship, transparent,
+     * reflector) and a light description for each kind of light (spotLight, pointLight, directionalLight); these
+     * are copied the requested number of times and scattered through a disc of the given "radius" and "height".
+     * Every other member of the base (programs, sky box, camera path, etc.) is kept as it is.
+     *
+     * Placements are drawn from a separate random sequence for each kind of object, so increasing one count does
+     * not move the others, and the first n objects of a kind are in the same places whatever n is.
+     */
+    utility::JsonValue buildStressScene(const utility::JsonValue &base, const StressSceneParams &params, unsigned seed);
+
+    //! Generates a stress scene from the base scene file, and loads it into the scene.
+    SceneFile loadStressScene(const std::string &baseFileName, const StressSceneParams &params, Scene &scene,
+            unsigned seed);
+}
@@ -0,0 +1,55 @@
+#include "scene/TextureCache.h"
+#include <iostream>
+
+namespace scene {
+
+void TextureCache::decode(const TextureSource &source, std::ostream &log) {
+    if (source.fileName.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(imagesMutex);
+        if (images.count(source.fileName) != 0)
+            return;
+
+        images[source.fileName] = nullptr;
+    }
+
+    log << "Texture: " << source.fileName << std::endl;
+    auto image = std::make_shared<NUGL::Image>(NUGL::Texture::decodeImage(source.fileName));
+
+    std::lock_guard<std::mutex> lock(imagesMutex);
+    images[source.fileName] = image;
+}
+
+std::shared_ptr<NUGL::Texture> TextureCache::get(const TextureSource &source) {
+    TextureKey key(source.fileName, source.unit, source.wrapS, source.wrapT);
+    auto it = textures.find(key);
+    if (it != textures.end())
+        return it->second;
+
+    std::shared_ptr<NUGL::Image> image;
+    {
+        std::lock_guard<std::mutex> lock(imagesMutex);
+        image = images[source.fileName];
+    }
+    if (!image) {
+        std::cout << "Texture: " << source.fileName << std::endl;
+        image = std::make_shared<NUGL::Image>(NUGL::Texture::decodeImage(source.fileName));
+
+        std::lock_guard<std::mutex> lock(imagesMutex);
+        images[source.fileName] = image;
+    }
+
+    auto texture = std::make_shared<NUGL::Texture>(source.unit, GL_TEXTURE_2D);
+    texture->loadFromImage(*image, GL_TEXTURE_2D);
+    texture->setParam(GL_TEXTURE_WRAP_S, source.wrapS);
+    texture->setParam(GL_TEXTURE_WRAP_T, source.wrapT);
+    texture->setParam(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    texture->setParam(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    textures[key] = texture;
+    return texture;
+}
+
+}
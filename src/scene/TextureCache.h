@@ -0,0 +1,40 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <glm/glm.hpp>
+
+#include "NUGL/Texture.h"
+#include "scene/Material.h"
+
+namespace scene {
+    /**
+     * Shares the textures of the models in a scene, so that each image is decoded and uploaded once.
+     *
+     * Images are decoded by decode, which is safe to call from the worker threads that import models. The textures
+     * are then created by get, on the thread that owns the GL context; materials that name the same image with the
+     * same unit and wrap modes share one texture (see Model::decodeTextures and Model::loadTextures).
+     */
+    class TextureCache {
+    public:
+        //! Decodes the source's image, unless it has already been decoded (or is being decoded by another thread).
+        void decode(const TextureSource &source, std::ostream &log);
+
+        /**
+         * Returns the texture for the source, creating it from the decoded image (which is decoded now, if decode was
+         * not called for it). Must be called on the GL thread, once no other thread is decoding.
+         */
+        std::shared_ptr<NUGL::Texture> get(const TextureSource &source);
+
+    private:
+        typedef std::tuple<std::string, GLenum, GLint, GLint> TextureKey;
+
+        std::mutex imagesMutex;
+        std::map<std::string, std::shared_ptr<NUGL::Image>> images; // Null while being decoded.
+        std::map<TextureKey, std::shared_ptr<NUGL::Texture>> textures;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+
+#include "scene/Camera.h"
+#include "scene/Light.h"
+
+namespace scene {
+    /**
+     * The uniform blocks shared by the scene's shader programs, and their fixed binding points.
+     *
+     * Each struct matches the std140 layout of the GLSL block with the same name, so that it can be copied
+     * directly into a uniform buffer.
+     */
+    enum UniformBlockBinding : GLuint {
+        cameraBlockBinding = 0,
+        objectBlockBinding = 1,
+        lightBlockBinding = 2,
+    };
+
+    struct CameraBlock {
+        glm::mat4 view;
+        glm::mat4 proj;
+        glm::mat4 viewInverse;
+        glm::mat4 projInverse;
+
+        CameraBlock() = default;
+
+        inline CameraBlock(const Camera &camera)
+                : view(camera.view), proj(camera.proj),
+                  viewInverse(glm::inverse(camera.view)), projInverse(glm::inverse(camera.proj)) { }
+    };
+
+    struct ObjectBlock {
+        glm::mat4 model;
+        glm::mat4 modelView;
+        glm::mat4 mvp;
+
+        // Computed for all models at once by utility::math::TransformStore::computeViewTransforms.
+    };
+
+    struct LightBlock {
+        glm::vec3 pos;
+        GLfloat attenuationConstant;
+        glm::vec3 dir;
+        GLfloat attenuationLinear;
+        glm::vec3 colDiffuse;
+        GLfloat attenuationQuadratic;
+        glm::vec3 colSpecular;
+        GLfloat angleConeInner;
+        glm::vec3 colAmbient;
+        GLfloat angleConeOuter;
+        GLfloat fov;
+        GLuint isSpotlight; // GLSL bools occupy 4 bytes in std140 blocks.
+        GLuint isDirectional;
+        GLuint hasShadowMap;
+        glm::mat4 view;
+        glm::mat4 proj;
+
+        LightBlock() = default;
+
+        inline LightBlock(const Light &light, const LightCamera *lightCamera)
+                : pos(light.pos), attenuationConstant(light.attenuationConstant),
+                  dir(light.dir), attenuationLinear(light.attenuationLinear),
+                  colDiffuse(light.colDiffuse), attenuationQuadratic(light.attenuationQuadratic),
+                  colSpecular(light.colSpecular), angleConeInner(light.angleConeInner),
+                  colAmbient(light.colAmbient), angleConeOuter(light.angleConeOuter),
+                  fov(20.0f), // More than 2*Pi
+                  isSpotlight(light.type == Light::Type::spot),
+                  isDirectional(light.type == Light::Type::directional),
+                  hasShadowMap(lightCamera != nullptr) {
+            if (lightCamera != nullptr) {
+                fov = lightCamera->fov;
+                view = lightCamera->view;
+                proj = lightCamera->proj;
+            }
+        }
+    };
+
+    static_assert(sizeof(CameraBlock) == 256, "CameraBlock must match its std140 layout.");
+    static_assert(sizeof(ObjectBlock) == 192, "ObjectBlock must match its std140 layout.");
+    static_assert(sizeof(LightBlock) == 224, "LightBlock must match its std140 layout.");
+}
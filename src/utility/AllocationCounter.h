@@ -0,0 +1,63 @@
+#pragma once
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+
+namespace utility {
+
+    /**
+     * Counts the heap allocations made by the current thread, so that debug builds can check that the frame loop
+     * does not allocate once it has warmed up.
+     *
+     * Counting requires the global operator new to be replaced, which UTILITY_DEFINE_ALLOCATION_COUNTER does. It
+     * must be expanded in exactly one translation unit. Without it, count() always returns 0.
+     */
+    struct AllocationCounter {
+        static inline size_t& count() {
+            static thread_local size_t allocations = 0;
+            return allocations;
+        }
+
+        static inline int& allowDepth() {
+            static thread_local int depth = 0;
+            return depth;
+        }
+
+        static inline void recordAllocation() {
+            if (allowDepth() == 0)
+                count()++;
+        }
+    };
+
+    /**
+     * Allocations made while an instance exists are not counted.
+     *
+     * Use this around expected one-off allocations on the frame path, such as growing a buffer or populating a
+     * cache the first time a key is seen.
+     */
+    class ScopedAllowAllocations {
+    public:
+        inline ScopedAllowAllocations() {
+            AllocationCounter::allowDepth()++;
+        }
+
+        inline ~ScopedAllowAllocations() {
+            AllocationCounter::allowDepth()--;
+        }
+
+        ScopedAllowAllocations(const ScopedAllowAllocations&) = delete;
+        ScopedAllowAllocations& operator=(const ScopedAllowAllocations&) = delete;
+    };
+}
+
+#define UTILITY_DEFINE_ALLOCATION_COUNTER \
+    void* operator new(std::size_t size) { \
+        utility::AllocationCounter::recordAllocation(); \
+        void* ptr = std::malloc(size == 0 ? 1 : size); \
+        if (ptr == nullptr) \
+            throw std::bad_alloc(); \
+        return ptr; \
+    } \
+    void operator delete(void* ptr) noexcept { \
+        std::free(ptr); \
+    }
@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+#include "utility/AllocationCounter.h"
+
+namespace utility {
+
+    /**
+     * A linear allocator for objects that only live for one frame.
+     *
+     * Allocation bumps a pointer into a single block, and reset() releases everything at once (calling the
+     * destructors of objects made with create(), in reverse order). When a frame needs more than the block holds,
+     * the excess is served from separate overflow blocks, and the next reset() replaces the main block with one
+     * large enough for the whole frame. Steady state frames therefore perform no heap allocations.
+     */
+    class FrameArena {
+    public:
+        inline FrameArena(size_t capacity = 64 * 1024) {
+            allocateBlock(capacity);
+        }
+
+        inline ~FrameArena() {
+            runDestructors();
+        }
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        inline void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": alignment must be a power of two (alignment == " << alignment << ").";
+                throw std::invalid_argument(errMsg.str());
+            }
+
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+            size_t offset = ((base + head + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+
+            if (offset + size <= blockSize) {
+                head = offset + size;
+                return block.get() + offset;
+            }
+
+            // Serve the request from an overflow block, and remember to grow the main block on reset:
+            ScopedAllowAllocations allow;
+            overflowBytes += size + alignment;
+            overflowBlocks.emplace_back(new unsigned char[size + alignment]);
+            uintptr_t overflowBase = reinterpret_cast<uintptr_t>(overflowBlocks.back().get());
+            return reinterpret_cast<void*>((overflowBase + alignment - 1) & ~uintptr_t(alignment - 1));
+        }
+
+        //! Constructs a T in the arena. Its destructor (if any) is called by reset().
+        template<typename T, typename... Args>
+        inline T* create(Args&&... args) {
+            void* memory = allocate(sizeof(T), alignof(T));
+            T* object = new (memory) T(std::forward<Args>(args)...);
+
+            if (!std::is_trivially_destructible<T>::value) {
+                Destructor* destructor = static_cast<Destructor*>(allocate(sizeof(Destructor), alignof(Destructor)));
+                destructor->destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+                destructor->object = object;
+                destructor->next = destructors;
+                destructors = destructor;
+            }
+
+            return object;
+        }
+
+        //! Destroys all objects, and makes the arena's memory available for the next frame.
+        inline void reset() {
+            runDestructors();
+
+            if (!overflowBlocks.empty()) {
+                ScopedAllowAllocations allow;
+                size_t required = blockSize + overflowBytes;
+                overflowBlocks.clear();
+                overflowBytes = 0;
+                allocateBlock(std::max(required, blockSize * 2));
+            }
+
+            head = 0;
+        }
+
+        //! The number of bytes used in the main block.
+        inline size_t used() const {
+            return head;
+        }
+
+        inline size_t capacity() const {
+            return blockSize;
+        }
+
+    private:
+        struct Destructor {
+            void (*destroy)(void*);
+            void* object;
+            Destructor* next;
+        };
+
+        inline void allocateBlock(size_t size) {
+            block.reset(new unsigned char[size]);
+            blockSize = size;
+            head = 0;
+        }
+
+        inline void runDestructors() {
+            for (Destructor* destructor = destructors; destructor != nullptr; destructor = destructor->next) {
+                destructor->destroy(destructor->object);
+            }
+            destructors = nullptr;
+        }
+
+        std::unique_ptr<unsigned char[]> block;
+        size_t blockSize = 0;
+        size_t head = 0;
+
+        std::vector<std::unique_ptr<unsigned char[]>> overflowBlocks;
+        size_t overflowBytes = 0;
+
+        Destructor* destructors = nullptr;
+    };
+}
@@ -3,19 +3,29 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+
+#include "utility/Histogram.h"
 
 namespace utility {
 
     class FrameTimer {
     public:
-        inline FrameTimer(double currentTime) : lastTime(currentTime), nbFrames(0), fps(1), timeStr("") { }
+        inline FrameTimer(double currentTime)
+                : lastTime(currentTime), lastFrameTime(currentTime), nbFrames(0), fps(1), timeStr("") { }
 
         inline bool frameUpdate(double currentTime) {
             nbFrames++;
+            frameTimes.record(uint64_t(std::max(0.0, currentTime - lastFrameTime) * 1000000.0));
+            lastFrameTime = currentTime;
+
             if (currentTime - lastTime >= 1.0) { // If last print was more than 1 sec ago
                 fps = double(nbFrames);
                 std::stringstream title;
-                title << "OpenGL | " << (1000.0 / fps) << " ms/frame (" << fps << "fps)";
+                title << "OpenGL | " << (1000.0 / fps) << " ms/frame (" << fps << "fps)"
+                        << " | p99 " << frameTimes.percentile(99) / 1000.0
+                        << " ms, max " << frameTimes.max() / 1000.0 << " ms";
+                frameTimes.reset();
                 nbFrames = 0;
                 lastTime += 1.0;
 //                glfwSetWindowTitle(window, title.str().c_str());
@@ -27,7 +37,9 @@ namespace utility {
         }
 
         double lastTime;
+        double lastFrameTime;
         int nbFrames;
+        Histogram frameTimes; //!< Frame times in microseconds, over the current one second window.
         double fps;
         std::string timeStr;
     };
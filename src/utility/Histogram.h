@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+namespace utility {
+
+    /**
+     * A streaming histogram of non-negative integer values (e.g. durations in microseconds), in the style of
+     * HdrHistogram.
+     *
+     * Values below subBucketCount are counted exactly. Larger values are counted in log-linear buckets: each power
+     * of two is split into subBucketCount equal sub-buckets, so every reported value is within 1 / subBucketCount
+     * (about 3%) of the true value. Recording is O(1), and the bucket array is allocated once.
+     */
+    class Histogram {
+    public:
+        static const int subBucketBits = 5;
+        static const uint64_t subBucketCount = uint64_t(1) << subBucketBits;
+        static const int maxShift = 40; // Values up to about 2^45 (a year, in microseconds).
+
+        inline Histogram() : counts(size_t(subBucketCount * (maxShift + 1)), 0) {
+            reset();
+        }
+
+        inline void record(uint64_t value) {
+            counts[bucketIndex(value)]++;
+            total++;
+            sum += value;
+            minValue = std::min(minValue, value);
+            maxValue = std::max(maxValue, value);
+        }
+
+        //! Starts a new window; values recorded before the reset are forgotten.
+        inline void reset() {
+            std::fill(counts.begin(), counts.end(), 0);
+            total = 0;
+            sum = 0;
+            minValue = std::numeric_limits<uint64_t>::max();
+            maxValue = 0;
+        }
+
+        inline uint64_t count() const { return total; }
+        inline uint64_t min() const { return total > 0 ? minValue : 0; }
+        inline uint64_t max() const { return maxValue; }
+
+        inline double mean() const {
+            return total > 0 ? double(sum) / total : 0;
+        }
+
+        /**
+         * Returns the value below which the given percentage (0 to 100) of recorded values lie, as the highest value
+         * equivalent to the bucket containing it (clamped to the largest value recorded).
+         */
+        inline uint64_t percentile(double percent) const {
+            if (total == 0)
+                return 0;
+
+            percent = std::min(std::max(percent, 0.0), 100.0);
+            uint64_t target = std::max(uint64_t(1), uint64_t(percent / 100.0 * total + 0.5));
+
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                seen += counts[i];
+                if (seen >= target)
+                    return std::min(bucketUpperBound(i), maxValue);
+            }
+
+            return maxValue;
+        }
+
+    private:
+        static inline size_t bucketIndex(uint64_t value) {
+            if (value < subBucketCount)
+                return size_t(value);
+
+            int msb = subBucketBits;
+            while (msb < 63 && (value >> (msb + 1)))
+                msb++;
+
+            int shift = std::min(msb - subBucketBits, maxShift - 1);
+            uint64_t subBucket = std::min((value >> shift) - subBucketCount, subBucketCount - 1);
+            return size_t(subBucketCount * (shift + 1) + subBucket);
+        }
+
+        static inline uint64_t bucketUpperBound(size_t index) {
+            if (index < subBucketCount)
+                return index;
+
+            int shift = int(index / subBucketCount) - 1;
+            uint64_t subBucket = index % subBucketCount;
+            return ((subBucketCount + subBucket + 1) << shift) - 1;
+        }
+
+        std::vector<uint32_t> counts;
+        uint64_t total;
+        uint64_t sum;
+        uint64_t minValue;
+        uint64_t maxValue;
+    };
+}
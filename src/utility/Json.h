@@ -0,0 +1,354 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+
+#include "utility/strutil.h"
+
+namespace utility {
+
+    /**
+     * A parsed JSON document (RFC 8259), for reading configuration files such as scene descriptions.
+     *
+     * Objects keep their members in file order. Accessors throw std::invalid_argument when a value has the wrong
+     * type or a required member is missing, naming the member, so that mistakes in hand-written files are easy to
+     * find.
+     */
+    class JsonValue {
+    public:
+        enum class Type { null, boolean, number, string, array, object };
+
+        Type type = Type::null;
+        bool boolean = false;
+        double number = 0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        static inline JsonValue parse(const std::string &text) {
+            Parser parser(text);
+            parser.skipWhitespace();
+            JsonValue value = parser.parseValue();
+            parser.skipWhitespace();
+            if (parser.pos != text.size())
+                parser.fail("Unexpected characters after the document");
+            return value;
+        }
+
+        static inline JsonValue parseFile(const std::string &fileName) {
+            try {
+                return parse(strutil::getFileString(fileName));
+            } catch (const std::invalid_argument &ex) {
+                std::stringstream errMsg;
+                errMsg << fileName << ": " << ex.what();
+                throw std::invalid_argument(errMsg.str());
+            }
+        }
+
+        inline bool isNull() const { return type == Type::null; }
+        inline bool isNumber() const { return type == Type::number; }
+        inline bool isString() const { return type == Type::string; }
+        inline bool isArray() const { return type == Type::array; }
+        inline bool isObject() const { return type == Type::object; }
+
+        inline bool asBool() const {
+            checkType(Type::boolean, "a boolean");
+            return boolean;
+        }
+
+        inline double asNumber() const {
+            checkType(Type::number, "a number");
+            return number;
+        }
+
+        inline const std::string &asString() const {
+            checkType(Type::string, "a string");
+            return string;
+        }
+
+        //! The number of elements of an array, or members of an object.
+        inline size_t size() const {
+            return type == Type::array ? array.size() : object.size();
+        }
+
+        inline const JsonValue &operator[](size_t index) const {
+            checkType(Type::array, "an array");
+            if (index >= array.size()) {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": Index " << index << " is out of range (size() == " << array.size() << ").";
+                throw std::invalid_argument(errMsg.str());
+            }
+            return array[index];
+        }
+
+        //! Returns the object's member, or nullptr if it has none with that name.
+        inline const JsonValue *find(const std::string &key) const {
+            checkType(Type::object, "an object");
+            for (const auto &member : object) {
+                if (member.first == key)
+                    return &member.second;
+            }
+            return nullptr;
+        }
+
+        inline bool has(const std::string &key) const {
+            return find(key) != nullptr;
+        }
+
+        inline const JsonValue &operator[](const std::string &key) const {
+            const JsonValue *value = find(key);
+            if (value == nullptr) {
+                std::stringstream errMsg;
+                errMsg << __func__ << ": Missing required member '" << key << "'.";
+                throw std::invalid_argument(errMsg.str());
+            }
+            return *value;
+        }
+
+        // Optional members:
+        inline double get(const std::string &key, double defaultValue) const {
+            const JsonValue *value = find(key);
+            if (value == nullptr)
+                return defaultValue;
+            value->checkType(Type::number, "a number", key.c_str());
+            return value->number;
+        }
+
+        inline bool get(const std::string &key, bool defaultValue) const {
+            const JsonValue *value = find(key);
+            if (value == nullptr)
+                return defaultValue;
+            value->checkType(Type::boolean, "a boolean", key.c_str());
+            return value->boolean;
+        }
+
+        inline std::string get(const std::string &key, const char *defaultValue) const {
+            const JsonValue *value = find(key);
+            if (value == nullptr)
+                return defaultValue;
+            value->checkType(Type::string, "a string", key.c_str());
+            return value->string;
+        }
+
+        //! Whether the values are the same (objects must also list their members in the same order).
+        inline bool operator==(const JsonValue &other) const {
+            return type == other.type && boolean == other.boolean && number == other.number && string == other.string
+                    && array == other.array && object == other.object;
+        }
+
+        inline bool operator!=(const JsonValue &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        inline void checkType(Type expected, const char *description, const char *key = nullptr) const {
+            if (type != expected) {
+                std::stringstream errMsg;
+                errMsg << "JsonValue: ";
+                if (key != nullptr)
+                    errMsg << "'" << key << "' ";
+                errMsg << "must be " << description << ".";
+                throw std::invalid_argument(errMsg.str());
+            }
+        }
+
+        struct Parser {
+            const std::string &text;
+            size_t pos = 0;
+
+            inline Parser(const std::string &text) : text(text) {}
+
+            inline void fail(const std::string &message) const {
+                int line = 1;
+                int column = 1;
+                for (size_t i = 0; i < pos && i < text.size(); i++) {
+                    column++;
+                    if (text[i] == '\n') {
+                        line++;
+                        column = 1;
+                    }
+                }
+
+                std::stringstream errMsg;
+                errMsg << "JSON parse error at line " << line << ", column " << column << ": " << message << ".";
+                throw std::invalid_argument(errMsg.str());
+            }
+
+            inline void skipWhitespace() {
+                while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+                    pos++;
+            }
+
+            inline void expect(char c) {
+                if (pos >= text.size() || text[pos] != c)
+                    fail(std::string("Expected '") + c + "'");
+                pos++;
+            }
+
+            inline bool consume(const char *literal) {
+                size_t length = std::char_traits<char>::length(literal);
+                if (text.compare(pos, length, literal) != 0)
+                    return false;
+                pos += length;
+                return true;
+            }
+
+            inline JsonValue parseValue() {
+                if (pos >= text.size())
+                    fail("Unexpected end of input");
+
+                JsonValue value;
+                char c = text[pos];
+                if (c == '{') {
+                    value.type = Type::object;
+                    parseObject(value);
+                } else if (c == '[') {
+                    value.type = Type::array;
+                    parseArray(value);
+                } else if (c == '"') {
+                    value.type = Type::string;
+                    value.string = parseString();
+                } else if (consume("true")) {
+                    value.type = Type::boolean;
+                    value.boolean = true;
+                } else if (consume("false")) {
+                    value.type = Type::boolean;
+                } else if (consume("null")) {
+                    value.type = Type::null;
+                } else if (c == '-' || (c >= '0' && c <= '9')) {
+                    value.type = Type::number;
+                    value.number = parseNumber();
+                } else {
+                    fail(std::string("Unexpected character '") + c + "'");
+                }
+                return value;
+            }
+
+            inline void parseObject(JsonValue &value) {
+                expect('{');
+                skipWhitespace();
+                if (pos < text.size() && text[pos] == '}') {
+                    pos++;
+                    return;
+                }
+
+                while (true) {
+                    skipWhitespace();
+                    if (pos >= text.size() || text[pos] != '"')
+                        fail("Expected a member name");
+                    std::string key = parseString();
+                    skipWhitespace();
+                    expect(':');
+                    skipWhitespace();
+                    value.object.emplace_back(std::move(key), parseValue());
+                    skipWhitespace();
+
+                    if (pos < text.size() && text[pos] == ',') {
+                        pos++;
+                        continue;
+                    }
+                    expect('}');
+                    return;
+                }
+            }
+
+            inline void parseArray(JsonValue &value) {
+                expect('[');
+                skipWhitespace();
+                if (pos < text.size() && text[pos] == ']') {
+                    pos++;
+                    return;
+                }
+
+                while (true) {
+                    skipWhitespace();
+                    value.array.push_back(parseValue());
+                    skipWhitespace();
+
+                    if (pos < text.size() && text[pos] == ',') {
+                        pos++;
+                        continue;
+                    }
+                    expect(']');
+                    return;
+                }
+            }
+
+            inline double parseNumber() {
+                const char *start = text.c_str() + pos;
+                char *end;
+                double number = std::strtod(start, &end);
+                if (end == start)
+                    fail("Invalid number");
+                pos += end - start;
+                return number;
+            }
+
+            inline std::string parseString() {
+                expect('"');
+                std::string str;
+                while (true) {
+                    if (pos >= text.size())
+                        fail("Unterminated string");
+
+                    char c = text[pos++];
+                    if (c == '"')
+                        return str;
+                    if (c != '\\') {
+                        str += c;
+                        continue;
+                    }
+
+                    if (pos >= text.size())
+                        fail("Unterminated string");
+                    char escape = text[pos++];
+                    switch (escape) {
+                        case '"': str += '"'; break;
+                        case '\\': str += '\\'; break;
+                        case '/': str += '/'; break;
+                        case 'b': str += '\b'; break;
+                        case 'f': str += '\f'; break;
+                        case 'n': str += '\n'; break;
+                        case 'r': str += '\r'; break;
+                        case 't': str += '\t'; break;
+                        case 'u': appendUtf8(str, parseHex4()); break;
+                        default: fail(std::string("Invalid escape '\\") + escape + "'");
+                    }
+                }
+            }
+
+            inline uint32_t parseHex4() {
+                if (pos + 4 > text.size())
+                    fail("Invalid unicode escape");
+                uint32_t codePoint = 0;
+                for (int i = 0; i < 4; i++) {
+                    char c = text[pos++];
+                    codePoint <<= 4;
+                    if (c >= '0' && c <= '9') codePoint |= uint32_t(c - '0');
+                    else if (c >= 'a' && c <= 'f') codePoint |= uint32_t(c - 'a' + 10);
+                    else if (c >= 'A' && c <= 'F') codePoint |= uint32_t(c - 'A' + 10);
+                    else fail("Invalid unicode escape");
+                }
+                return codePoint;
+            }
+
+            // Surrogate pairs are not combined; scene files have no need for characters outside the BMP.
+            static inline void appendUtf8(std::string &str, uint32_t codePoint) {
+                if (codePoint < 0x80) {
+                    str += char(codePoint);
+                } else if (codePoint < 0x800) {
+                    str += char(0xC0 | (codePoint >> 6));
+                    str += char(0x80 | (codePoint & 0x3F));
+                } else {
+                    str += char(0xE0 | (codePoint >> 12));
+                    str += char(0x80 | ((codePoint >> 6) & 0x3F));
+                    str += char(0x80 | (codePoint & 0x3F));
+                }
+            }
+        };
+    };
+}
@@ -1,193 +1,447 @@
 #pragma once
 #include <chrono>
+#include <iostream>
+#include <algorithm>
 #include <iomanip>
-#include <map>
-#include <sstream>
+#include <cstdint>
+#include <unordered_map>
 #include <memory>
+#include <vector>
+#include <string>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "utility/AllocationCounter.h"
+#include "utility/Histogram.h"
+
+/**
+ * Interns a string literal as a Profiler::LabelId. The label is registered the first time the expression is
+ * evaluated, and every later evaluation is a load of a function-local static.
+ */
+#define PROFILER_LABEL(name) ([]() -> Profiler::LabelId { \
+        static const Profiler::LabelId id = Profiler::internLabel(name); \
+        return id; \
+    }())
+
+/**
+ * Measures the time between consecutive calls to split, as a tree of labelled sections.
+ *
+ * Labels are interned once (see PROFILER_LABEL), and the tree's nodes are found by label ID, so neither split nor
+ * push hash or build strings. Each node keeps its samples in fixed-size ring buffers with running sums, so averages
+ * are available without rescanning the samples. Each node (and the frame as a whole) also records its times in
+ * histograms, from which percentiles are reported; the histograms are reset every histogramWindow seconds.
+ *
+ * CPU times are measured directly. GPU times are measured with GL_TIMESTAMP queries issued at each split, and
+ * read back numGpuFrames frames later (see endFrame), so that profiling never stalls the pipeline.
+ *
+ * While a trace is being recorded (see startTrace), every split, scope, marker, and frame is also written to a
+ * Chrome trace event JSON file, which can be opened in chrome://tracing or the Perfetto UI.
+ */
 class Profiler {
 public:
-    struct ProfilerNode {
-        std::map<std::string, std::shared_ptr<ProfilerNode>> childrenMap;
-        std::deque<std::chrono::microseconds> durations;
-//        std::map<std::string, std::deque<std::chrono::microseconds>> durationMap;
-
-        inline double average() {
-            double childSum = 0;
-            for (const auto& pair : childrenMap) {
-                childSum += pair.second->average();
+    typedef uint32_t LabelId;
+
+    //! The most recent samples of a duration, with a running sum.
+    struct SampleRing {
+        std::vector<std::chrono::microseconds> samples;
+        size_t next = 0;
+        std::chrono::microseconds::rep sum = 0;
+
+        inline void add(std::chrono::microseconds duration, size_t sampleLimit) {
+            if (samples.size() < sampleLimit) {
+                if (samples.capacity() < sampleLimit) {
+                    utility::ScopedAllowAllocations allow;
+                    samples.reserve(sampleLimit);
+                }
+                samples.push_back(duration);
+            } else {
+                sum -= samples[next].count();
+                samples[next] = duration;
             }
 
-            if (durations.empty())
-                return childSum;
-
-            double avg = 0;
-
-            for (auto d : durations) {
-                avg += (double)d.count();
-            }
-
-            double ms = avg / (durations.size() * 1000.0); // milliseconds
-
-            return childSum + ms;
+            sum += duration.count();
+            next = (next + 1) % sampleLimit;
         }
 
-        inline void print(int nesting = 0) {
-            int maxlen = 0;
-            double total = 0;
-
-            std::vector<std::pair<std::string, std::shared_ptr<ProfilerNode>>> data;
-            for (const auto& pair : childrenMap) {
-                auto node = pair.second;
+        //! The average duration in milliseconds.
+        inline double average() const {
+            if (samples.empty())
+                return 0;
 
-                maxlen = std::max((int)pair.first.length(), maxlen);
-                double avg = node->average();// average(pair.first);
-                total += avg;
-                data.emplace_back(pair);
-            }
-            sort(data.begin(), data.end(), [](std::pair<std::string, std::shared_ptr<ProfilerNode>>& p1, std::pair<std::string, std::shared_ptr<ProfilerNode>>& p2) {
-                return p1.second->average() > p2.second->average();
-            });
-
-            for (const auto& pair : data) {
-                double avg = pair.second->average();
-                std::cout
-                        << std::setw(nesting * 4)
-                        << "| "
-                        << std::setw(maxlen)
-                        << pair.first << ": "
-                        << std::fixed
-                        << std::setw(10)
-                        << std::setprecision(4)
-//                    << average(pair.first) << " ms"
-                        << avg << " ms, "
-                        << std::setw(5)
-                        << std::setprecision(2)
-                        << (100 * avg / total)
-                        << "%"
-                        << std::endl;
-
-                pair.second->print(nesting + 1);
-            }
+            return sum / (samples.size() * 1000.0);
         }
     };
 
-    std::deque<std::shared_ptr<ProfilerNode>> nodeStack;
-    std::shared_ptr<ProfilerNode> currentNode;
+    struct ProfilerNode {
+        LabelId label;
+        std::vector<std::pair<LabelId, size_t>> children; // Child node indices, by label.
+        SampleRing durations;
+        SampleRing gpuDurations;
+        utility::Histogram histogram; // Microseconds.
+        utility::Histogram gpuHistogram;
+    };
 
     std::chrono::system_clock::time_point start;
     std::chrono::system_clock::time_point lastPrint;
     unsigned sampleLimit;
     bool glFinishEnabled;
-    bool disabled = false;
+    bool gpuTimingEnabled = true; //!< Measure GPU times with timestamp queries (when supported).
+    double histogramWindow = 10; //!< Seconds between histogram resets (0 to never reset).
+
+    //! The CPU time between consecutive calls to endFrame, in microseconds.
+    utility::Histogram frameHistogram;
 
     inline Profiler(unsigned sampleLimit = 100) {
         this->sampleLimit = sampleLimit;
         lastPrint = std::chrono::system_clock::now();
-        glFinishEnabled = true;
-        disabled = false;
+        glFinishEnabled = false;
 
-        currentNode = std::make_shared<ProfilerNode>();
-        nodeStack.push_back(currentNode);
+        nodes.reserve(64);
+        nodes.push_back(ProfilerNode());
+        nodes[0].label = internLabel("");
+        nodeStack.reserve(16);
+        nodeStack.push_back(0);
 
         reset();
+        frameStart = start;
+        histogramWindowStart = start;
     };
 
+    inline ~Profiler() {
+        for (auto& frame : gpuFrames) {
+            if (!frame.queries.empty())
+                glDeleteQueries(GLsizei(frame.queries.size()), frame.queries.data());
+        }
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    //! Returns the ID of the label, registering it if it has not been seen before.
+    static inline LabelId internLabel(const std::string& name) {
+        auto& ids = labelIds();
+        auto it = ids.find(name);
+        if (it != ids.end())
+            return it->second;
+
+        utility::ScopedAllowAllocations allow;
+        LabelId id = LabelId(labelNames().size());
+        labelNames().push_back(name);
+        ids[name] = id;
+        return id;
+    }
+
+    //! As above, allowing the allocation of the key (PROFILER_LABEL may first be reached after the frame loop warms up).
+    static inline LabelId internLabel(const char* name) {
+        utility::ScopedAllowAllocations allow;
+        return internLabel(std::string(name));
+    }
+
+    //! Returns the ID of the label formed by appending the index to a base label (e.g. "light 2").
+    //! Numbered labels are cached by base and index, so that repeated lookups only index into vectors.
+    static inline LabelId internLabel(LabelId base, int index) {
+        auto& ids = indexedLabelIds();
+        if (base < ids.size() && index >= 0 && size_t(index) < ids[base].size() && ids[base][index] != noLabel)
+            return ids[base][index];
+
+        utility::ScopedAllowAllocations allow;
+        LabelId id = internLabel(labelNames()[base] + std::to_string(index));
+        if (index < 0)
+            return id;
+
+        if (base >= ids.size())
+            ids.resize(base + 1);
+        if (size_t(index) >= ids[base].size())
+            ids[base].resize(index + 1, LabelId(noLabel));
+        ids[base][index] = id;
+        return id;
+    }
+
+    static inline const std::string& labelName(LabelId id) {
+        return labelNames()[id];
+    }
+
     inline void reset() {
         start = std::chrono::system_clock::now();
     }
 
+    //! Stops (or resumes) profiling at the end of the current frame, so that pushes and pops stay balanced.
     inline void disable() {
-        disabled = true;
+        requestedDisabled = true;
     }
 
     inline void enable() {
-        disabled = false;
+        requestedDisabled = false;
     }
 
-    inline void push(std::string label) {
-        std::shared_ptr<ProfilerNode> childNode;
-        if(currentNode->childrenMap.find(label) == currentNode->childrenMap.end()) {
-            childNode = std::make_shared<ProfilerNode>();
-            currentNode->childrenMap[label] = childNode;
-        } else {
-            childNode = currentNode->childrenMap[label];
-        }
-
-        nodeStack.push_back(childNode);
-        currentNode = childNode;
+    inline bool isDisabled() const {
+        return disabled;
     }
-    // Allow any sequence of stringstreamable arguments to be passed to split.
-    template<typename T, typename... Args>
-    inline void push(std::string s, T t, Args... args) {
-        std::stringstream ss;
-        ss << s << t;
 
-        push(ss.str(), args...);
-    }
-    template<typename T, typename... Args>
-    inline void push(T t, Args... args) {
-        std::stringstream ss;
-        ss << t;
+    inline void push(LabelId label) {
+        if (disabled)
+            return;
+
+        size_t child = findOrAddChild(nodeStack.back(), label);
+        nodeStack.push_back(child);
 
-        push(ss.str(), args...);
+        // Scopes begin and end at split boundaries, so that the splits recorded inside them nest properly:
+        if (traceRecording)
+            addTraceEvent(label, 'B', cpuTrack, traceTime(start), 0);
     }
 
+    inline void push(LabelId label, int index) {
+        if (disabled)
+            return;
+
+        push(internLabel(label, index));
+    }
 
     inline void pop() {
+        if (disabled)
+            return;
+
         if (nodeStack.size() > 1) {
+            if (traceRecording)
+                addTraceEvent(nodes[nodeStack.back()].label, 'E', cpuTrack, traceTime(start), 0);
+
             nodeStack.pop_back();
-            currentNode = nodeStack.back();
         } else {
             std::cerr << __FILE__ << ", " << __LINE__ << ": Cannot pop the only ProfilerNode" << std::endl;
         }
     }
 
-    inline void split(std::string label) {
+    //! Records the time since the last split under the given label, in the current node.
+    inline void split(LabelId label) {
         if (disabled)
             return;
 
-        // Wait until the effects of all previously called GL commands are complete.
-        if (glFinishEnabled)
-            glFinish();
+        recordSplit(findOrAddChild(nodeStack.back(), label));
+    }
 
-        auto end = std::chrono::system_clock::now();
+    inline void split(LabelId label, int index) {
+        if (disabled)
+            return;
+
+        split(internLabel(label, index));
+    }
 
-        if(currentNode->childrenMap.find(label) == currentNode->childrenMap.end()) {
-            currentNode->childrenMap[label] = std::make_shared<ProfilerNode>();
+    //! Records an instant event in the trace (e.g. a light being toggled, or an asset being loaded).
+    inline void mark(LabelId label) {
+        if (traceRecording)
+            addTraceEvent(label, 'i', cpuTrack, traceTime(std::chrono::system_clock::now()), 0);
+    }
+
+    /**
+     * Starts recording a trace to the given file. If numFrames is positive, recording stops after that many
+     * frames; otherwise it continues until stopTrace is called.
+     *
+     * Returns false (after reporting the error) if a trace is already being written, or the file cannot be opened.
+     */
+    inline bool startTrace(const std::string& fileName, int numFrames = 0) {
+        if (traceFile.is_open()) {
+            std::cerr << __FILE__ << ", " << __LINE__ << ": A trace is already being written." << std::endl;
+            return false;
         }
 
-        currentNode->childrenMap[label]->durations.push_front(std::chrono::duration_cast<std::chrono::microseconds>(end - start));
-        start = end;
+        traceFile.open(fileName);
+        if (!traceFile) {
+            std::cerr << __FILE__ << ", " << __LINE__ << ", " << __func__
+                    << ": Could not open trace file '" << fileName << "'." << std::endl;
+            traceFile.clear();
+            return false;
+        }
+
+        traceStart = std::chrono::system_clock::now();
+        lastFrameEnd = traceStart;
+        traceFramesLeft = numFrames;
+        traceDrainFrames = 0;
+        traceRecording = true;
+        firstTraceEvent = true;
+        traceEvents.reserve(4096);
+
+        // Map GPU timestamps onto the trace's clock:
+        gpuTraceOffset = 0;
+        if (gpuTimingActive()) {
+            GLint64 gpuNow;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            gpuTraceOffset = gpuNow / 1000 - traceTime(std::chrono::system_clock::now());
+        }
+
+        traceFile << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        writeTrackName(frameTrack, "Frames");
+        writeTrackName(cpuTrack, "CPU");
+        writeTrackName(gpuTrack, "GPU");
+
+        std::cout << "Recording trace to '" << fileName << "'." << std::endl;
+        return true;
+    }
+
+    /**
+     * Stops recording the trace. The file is completed once the GPU times of the frames in flight have been
+     * read back.
+     */
+    inline void stopTrace() {
+        if (!traceRecording)
+            return;
+
+        traceRecording = false;
+        traceDrainFrames = numGpuFrames;
+    }
+
+    inline bool isTracing() const {
+        return traceRecording;
+    }
+
+    /**
+     * Marks the end of a frame. Reads back the GPU times of the oldest frame in the query ring, and starts
+     * timing the next frame on the GPU.
+     *
+     * Must be called once per frame for GPU times to be recorded.
+     */
+    inline void endFrame() {
+        auto now = std::chrono::system_clock::now();
+        auto frameTime = std::chrono::duration_cast<std::chrono::microseconds>(now - frameStart).count();
+        frameHistogram.record(std::max(decltype(frameTime)(0), frameTime));
+        frameStart = now;
+
+        if (requestedDisabled != disabled) {
+            disabled = requestedDisabled;
+            nodeStack.resize(1);
+            reset();
+        }
+
+        if (gpuTimingActive()) {
+            currentGpuFrame = (currentGpuFrame + 1) % numGpuFrames;
+            GpuFrame& frame = gpuFrames[currentGpuFrame];
+            resolveGpuFrame(frame);
+
+            lastGpuQuery = issueTimestamp(frame);
+        }
 
-        if (currentNode->childrenMap[label]->durations.size() > sampleLimit)
-            currentNode->childrenMap[label]->durations.pop_back();
+        if (traceFile.is_open())
+            endTraceFrame();
     }
-    // Allow any sequence of stringstreamable arguments to be passed to split.
-    template<typename T, typename... Args>
-    inline void split(std::string s, T t, Args... args) {
-        std::stringstream ss;
-        ss << s << t;
 
-        split(ss.str(), args...);
+    //! The node's average CPU (or GPU) time in milliseconds, including its children.
+    inline double average(size_t node, bool gpu = false) {
+        double childSum = 0;
+        for (const auto& child : nodes[node].children) {
+            childSum += average(child.second, gpu);
+        }
+
+        return childSum + (gpu ? nodes[node].gpuDurations : nodes[node].durations).average();
     }
-    template<typename T, typename... Args>
-    inline void split(T t, Args... args) {
-        std::stringstream ss;
-        ss << t;
 
-        split(ss.str(), args...);
+    //! Starts a new percentile window for the frame and every node.
+    inline void resetHistograms() {
+        frameHistogram.reset();
+        for (auto& node : nodes) {
+            node.histogram.reset();
+            node.gpuHistogram.reset();
+        }
+
+        histogramWindowStart = std::chrono::system_clock::now();
+    }
+
+    inline bool hasGpuSamples(size_t node) {
+        if (!nodes[node].gpuDurations.samples.empty())
+            return true;
+
+        for (const auto& child : nodes[node].children) {
+            if (hasGpuSamples(child.second))
+                return true;
+        }
+
+        return false;
     }
 
     inline void print() {
         std::cout << "Times:"
                 << " (glFinishEnabled: " << std::boolalpha << glFinishEnabled << " (T to toggle))"
+                << " (gpu timing: " << gpuTimingActive() << ", dropped frames: " << droppedGpuFrames << ")"
                 << std::endl;
 
-        currentNode->print();
+        std::cout << "Frame: ";
+        printPercentiles(frameHistogram);
+        std::cout << " over " << frameHistogram.count() << " frames" << std::endl;
+
+        print(0);
+    }
+
+    //! Prints the histogram's mean and percentiles, in milliseconds. Leaves the stream's format unchanged.
+    inline void printPercentiles(const utility::Histogram& histogram) {
+        std::ios::fmtflags flags = std::cout.flags();
+        std::streamsize precision = std::cout.precision();
+
+        std::cout
+                << std::fixed << std::setprecision(2)
+                << "mean " << histogram.mean() / 1000.0
+                << ", p50 " << histogram.percentile(50) / 1000.0
+                << ", p90 " << histogram.percentile(90) / 1000.0
+                << ", p99 " << histogram.percentile(99) / 1000.0
+                << ", max " << histogram.max() / 1000.0 << " ms";
+
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+    inline void print(size_t node, int nesting = 0) {
+        int maxlen = 0;
+        double total = 0;
+
+        std::vector<std::pair<double, size_t>> data;
+        for (const auto& child : nodes[node].children) {
+            maxlen = std::max((int)labelName(child.first).length(), maxlen);
+            double avg = average(child.second);
+            total += avg;
+            data.emplace_back(avg, child.second);
+        }
+        sort(data.begin(), data.end(), [](const std::pair<double, size_t>& p1, const std::pair<double, size_t>& p2) {
+            return p1.first > p2.first;
+        });
+
+        for (const auto& pair : data) {
+            double avg = pair.first;
+            std::cout
+                    << std::setw(nesting * 4)
+                    << "| "
+                    << std::setw(maxlen)
+                    << labelName(nodes[pair.second].label) << ": "
+                    << std::fixed
+                    << std::setw(10)
+                    << std::setprecision(4)
+                    << avg << " ms, gpu ";
+
+            if (hasGpuSamples(pair.second)) {
+                std::cout << std::setw(10) << average(pair.second, true) << " ms, ";
+            } else {
+                std::cout << std::setw(10) << "-" << "    , ";
+            }
+
+            std::cout
+                    << std::setw(5)
+                    << std::setprecision(2)
+                    << (100 * avg / total)
+                    << "%";
+
+            if (nodes[pair.second].histogram.count() > 0) {
+                std::cout << " (";
+                printPercentiles(nodes[pair.second].histogram);
+                if (nodes[pair.second].gpuHistogram.count() > 0)
+                    std::cout << ", gpu p99 " << nodes[pair.second].gpuHistogram.percentile(99) / 1000.0 << " ms";
+                std::cout << ")";
+            }
+
+            std::cout << std::endl;
+
+            print(pair.second, nesting + 1);
+        }
     }
 
     inline void printEvery(double seconds) {
@@ -198,5 +452,325 @@ public:
             print();
             lastPrint = current;
         }
+
+        double windowMicro = std::chrono::duration_cast<std::chrono::microseconds>(current - histogramWindowStart).count();
+        if (histogramWindow > 0 && windowMicro / 1000000.0 > histogramWindow)
+            resetHistograms();
+    }
+
+    /**
+     * Waits for the GPU to finish, and records the GPU times of every frame still in flight. Used at the end of
+     * a benchmark, so that its last frames are included in the results.
+     */
+    inline void finishGpuFrames() {
+        if (!gpuTimingActive())
+            return;
+
+        glFinish();
+        for (int i = 1; i <= numGpuFrames; i++) {
+            resolveGpuFrame(gpuFrames[(currentGpuFrame + i) % numGpuFrames]);
+        }
+        lastGpuQuery = issueTimestamp(gpuFrames[currentGpuFrame]);
+    }
+
+    /**
+     * Writes the frame and per-scope statistics of the current histogram window as a JSON object. Times are in
+     * milliseconds, and scopes are named by their path from the root (e.g. "light 2/drawModels"). Scopes
+     * made with push only have times for the splits inside them.
+     */
+    inline void writeReport(std::ostream& out) {
+        out << "{\n  \"frame\": ";
+        writeHistogram(out, frameHistogram);
+        out << ",\n  \"droppedGpuFrames\": " << droppedGpuFrames << ",\n  \"scopes\": [";
+
+        bool first = true;
+        visitScopes([&](const std::string& name, const ProfilerNode& scope) {
+            out << (first ? "\n    " : ",\n    ") << "{\"name\": ";
+            writeJsonString(out, name);
+            if (scope.histogram.count() > 0) {
+                out << ", \"cpu\": ";
+                writeHistogram(out, scope.histogram);
+            }
+            if (scope.gpuHistogram.count() > 0) {
+                out << ", \"gpu\": ";
+                writeHistogram(out, scope.gpuHistogram);
+            }
+            out << "}";
+            first = false;
+        });
+        out << "\n  ]\n}";
+    }
+
+    /**
+     * Calls visit(path, scope) for every scope below the given node, parents before their children. Scopes are
+     * named by their path from the root, as in writeReport.
+     */
+    template <typename Visitor>
+    inline void visitScopes(Visitor&& visit, size_t node = 0, const std::string& path = "") {
+        for (const auto& child : nodes[node].children) {
+            const ProfilerNode& scope = nodes[child.second];
+            std::string name = path.empty() ? labelName(scope.label) : path + "/" + labelName(scope.label);
+            visit(name, scope);
+            visitScopes(visit, child.second, name);
+        }
+    }
+
+    /**
+     * Writes a JSON string, escaping the characters that labels could plausibly contain. If number is not negative,
+     * it is appended to the string.
+     */
+    static inline void writeJsonString(std::ostream& out, const std::string& str, int64_t number = -1) {
+        out << '"';
+        for (char c : str) {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        if (number >= 0)
+            out << number;
+        out << '"';
+    }
+
+private:
+    static const int numGpuFrames = 4;
+
+    struct GpuSample {
+        size_t node;
+        size_t startQuery;
+        size_t endQuery;
+        bool traced; // Whether the sample was taken while recording a trace.
+    };
+
+    //! The timestamp queries issued during one frame. The vectors are reused, so they only allocate while growing.
+    struct GpuFrame {
+        std::vector<GLuint> queries;
+        size_t usedQueries = 0;
+        std::vector<GpuSample> samples;
+    };
+
+    // The label registry is shared by all profilers, so that PROFILER_LABEL can cache IDs in statics.
+    static inline std::vector<std::string>& labelNames() {
+        static std::vector<std::string> names;
+        return names;
+    }
+
+    static inline std::unordered_map<std::string, LabelId>& labelIds() {
+        static std::unordered_map<std::string, LabelId> ids;
+        return ids;
+    }
+
+    static const LabelId noLabel = LabelId(-1);
+
+    //! The IDs of numbered labels, by base label and index (noLabel where not yet interned).
+    static inline std::vector<std::vector<LabelId>>& indexedLabelIds() {
+        static std::vector<std::vector<LabelId>> ids;
+        return ids;
+    }
+
+    std::vector<ProfilerNode> nodes; // nodes[0] is the root.
+    std::vector<size_t> nodeStack;
+    bool disabled = false;
+    std::chrono::system_clock::time_point frameStart;
+    std::chrono::system_clock::time_point histogramWindowStart;
+    bool requestedDisabled = false;
+
+    GpuFrame gpuFrames[numGpuFrames];
+    int currentGpuFrame = 0;
+    size_t lastGpuQuery = 0;
+    std::vector<GLuint64> timestamps;
+    unsigned droppedGpuFrames = 0;
+
+    enum TraceTrack : int {
+        frameTrack = 1,
+        cpuTrack = 2,
+        gpuTrack = 3,
+    };
+
+    struct TraceEvent {
+        LabelId label;
+        char phase; // 'X' (complete), 'B'/'E' (scope begin/end), or 'i' (instant).
+        int track;
+        int64_t timestamp; // Microseconds since the start of the trace.
+        int64_t duration;
+        int64_t number; // Appended to the label's name if not negative (e.g. "frame 12"), so that it needn't be interned.
+    };
+
+    std::ofstream traceFile;
+    std::vector<TraceEvent> traceEvents; // Events not yet written to the file.
+    std::chrono::system_clock::time_point traceStart;
+    std::chrono::system_clock::time_point lastFrameEnd;
+    int64_t gpuTraceOffset = 0; // GPU timestamp (in microseconds) at the start of the trace.
+    bool traceRecording = false;
+    bool firstTraceEvent = true;
+    int traceFramesLeft = 0;
+    int traceDrainFrames = 0;
+    unsigned traceFrameNumber = 0;
+
+    //! Microseconds since the start of the trace (clamped, as the first split may have started earlier).
+    inline int64_t traceTime(std::chrono::system_clock::time_point time) {
+        return std::max(int64_t(0), int64_t(std::chrono::duration_cast<std::chrono::microseconds>(time - traceStart).count()));
+    }
+
+    inline void addTraceEvent(LabelId label, char phase, int track, int64_t timestamp, int64_t duration,
+            int64_t number = -1) {
+        if (traceEvents.size() == traceEvents.capacity()) {
+            utility::ScopedAllowAllocations allow;
+            traceEvents.reserve(traceEvents.size() * 2 + 64);
+        }
+
+        traceEvents.push_back({label, phase, track, timestamp, duration, number});
+    }
+
+    inline void writeTrackName(int track, const char* name) {
+        writeTraceSeparator();
+        traceFile << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track
+                << ", \"args\": {\"name\": \"" << name << "\"}}";
+    }
+
+    inline void writeTraceSeparator() {
+        if (!firstTraceEvent)
+            traceFile << ",\n";
+        firstTraceEvent = false;
+    }
+
+    inline void endTraceFrame() {
+        auto now = std::chrono::system_clock::now();
+        if (traceRecording) {
+            addTraceEvent(PROFILER_LABEL("frame "), 'X', frameTrack,
+                    traceTime(lastFrameEnd), traceTime(now) - traceTime(lastFrameEnd), traceFrameNumber++);
+            lastFrameEnd = now;
+
+            if (traceFramesLeft > 0 && --traceFramesLeft == 0)
+                stopTrace();
+        }
+
+        for (const auto& event : traceEvents) {
+            writeTraceSeparator();
+            traceFile << "{\"name\": ";
+            writeJsonString(traceFile, labelName(event.label), event.number);
+            traceFile << ", \"ph\": \"" << event.phase << "\", \"pid\": 1, \"tid\": " << event.track
+                    << ", \"ts\": " << event.timestamp;
+
+            if (event.phase == 'X')
+                traceFile << ", \"dur\": " << event.duration;
+            if (event.phase == 'i')
+                traceFile << ", \"s\": \"g\"";
+
+            traceFile << "}";
+        }
+        traceEvents.clear();
+
+        if (!traceRecording && --traceDrainFrames <= 0) {
+            traceFile << "\n]}\n";
+            traceFile.close();
+            traceFrameNumber = 0;
+            std::cout << "Finished writing trace." << std::endl;
+        }
+    }
+
+    inline void writeHistogram(std::ostream& out, const utility::Histogram& histogram) {
+        out << std::fixed << std::setprecision(3)
+                << "{\"count\": " << histogram.count()
+                << ", \"mean\": " << histogram.mean() / 1000.0
+                << ", \"min\": " << histogram.min() / 1000.0
+                << ", \"p50\": " << histogram.percentile(50) / 1000.0
+                << ", \"p90\": " << histogram.percentile(90) / 1000.0
+                << ", \"p99\": " << histogram.percentile(99) / 1000.0
+                << ", \"max\": " << histogram.max() / 1000.0 << "}";
+    }
+
+    inline size_t findOrAddChild(size_t parent, LabelId label) {
+        for (const auto& child : nodes[parent].children) {
+            if (child.first == label)
+                return child.second;
+        }
+
+        utility::ScopedAllowAllocations allow;
+        size_t child = nodes.size();
+        nodes.push_back(ProfilerNode());
+        nodes[child].label = label;
+        nodes[parent].children.emplace_back(label, child);
+        return child;
+    }
+
+    inline void recordSplit(size_t node) {
+        // Wait until the effects of all previously called GL commands are complete.
+        if (glFinishEnabled)
+            glFinish();
+
+        auto end = std::chrono::system_clock::now();
+
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        nodes[node].durations.add(duration, sampleLimit);
+        nodes[node].histogram.record(std::max(decltype(duration.count())(0), duration.count()));
+        if (traceRecording)
+            addTraceEvent(nodes[node].label, 'X', cpuTrack, traceTime(start), traceTime(end) - traceTime(start));
+        start = end;
+
+        // Time the GPU work since the last split, if this frame's timing has been started by endFrame:
+        GpuFrame& frame = gpuFrames[currentGpuFrame];
+        if (gpuTimingActive() && frame.usedQueries > 0) {
+            size_t query = issueTimestamp(frame);
+
+            if (frame.samples.size() == frame.samples.capacity()) {
+                utility::ScopedAllowAllocations allow;
+                frame.samples.reserve(std::max(size_t(16), frame.samples.size() * 2));
+            }
+            frame.samples.push_back({node, lastGpuQuery, query, traceRecording});
+            lastGpuQuery = query;
+        }
+    }
+
+    inline bool gpuTimingActive() {
+        return gpuTimingEnabled && !disabled && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+    }
+
+    inline size_t issueTimestamp(GpuFrame& frame) {
+        if (frame.usedQueries == frame.queries.size()) {
+            utility::ScopedAllowAllocations allow;
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+
+        glQueryCounter(frame.queries[frame.usedQueries], GL_TIMESTAMP);
+        return frame.usedQueries++;
+    }
+
+    //! Records the frame's GPU times if its queries have completed, and frees the frame for reuse.
+    inline void resolveGpuFrame(GpuFrame& frame) {
+        if (frame.usedQueries > 0) {
+            // Queries complete in order, so if the last is available, all of them are:
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (available) {
+                if (timestamps.size() < frame.usedQueries) {
+                    utility::ScopedAllowAllocations allow;
+                    timestamps.resize(frame.usedQueries);
+                }
+
+                for (size_t i = 0; i < frame.usedQueries; i++) {
+                    glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+                }
+
+                for (auto& sample : frame.samples) {
+                    GLuint64 nanoseconds = timestamps[sample.endQuery] - timestamps[sample.startQuery];
+                    nodes[sample.node].gpuDurations.add(std::chrono::microseconds(nanoseconds / 1000), sampleLimit);
+                    nodes[sample.node].gpuHistogram.record(nanoseconds / 1000);
+
+                    if (sample.traced && traceFile.is_open()) {
+                        int64_t timestamp = int64_t(timestamps[sample.startQuery] / 1000) - gpuTraceOffset;
+                        addTraceEvent(nodes[sample.node].label, 'X', gpuTrack, timestamp, int64_t(nanoseconds / 1000));
+                    }
+                }
+            } else {
+                // The GPU is more than numGpuFrames behind; drop the frame rather than waiting for it.
+                droppedGpuFrames++;
+            }
+        }
+
+        frame.usedQueries = 0;
+        frame.samples.clear();
     }
 };
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+
+namespace utility {
+
+    /**
+     * A handle to an element of a SlotMap.
+     *
+     * Handles stay valid while other elements are inserted and erased. Once the element itself is erased, its
+     * slot's generation is incremented, so stale handles are detected instead of aliasing a newer element.
+     */
+    struct SlotHandle {
+        uint32_t index = 0;
+        uint32_t generation = 0; // Generation 0 is never issued, so a default constructed handle is null.
+
+        inline bool isNull() const {
+            return generation == 0;
+        }
+
+        inline bool operator==(const SlotHandle& other) const {
+            return index == other.index && generation == other.generation;
+        }
+
+        inline bool operator!=(const SlotHandle& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * Stores elements contiguously, addressed by generational handles.
+     *
+     * Iteration walks the dense element array directly. Erasing moves the last element into the gap, so the
+     * order of iteration is not preserved, but the array never has holes.
+     */
+    template<typename T>
+    class SlotMap {
+    public:
+        inline SlotHandle insert(T value) {
+            uint32_t slotIndex;
+            if (freeSlots.empty()) {
+                slotIndex = uint32_t(slots.size());
+                slots.push_back(Slot());
+            } else {
+                slotIndex = freeSlots.back();
+                freeSlots.pop_back();
+            }
+
+            Slot& slot = slots[slotIndex];
+            slot.denseIndex = uint32_t(dense.size());
+            dense.push_back(std::move(value));
+            denseToSlot.push_back(slotIndex);
+
+            SlotHandle handle;
+            handle.index = slotIndex;
+            handle.generation = slot.generation;
+            return handle;
+        }
+
+        inline void erase(SlotHandle handle) {
+            checkHandle(handle, __func__);
+
+            Slot& slot = slots[handle.index];
+            uint32_t last = uint32_t(dense.size() - 1);
+
+            if (slot.denseIndex != last) {
+                dense[slot.denseIndex] = std::move(dense[last]);
+                denseToSlot[slot.denseIndex] = denseToSlot[last];
+                slots[denseToSlot[last]].denseIndex = slot.denseIndex;
+            }
+
+            dense.pop_back();
+            denseToSlot.pop_back();
+
+            // Skip generation 0 on wrap around, as it marks null handles:
+            if (++slot.generation == 0)
+                slot.generation = 1;
+            freeSlots.push_back(handle.index);
+        }
+
+        inline bool contains(SlotHandle handle) const {
+            return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+        }
+
+        //! Returns the element, or nullptr if the handle is stale.
+        inline T* get(SlotHandle handle) {
+            return contains(handle) ? &dense[slots[handle.index].denseIndex] : nullptr;
+        }
+
+        inline T& operator[](SlotHandle handle) {
+            checkHandle(handle, __func__);
+            return dense[slots[handle.index].denseIndex];
+        }
+
+        //! Returns the element's position in the dense array (which changes when other elements are erased).
+        inline size_t denseIndexOf(SlotHandle handle) const {
+            checkHandle(handle, __func__);
+            return slots[handle.index].denseIndex;
+        }
+
+        //! Returns the handle of the element at the given position in the dense array.
+        inline SlotHandle handleAt(size_t denseIndex) const {
+            SlotHandle handle;
+            handle.index = denseToSlot[denseIndex];
+            handle.generation = slots[handle.index].generation;
+            return handle;
+        }
+
+        inline void clear() {
+            for (uint32_t slotIndex : denseToSlot) {
+                if (++slots[slotIndex].generation == 0)
+                    slots[slotIndex].generation = 1;
+                freeSlots.push_back(slotIndex);
+            }
+
+            dense.clear();
+            denseToSlot.clear();
+        }
+
+        inline size_t size() const { return dense.size(); }
+        inline bool empty() const { return dense.empty(); }
+
+        inline typename std::vector<T>::iterator begin() { return dense.begin(); }
+        inline typename std::vector<T>::iterator end() { return dense.end(); }
+        inline typename std::vector<T>::const_iterator begin() const { return dense.begin(); }
+        inline typename std::vector<T>::const_iterator end() const { return dense.end(); }
+
+    private:
+        struct Slot {
+            uint32_t denseIndex = 0;
+            uint32_t generation = 1;
+        };
+
+        inline void checkHandle(SlotHandle handle, const char* func) const {
+            if (!contains(handle)) {
+                std::stringstream errMsg;
+                errMsg << func << ": Invalid or stale handle (index == " << handle.index
+                        << ", generation == " << handle.generation << ").";
+                throw std::out_of_range(errMsg.str());
+            }
+        }
+
+        std::vector<T> dense;
+        std::vector<uint32_t> denseToSlot;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> freeSlots;
+    };
+}
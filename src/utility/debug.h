@@ -52,14 +52,15 @@ inline void checkForAndPrintGLError(int num) {
     }
 }
 
-inline void checkForAndPrintGLError(const std::string& file, int line) {
+// The file is a C string, as converting __FILE__ to a std::string would allocate on every check:
+inline void checkForAndPrintGLError(const char* file, int line) {
     auto err = glGetError();
     if (err) {
         std::cerr << "[" << file << ", " << line << "] " << getGLErrorName(err) << std::endl;
     }
 }
 
-inline void checkForAndPrintGLError(const std::string& file, int line, const std::string& info) {
+inline void checkForAndPrintGLError(const char* file, int line, const std::string& info) {
     auto err = glGetError();
     if (err) {
         std::cerr << "[" << file << ", " << line << ": " << info << "] " << getGLErrorName(err) << std::endl;
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define UTILITY_MATH_TRANSFORM_STORE_SSE
+#endif
+
+namespace utility {
+namespace math {
+
+    /**
+     * Stores 4x4 matrices as a structure of arrays.
+     *
+     * Element k (in column-major order) of every matrix is stored contiguously, so that the SIMD kernels in
+     * computeViewTransforms can multiply 4 (SSE) or 8 (AVX) matrices at once with broadcast scalars, without
+     * any shuffles until the results are written out.
+     */
+    class TransformStore {
+    public:
+        //! Reserves count consecutive matrices (initialised to identity), and returns the index of the first.
+        inline int allocate(int count) {
+            int first = numTransforms;
+            numTransforms += count;
+
+            size_t padded = (numTransforms + groupWidth - 1) / groupWidth * groupWidth;
+            for (int k = 0; k < 16; k++) {
+                elements[k].resize(padded, (k % 5 == 0) ? 1.0f : 0.0f);
+            }
+
+            return first;
+        }
+
+        inline void clear() {
+            numTransforms = 0;
+            for (auto &element : elements) {
+                element.clear();
+            }
+        }
+
+        inline int size() const {
+            return numTransforms;
+        }
+
+        inline void set(int index, const glm::mat4 &transform) {
+            const float *values = glm::value_ptr(transform);
+            for (int k = 0; k < 16; k++) {
+                elements[k][index] = values[k];
+            }
+        }
+
+        inline glm::mat4 get(int index) const {
+            glm::mat4 transform;
+            float *values = glm::value_ptr(transform);
+            for (int k = 0; k < 16; k++) {
+                values[k] = elements[k][index];
+            }
+            return transform;
+        }
+
+        /**
+         * For every stored world matrix, writes the three consecutive matrices (world, view * world,
+         * proj * view * world) to dst + index * stride.
+         *
+         * This matches the layout of a std140 block of three mat4s, so dst may point directly into a mapped
+         * uniform buffer. Neither dst nor stride need to be aligned.
+         */
+        inline void computeViewTransforms(const glm::mat4 &view, const glm::mat4 &proj, void *dst, size_t stride) const {
+            computeViewTransforms(view, proj, dst, stride, 0, numTransforms);
+        }
+
+        //! As above, for the transforms [begin, end) only (still written to dst + index * stride).
+        inline void computeViewTransforms(const glm::mat4 &view, const glm::mat4 &proj, void *dst, size_t stride,
+                int begin, int end) const {
+            unsigned char *out = static_cast<unsigned char *>(dst);
+            glm::mat4 viewProj = proj * view;
+            int i = begin;
+
+#if defined(__AVX__)
+            i = computeViewTransformsAvx(view, viewProj, out, stride, begin, end);
+#elif defined(UTILITY_MATH_TRANSFORM_STORE_SSE)
+            i = computeViewTransformsSse(view, viewProj, out, stride, begin, end);
+#endif
+
+            computeViewTransformsScalar(view, viewProj, out, stride, i, end);
+        }
+
+        //! The reference implementation of computeViewTransforms, for transforms [begin, end).
+        inline void computeViewTransformsScalar(const glm::mat4 &view, const glm::mat4 &viewProj,
+                unsigned char *out, size_t stride, int begin, int end) const {
+            for (int i = begin; i < end; i++) {
+                glm::mat4 world = get(i);
+                glm::mat4 results[3] = {world, view * world, viewProj * world};
+                std::memcpy(out + i * stride, results, sizeof(results));
+            }
+        }
+
+    private:
+        static const int groupWidth = 8;
+
+#if defined(UTILITY_MATH_TRANSFORM_STORE_SSE)
+        // Transposes four rows, each holding one matrix element of four transforms, into one column of each
+        // transform, and stores the columns.
+        static inline void storeColumnsSse(__m128 r0, __m128 r1, __m128 r2, __m128 r3, unsigned char *out, size_t stride) {
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(reinterpret_cast<float *>(out), r0);
+            _mm_storeu_ps(reinterpret_cast<float *>(out + stride), r1);
+            _mm_storeu_ps(reinterpret_cast<float *>(out + 2 * stride), r2);
+            _mm_storeu_ps(reinterpret_cast<float *>(out + 3 * stride), r3);
+        }
+#endif
+
+#if defined(__AVX__)
+        inline int computeViewTransformsAvx(const glm::mat4 &view, const glm::mat4 &viewProj, unsigned char *out, size_t stride,
+                int begin, int end) const {
+            __m256 a[2][16];
+            for (int k = 0; k < 16; k++) {
+                a[0][k] = _mm256_set1_ps(glm::value_ptr(view)[k]);
+                a[1][k] = _mm256_set1_ps(glm::value_ptr(viewProj)[k]);
+            }
+
+            int i = begin;
+            for (; i + 8 <= end; i += 8) {
+                __m256 results[3][16];
+                for (int k = 0; k < 16; k++) {
+                    results[0][k] = _mm256_loadu_ps(&elements[k][i]);
+                }
+
+                // (A * W)[c][r] = sum_k A[k][r] * W[c][k]
+                for (int m = 0; m < 2; m++) {
+                    for (int c = 0; c < 4; c++) {
+                        for (int r = 0; r < 4; r++) {
+                            __m256 sum = _mm256_mul_ps(a[m][r], results[0][c * 4]);
+                            sum = _mm256_add_ps(sum, _mm256_mul_ps(a[m][4 + r], results[0][c * 4 + 1]));
+                            sum = _mm256_add_ps(sum, _mm256_mul_ps(a[m][8 + r], results[0][c * 4 + 2]));
+                            sum = _mm256_add_ps(sum, _mm256_mul_ps(a[m][12 + r], results[0][c * 4 + 3]));
+                            results[m + 1][c * 4 + r] = sum;
+                        }
+                    }
+                }
+
+                for (int m = 0; m < 3; m++) {
+                    for (int c = 0; c < 4; c++) {
+                        __m256 *col = &results[m][c * 4];
+                        unsigned char *base = out + i * stride + (m * 4 + c) * 4 * sizeof(float);
+                        storeColumnsSse(_mm256_castps256_ps128(col[0]), _mm256_castps256_ps128(col[1]),
+                                _mm256_castps256_ps128(col[2]), _mm256_castps256_ps128(col[3]), base, stride);
+                        storeColumnsSse(_mm256_extractf128_ps(col[0], 1), _mm256_extractf128_ps(col[1], 1),
+                                _mm256_extractf128_ps(col[2], 1), _mm256_extractf128_ps(col[3], 1), base + 4 * stride, stride);
+                    }
+                }
+            }
+
+            return i;
+        }
+#endif
+
+#if defined(UTILITY_MATH_TRANSFORM_STORE_SSE)
+        inline int computeViewTransformsSse(const glm::mat4 &view, const glm::mat4 &viewProj, unsigned char *out, size_t stride,
+                int begin, int end) const {
+            __m128 a[2][16];
+            for (int k = 0; k < 16; k++) {
+                a[0][k] = _mm_set1_ps(glm::value_ptr(view)[k]);
+                a[1][k] = _mm_set1_ps(glm::value_ptr(viewProj)[k]);
+            }
+
+            int i = begin;
+            for (; i + 4 <= end; i += 4) {
+                __m128 results[3][16];
+                for (int k = 0; k < 16; k++) {
+                    results[0][k] = _mm_loadu_ps(&elements[k][i]);
+                }
+
+                // (A * W)[c][r] = sum_k A[k][r] * W[c][k]
+                for (int m = 0; m < 2; m++) {
+                    for (int c = 0; c < 4; c++) {
+                        for (int r = 0; r < 4; r++) {
+                            __m128 sum = _mm_mul_ps(a[m][r], results[0][c * 4]);
+                            sum = _mm_add_ps(sum, _mm_mul_ps(a[m][4 + r], results[0][c * 4 + 1]));
+                            sum = _mm_add_ps(sum, _mm_mul_ps(a[m][8 + r], results[0][c * 4 + 2]));
+                            sum = _mm_add_ps(sum, _mm_mul_ps(a[m][12 + r], results[0][c * 4 + 3]));
+                            results[m + 1][c * 4 + r] = sum;
+                        }
+                    }
+                }
+
+                for (int m = 0; m < 3; m++) {
+                    for (int c = 0; c < 4; c++) {
+                        __m128 *col = &results[m][c * 4];
+                        unsigned char *base = out + i * stride + (m * 4 + c) * 4 * sizeof(float);
+                        storeColumnsSse(col[0], col[1], col[2], col[3], base, stride);
+                    }
+                }
+            }
+
+            return i;
+        }
+#endif
+
+        std::vector<float> elements[16];
+        int numTransforms = 0;
+    };
+}
+}